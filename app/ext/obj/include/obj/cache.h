@@ -0,0 +1,38 @@
+#ifndef OBJ_CACHE_H
+#define OBJ_CACHE_H
+
+#include "model.h"
+
+/*
+ * Binary mesh cache stored next to the OBJ file (<model>.obj.mesh).
+ *
+ * The cache is keyed by the source path and the size and modification time of
+ * the source file and of its material library, so it is rebuilt automatically
+ * when the OBJ or the MTL file changes.
+ * Loading maps the file copy-on-write and points the model arrays directly
+ * into the mapping: there is no parsing or conversion at startup.
+ */
+
+/**
+ * Load the model from the cache of the source file.
+ * Returns FALSE if there is no valid (up to date) cache.
+ */
+int load_mesh_cache(Model* model, const char* source_filename);
+
+/**
+ * Write the cache file of the loaded model.
+ */
+int save_mesh_cache(const Model* model, const char* source_filename);
+
+/**
+ * Enable or disable the cache in load_model(). It is enabled by default,
+ * unless the OBJ_MESH_CACHE environment variable is set to 0.
+ */
+void set_mesh_cache_enabled(int enabled);
+
+/**
+ * Check whether load_model() uses the cache.
+ */
+int is_mesh_cache_enabled(void);
+
+#endif /* OBJ_CACHE_H */
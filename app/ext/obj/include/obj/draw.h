@@ -1,16 +1,114 @@
 #ifndef OBJ_DRAW_H
 #define OBJ_DRAW_H
 
+#include "meshlet.h"
 #include "model.h"
 
+/*
+ * Models with quantized vertices are drawn from them: the dequantization
+ * matrix (get_dequantization_matrix) has to be on the modelview stack and
+ * GL_NORMALIZE has to be enabled.
+ *
+ * Models with buffer objects (see gpu_mesh.h) are drawn with glDrawElements,
+ * the others in immediate mode. With DRAW_PATH_DISPLAY_LISTS the models with
+ * compiled lists replay them instead (meshlet culling is skipped then).
+ */
+
+/**
+ * How the models are drawn
+ */
+typedef enum DrawPath {
+    DRAW_PATH_IMMEDIATE,
+    DRAW_PATH_BUFFERS,
+    DRAW_PATH_DISPLAY_LISTS
+} DrawPath;
+
+/**
+ * Select the drawing path of all models (DRAW_PATH_BUFFERS by default).
+ */
+void set_draw_path(DrawPath path);
+
+/**
+ * Get the current drawing path.
+ */
+DrawPath get_draw_path(void);
+
+/**
+ * Compile (or recompile, after a vertex format change) one display list per
+ * level of detail, and one with the materials for models with materials.
+ * Returns FALSE if GL is out of list names or memory.
+ */
+int compile_model_lists(Model* model);
+
+/**
+ * Delete the display lists of the model (needed before free_model()).
+ */
+void release_model_lists(Model* model);
+
+/**
+ * Check whether the model has display lists for its current vertex format.
+ */
+int has_model_lists(const Model* model);
+
 /**
  * Draw the model.
  */
 void draw_model(const Model* model);
 
 /**
- * Draw the triangles of the model.
+ * Draw the given level of detail of the model (clamped to the available levels).
+ */
+void draw_model_lod(const Model* model, int level);
+
+/**
+ * Set the current color and the specular material of an OBJ material.
+ * GL_COLOR_MATERIAL has to track the ambient and diffuse terms.
+ */
+void apply_material(const ObjMaterial* material);
+
+/**
+ * Draw the given level of detail with the materials of its submeshes
+ * (draw_model_lod draws the geometry only).
+ */
+void draw_model_materials(const Model* model, int level);
+
+/**
+ * Placement of one copy of a model in draw_model_instanced()
+ */
+typedef struct ModelPlacement
+{
+    /* Column major matrix multiplied onto the modelview (with the dequantization of quantized models) */
+    float transform[16];
+    /* 2D texture of the copy (0 = none) */
+    unsigned int texture;
+} ModelPlacement;
+
+/**
+ * Draw the given level of detail with its materials at each placement with
+ * instanced draws: one glDrawElementsInstanced per submesh and per run of
+ * placements with the same texture (sort them by texture). The whole level is
+ * drawn, without meshlet culling.
+ * Returns the number of instanced draws, 0 when nothing was drawn (no
+ * instancing, or the model isn't drawn from its buffers): draw them one by one then.
+ * n_texture_binds receives the number of texture binds.
+ */
+int draw_model_instanced(const Model* model, int level, const ModelPlacement* placements, int n_placements,
+                         int* n_texture_binds);
+
+/**
+ * Draw the visible meshlets of the given level of detail and count the culled ones.
+ * The materials are applied once per submesh.
+ */
+void draw_model_culled(const Model* model, int level, const MeshletCuller* culler, MeshletStats* stats);
+
+/**
+ * Draw the triangles of the model (full detail).
  */
 void draw_triangles(const Model* model);
 
+/**
+ * Draw the triangles of a range of the index buffer.
+ */
+void draw_index_range(const Model* model, int first_index, int n_indices);
+
 #endif /* OBJ_DRAW_H */
@@ -0,0 +1,26 @@
+#ifndef OBJ_GLB_H
+#define OBJ_GLB_H
+
+#include "model.h"
+
+/*
+ * Binary glTF 2.0 (GLB) import.
+ *
+ * The file is memory mapped copy-on-write and there is no text parsing of the
+ * geometry: the accessors of the binary chunk are used in place as the vertex
+ * and index storage of the model when their layout matches the mesh layout
+ * (interleaved float position, normal and uv with a 32 byte stride, and 16 or
+ * 32 bit indices of consecutive primitives). Other layouts are gathered into
+ * new arrays with one copy.
+ *
+ * The triangle primitives of all meshes are loaded, one submesh per primitive
+ * with the base color of its material. Node transformations, sparse accessors
+ * and embedded images are not supported.
+ */
+
+/**
+ * Load a GLB model (the mesh cache and the common mesh processing of load_model() apply).
+ */
+int load_glb_model(Model* model, const char* filename);
+
+#endif /* OBJ_GLB_H */
@@ -0,0 +1,110 @@
+#ifndef OBJ_GPU_MESH_H
+#define OBJ_GPU_MESH_H
+
+#include "model.h"
+
+#include <stddef.h>
+
+/*
+ * Retained mode drawing: the vertices and the index buffer of the model are
+ * uploaded once into buffer objects (VBO + IBO, recorded in a vertex array
+ * object where available), and the draw functions of draw.h issue one
+ * glDrawElements per index range instead of a glBegin/glEnd vertex loop.
+ *
+ * Float models upload their MeshVertex array as it is. Quantized models upload
+ * 16 byte vertices: the 16 bit positions and uvs as they are (dequantized by
+ * the modelview and the texture matrix) and the decoded normals as 3x16 bits.
+ *
+ * The immediate mode path stays the fallback: without GL 1.5 or
+ * ARB_vertex_buffer_object, with OBJ_GPU_BUFFERS=0, or for a model whose
+ * buffers are missing or older than its vertex format.
+ *
+ * Instanced draws (GL 2.0 with GL 3.3, or ARB_draw_instanced and
+ * ARB_instanced_arrays) draw many copies of a range with one glDrawElementsInstanced:
+ * the matrix of each copy is a per-instance vertex attribute read by a small
+ * vertex program, which also does the fixed-function lighting.
+ * OBJ_GPU_INSTANCING=0 turns them off.
+ */
+
+/**
+ * Address of a GL function by name (SDL_GL_GetProcAddress, wglGetProcAddress, ...)
+ */
+typedef void* (*GlProcLoader)(const char* name);
+
+/**
+ * Load the buffer object functions of the current GL context.
+ * Returns FALSE when the models are drawn in immediate mode.
+ */
+int init_gpu_buffers(GlProcLoader loader);
+
+/**
+ * Check whether upload_model_buffers() creates buffers.
+ */
+int is_gpu_buffers_enabled(void);
+
+/**
+ * Build the instancing program (called by init_gpu_buffers()).
+ * Returns FALSE when instanced draws are not available.
+ */
+int init_gpu_instancing(GlProcLoader loader);
+
+/**
+ * Check whether begin_instanced_draw() can be used.
+ */
+int is_gpu_instancing_enabled(void);
+
+/**
+ * Delete the instancing program and its buffer (before the context is destroyed).
+ */
+void release_gpu_instancing(void);
+
+/**
+ * Upload the instances (each starts with its column major matrix, stride bytes
+ * apart), bind the program and the buffers of the model.
+ * Returns FALSE (nothing bound) without instancing or buffers for the model.
+ */
+int begin_instanced_draw(const Model* model, const void* instances, int n_instances, int stride);
+
+/**
+ * Draw a range of the index buffer once per instance from first_instance on.
+ */
+void draw_instanced_range(const Model* model, int first_index, int n_indices, int first_instance,
+                          int n_instances);
+
+/**
+ * Unbind what begin_instanced_draw() bound.
+ */
+void end_instanced_draw(const Model* model);
+
+/**
+ * Create (or rebuild, after a vertex format change) the buffers of the model.
+ */
+int upload_model_buffers(Model* model);
+
+/**
+ * Delete the buffers of the model (needed before free_model()).
+ */
+void release_model_buffers(Model* model);
+
+/**
+ * Check whether the model has buffers for its current vertex format.
+ */
+int has_model_buffers(const Model* model);
+
+/**
+ * Size of the uploaded vertex buffer in bytes (0 without buffers).
+ */
+size_t get_model_vertex_buffer_size(const Model* model);
+
+/**
+ * Set up the vertex arrays of the model for glDrawElements (index offsets are
+ * in bytes from the start of the index buffer).
+ */
+void bind_model_buffers(const Model* model);
+
+/**
+ * Restore the state changed by bind_model_buffers().
+ */
+void unbind_model_buffers(const Model* model);
+
+#endif /* OBJ_GPU_MESH_H */
@@ -0,0 +1,67 @@
+#ifndef OBJ_JSON_H
+#define OBJ_JSON_H
+
+#include <stddef.h>
+
+/*
+ * Minimal in-place JSON tokenizer (for the glTF scene description).
+ *
+ * The text is not copied or modified: the tokens are ranges of it. The tokens
+ * are stored in document order; the children of an object are its keys and
+ * every key has its value as its only child.
+ */
+
+typedef enum {
+    JSON_OBJECT,
+    JSON_ARRAY,
+    JSON_STRING,
+    JSON_PRIMITIVE
+} JsonType;
+
+typedef struct JsonToken
+{
+    JsonType type;
+    /* Range of the text (without the quotes of strings) */
+    int start;
+    int end;
+    /* Number of children */
+    int size;
+} JsonToken;
+
+/**
+ * Tokenize the text. Returns the allocated token array (NULL on syntax error)
+ * and the number of tokens in n_tokens.
+ */
+JsonToken* tokenize_json(const char* text, size_t length, int* n_tokens);
+
+/**
+ * Index of the token after the given token and all of its children.
+ */
+int skip_json_token(const JsonToken* tokens, int index);
+
+/**
+ * Index of the value of the key in the object, or -1.
+ */
+int find_json_key(const char* text, const JsonToken* tokens, int object, const char* key);
+
+/**
+ * Index of the n-th element of the array, or -1.
+ */
+int get_json_element(const JsonToken* tokens, int array, int n);
+
+/**
+ * Check whether the string token equals to the given text.
+ */
+int is_json_string(const char* text, const JsonToken* token, const char* value);
+
+/**
+ * Integer value of a primitive token (or the fallback when the token is missing or not a number).
+ */
+int get_json_int(const char* text, const JsonToken* tokens, int index, int fallback);
+
+/**
+ * Floating point value of a primitive token (or the fallback).
+ */
+double get_json_double(const char* text, const JsonToken* tokens, int index, double fallback);
+
+#endif /* OBJ_JSON_H */
@@ -3,20 +3,62 @@
 
 #include "model.h"
 
+#include <stddef.h>
 #include <stdio.h>
 
 /**
  * Load OBJ model from file.
+ * The file is memory mapped and parsed in place when possible,
+ * then the vertices are welded into an indexed mesh (see weld.h).
  */
 int load_model(Model* model, const char* filename);
 
 /**
- * Count the elements in the model and set counts in the structure.
+ * Build the levels of detail, optimize the mesh, split it into meshlets and
+ * write its mesh cache (the common steps after reading an indexed mesh).
  */
-void count_elements(Model* model, FILE* file);
+int process_loaded_mesh(Model* model, const char* filename);
 
 /**
- * Read the elements of the model and fill the structure with values.
+ * Read the elements of the model directly from an in-memory OBJ text.
+ * The buffer doesn't need to be NUL-terminated and lines have no length limit.
+ */
+int read_elements_from_memory(Model* model, const char* data, size_t size);
+
+/**
+ * Read the elements of an in-memory OBJ text on several threads.
+ * The text is split at line boundaries, the chunks are parsed in parallel and
+ * stitched in file order, so the result is the same as the serial reader's.
+ */
+int read_elements_parallel(Model* model, const char* data, size_t size, int n_threads);
+
+/**
+ * Set the number of threads used by load_model(). 0 means automatic:
+ * the OBJ_LOAD_THREADS environment variable if set, otherwise all cores.
+ * Small files are always read on a single thread.
+ */
+void set_load_thread_count(int count);
+
+/**
+ * Get the effective number of threads used by load_model().
+ */
+int get_load_thread_count(void);
+
+/**
+ * Keep the double precision OBJ elements (vertices, texture vertices, normals
+ * and triangles) next to the single precision mesh after loading.
+ * Disabled by default; when enabled the mesh cache is bypassed.
+ */
+void set_high_precision_import(int enabled);
+
+/**
+ * Check whether load_model() keeps the double precision OBJ elements.
+ */
+int is_high_precision_import(void);
+
+/**
+ * Read the elements of the model in a single pass and fill the structure with values.
+ * The arrays grow geometrically while reading and are shrunk to fit at the end.
  */
 int read_elements(Model* model, FILE* file);
 
@@ -0,0 +1,32 @@
+#ifndef OBJ_MAPFILE_H
+#define OBJ_MAPFILE_H
+
+#include <stddef.h>
+
+/**
+ * Read-only view of a whole file mapped into memory
+ */
+typedef struct MappedFile
+{
+    const char* data;
+    size_t size;
+    void* handle;
+} MappedFile;
+
+/**
+ * Map the file into memory. An empty file gives a valid mapping with NULL data.
+ */
+int map_file(MappedFile* file, const char* filename);
+
+/**
+ * Map the file copy-on-write: the pages can be modified in memory,
+ * but the changes are private and never written back to the file.
+ */
+int map_file_private(MappedFile* file, const char* filename);
+
+/**
+ * Release the mapping.
+ */
+void unmap_file(MappedFile* file);
+
+#endif /* OBJ_MAPFILE_H */
@@ -0,0 +1,22 @@
+#ifndef OBJ_MATERIAL_H
+#define OBJ_MATERIAL_H
+
+#include "model.h"
+
+#include <stddef.h>
+
+/**
+ * Read the material library (mtllib) of the model.
+ *
+ * The library path is relative to the directory of the OBJ file.
+ * Only the materials used by the model (usemtl) are filled, the others are skipped.
+ * Materials missing from the library keep their defaults.
+ */
+int load_material_library(Model* model, const char* obj_filename);
+
+/**
+ * Path of a material library named in the OBJ file (relative to its directory).
+ */
+void get_material_library_path(char* path, size_t size, const char* obj_filename, const char* library);
+
+#endif /* OBJ_MATERIAL_H */
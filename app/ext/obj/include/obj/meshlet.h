@@ -0,0 +1,73 @@
+#ifndef OBJ_MESHLET_H
+#define OBJ_MESHLET_H
+
+#include "model.h"
+
+/* Limits of one meshlet */
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 126
+
+/**
+ * Result of the meshlet culling test
+ */
+typedef enum {
+    MESHLET_VISIBLE,
+    MESHLET_OUTSIDE_FRUSTUM,
+    MESHLET_BACKFACING
+} MeshletVisibility;
+
+/**
+ * View of the model for meshlet culling, in model space
+ */
+typedef struct MeshletCuller
+{
+    /* Frustum planes (left, right, bottom, top, near, far): ax + by + cz + d >= 0 inside. */
+    float planes[6][4];
+    float camera[3];
+    /* Backface cone test: only valid when back faces are culled and the scale is uniform. */
+    int cone_culling;
+} MeshletCuller;
+
+/**
+ * Culling counters (accumulated over the drawn models)
+ */
+typedef struct MeshletStats
+{
+    int n_meshlets;
+    int n_frustum_culled;
+    int n_backface_culled;
+    int n_triangles;
+    int n_triangles_culled;
+} MeshletStats;
+
+/**
+ * Split every submesh of every level of detail into meshlets of consecutive triangles
+ * (at most MESHLET_MAX_VERTICES vertices and MESHLET_MAX_TRIANGLES triangles)
+ * and compute their bounding spheres and normal cones.
+ * The triangle order is kept, so the meshlets follow the vertex cache order.
+ */
+int build_meshlets(Model* model);
+
+/**
+ * Recompute the bounding spheres and normal cones of the meshlets after the
+ * vertex positions changed (see scale_model()).
+ */
+void update_meshlet_bounds(Model* model);
+
+/**
+ * Set up the culler from the OpenGL modelview (model to eye) and projection matrices.
+ */
+void init_meshlet_culler(MeshletCuller* culler, const float modelview[16],
+                         const float projection[16], int cone_culling);
+
+/**
+ * Test the meshlet against the frustum and the view direction.
+ */
+MeshletVisibility cull_meshlet(const MeshletCuller* culler, const Meshlet* meshlet);
+
+/**
+ * Reset the counters.
+ */
+void reset_meshlet_stats(MeshletStats* stats);
+
+#endif /* OBJ_MESHLET_H */
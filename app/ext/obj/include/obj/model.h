@@ -6,6 +6,18 @@
 
 #define INVALID_VERTEX_INDEX 0
 
+#define MAX_MODEL_LODS 4
+
+#define MAX_MATERIAL_NAME 64
+#define MAX_MATERIAL_PATH 256
+
+/* Material index of the triangles before the first usemtl */
+#define NO_MATERIAL (-1)
+
+/* Bits of Model.vertex_attributes */
+#define MESH_HAS_NORMALS 1
+#define MESH_HAS_UVS 2
+
 /**
  * Three dimensional vertex
  */
@@ -36,15 +48,178 @@ typedef struct FacePoint
 } FacePoint;
 
 /**
- * Triangle as facepoint triplet
+ * Triangle as facepoint triplet with the index of its material
  */
 typedef struct Triangle
 {
     struct FacePoint points[3];
+    int material;
 } Triangle;
 
+/**
+ * Material of an MTL library
+ *
+ * The colors are RGB (Ka, Kd, Ks), the shininess is the MTL Ns (0 .. 1000),
+ * the alpha is the dissolve (d). The texture is the map_Kd file name as written
+ * in the library (empty when the material has none).
+ */
+typedef struct ObjMaterial
+{
+    char name[MAX_MATERIAL_NAME];
+    float ambient[3];
+    float diffuse[3];
+    float specular[3];
+    float shininess;
+    float alpha;
+    char texture[MAX_MATERIAL_NAME];
+} ObjMaterial;
+
+/**
+ * Triangles of one material in one level of detail: a range of the index buffer
+ *
+ * The material is an index of the material table (or NO_MATERIAL).
+ * The meshlets of the range are first_meshlet .. + n_meshlets.
+ */
+typedef struct Submesh
+{
+    int material;
+    int first_index;
+    int n_indices;
+    int first_meshlet;
+    int n_meshlets;
+} Submesh;
+
+/**
+ * Vertex of the welded mesh: one unique (vertex, texture, normal) combination
+ *
+ * Interleaved single precision layout (32 bytes), ready for vertex arrays and
+ * GPU upload. The uv is the OpenGL texture coordinate (v is already flipped).
+ */
+typedef struct MeshVertex
+{
+    float position[3];
+    float normal[3];
+    float uv[2];
+} MeshVertex;
+
+/**
+ * Quantized mesh vertex with a 2x8 bit octahedral normal (12 bytes)
+ *
+ * The position and the uv are 16 bit signed normalized values in the
+ * bounds of the model (see VertexQuantization).
+ */
+typedef struct QuantizedVertex8
+{
+    short position[3];
+    short uv[2];
+    signed char normal[2];
+} QuantizedVertex8;
+
+/**
+ * Quantized mesh vertex with a 2x16 bit octahedral normal (16 bytes)
+ */
+typedef struct QuantizedVertex16
+{
+    short position[3];
+    short uv[2];
+    short normal[2];
+    short reserved;
+} QuantizedVertex16;
+
+/**
+ * Dequantization of the quantized vertices: value = offset + q * scale
+ *
+ * normal_bits is 8 or 16 (QuantizedVertex8 or QuantizedVertex16),
+ * 0 when the model has no quantized vertices.
+ */
+typedef struct VertexQuantization
+{
+    int normal_bits;
+    float position_offset[3];
+    float position_scale[3];
+    float uv_offset[2];
+    float uv_scale[2];
+} VertexQuantization;
+
+/**
+ * Level of detail: a range of the index buffer
+ *
+ * All levels index the same mesh vertices. The error is the geometric error
+ * of the simplification in model units (0 for the full detail level).
+ */
+typedef struct ModelLod
+{
+    int first_index;
+    int n_indices;
+    float error;
+    int first_meshlet;
+    int n_meshlets;
+    int first_submesh;
+    int n_submeshes;
+} ModelLod;
+
+/**
+ * Small cluster of triangles: a range of the index buffer with its bounds
+ *
+ * The bounding sphere and the normal cone (axis and cutoff) are in model space
+ * and are used for frustum and backface culling of the whole cluster.
+ */
+typedef struct Meshlet
+{
+    int first_index;
+    int n_indices;
+    float center[3];
+    float radius;
+    float cone_axis[3];
+    float cone_cutoff;
+} Meshlet;
+
+/**
+ * Buffer objects (see gpu_mesh.h) and display lists (see draw.h) of a model,
+ * 0 names when it has none
+ *
+ * normal_bits and list_normal_bits are the vertex formats the buffers and the
+ * lists were built from (like in VertexQuantization); they are stale when it
+ * differs from the model. The display lists are display_lists + level * list_stride
+ * for the geometry and + 1 for the geometry with the materials (list_stride 2).
+ */
+typedef struct GpuMesh
+{
+    unsigned int vertex_buffer;
+    unsigned int index_buffer;
+    unsigned int vertex_array;
+    int normal_bits;
+    unsigned int display_lists;
+    int list_stride;
+    int list_normal_bits;
+} GpuMesh;
+
 /**
  * Three dimensional model with texture
+ *
+ * The loader reads the OBJ elements (vertices, texture_vertices, normals and
+ * triangles) in double precision, then welds them into the single precision
+ * mesh_vertices array and an index buffer of 16 or 32 bit indices
+ * (index_size is 2 or 4 bytes). The mesh arrays are the runtime representation;
+ * the double precision elements are only kept for high precision import.
+ *
+ * The index buffer holds the levels of detail one after the other; lods[0] is
+ * the full detail mesh and n_triangles is its triangle count. Each level is
+ * split into meshlets (lods[i].first_meshlet .. + n_meshlets).
+ *
+ * The triangles of a level are grouped by material into contiguous submeshes
+ * (lods[i].first_submesh .. + n_submeshes); meshlets don't cross submeshes.
+ * The material table comes from the mtllib of the OBJ file (material_library).
+ *
+ * vertex_attributes (MESH_HAS_NORMALS, MESH_HAS_UVS) tells which attributes
+ * come from the file; the others hold the default slot values.
+ *
+ * The optional quantized_vertices are a compact copy of mesh_vertices for
+ * drawing; they are always heap allocated (see quantize.h).
+ *
+ * gpu holds the buffer objects and the display lists of the mesh once built;
+ * they have to be released with release_model_buffers() and
+ * release_model_lists() (on the GL thread) before free_model().
  */
 typedef struct Model
 {
@@ -56,6 +231,26 @@ typedef struct Model
     TextureVertex* texture_vertices;
     Vertex* normals;
     Triangle* triangles;
+    int n_mesh_vertices;
+    int n_indices;
+    int index_size;
+    int vertex_attributes;
+    MeshVertex* mesh_vertices;
+    void* indices;
+    int n_lods;
+    ModelLod lods[MAX_MODEL_LODS];
+    int n_meshlets;
+    Meshlet* meshlets;
+    int n_submeshes;
+    Submesh* submeshes;
+    int n_materials;
+    ObjMaterial* materials;
+    char material_library[MAX_MATERIAL_PATH];
+    void* quantized_vertices;
+    VertexQuantization quantization;
+    GpuMesh gpu;
+    /* Memory mapped file (mesh cache or GLB) some of the arrays point into (NULL when they are all heap allocated). */
+    void* mapping;
 } Model;
 
 /**
@@ -66,7 +261,9 @@ typedef enum {
     VERTEX,
     TEXTURE_VERTEX,
     NORMAL,
-    FACE
+    FACE,
+    MATERIAL_LIBRARY,
+    USE_MATERIAL
 } ElementType;
 
 /**
@@ -79,6 +276,31 @@ void init_model(Model* model);
  */
 void allocate_model(Model* model);
 
+/**
+ * Get the i-th element of the index buffer.
+ */
+unsigned int get_model_index(const Model* model, int i);
+
+/**
+ * Check whether the array points into the memory mapped file of the model (it is not freed then).
+ */
+int is_model_array_mapped(const Model* model, const void* array);
+
+/**
+ * Find the material by name. Returns its index or NO_MATERIAL.
+ */
+int find_model_material(const Model* model, const char* name);
+
+/**
+ * Add a material with default colors (or find the existing one). Returns its index or NO_MATERIAL.
+ */
+int add_model_material(Model* model, const char* name);
+
+/**
+ * Release the OBJ element arrays (vertices, texture vertices, normals and triangles).
+ */
+void free_model_elements(Model* model);
+
 /**
  * Release the allocated memory of the model.
  */
@@ -0,0 +1,50 @@
+#ifndef OBJ_OPTIMIZE_H
+#define OBJ_OPTIMIZE_H
+
+#include "model.h"
+
+/**
+ * Post-transform vertex cache statistics of the index buffer
+ */
+typedef struct VertexCacheStats
+{
+    /* Average cache miss ratio: transformed vertices per triangle (0.5 .. 3). */
+    float acmr;
+    /* Average transformed to vertex ratio: transformed vertices per vertex (1 is ideal). */
+    float atvr;
+} VertexCacheStats;
+
+/**
+ * Enable or disable the optimizer stage of load_model().
+ * Enabled by default; the environment variable OBJ_OPTIMIZE=0 disables it.
+ */
+void set_mesh_optimization_enabled(int enabled);
+
+/**
+ * Check whether load_model() optimizes the mesh.
+ */
+int is_mesh_optimization_enabled(void);
+
+/**
+ * Simulate a FIFO post-transform cache of the given size over the full detail level.
+ */
+VertexCacheStats analyze_vertex_cache(const Model* model, int cache_size);
+
+/**
+ * Reorder the triangles for post-transform cache locality
+ * (Forsyth's linear-speed vertex cache optimization), submesh by submesh.
+ */
+int optimize_vertex_cache(Model* model);
+
+/**
+ * Reorder the vertices in the order of their first use by the index buffer
+ * for vertex fetch locality. Unreferenced vertices are dropped.
+ */
+int optimize_vertex_fetch(Model* model);
+
+/**
+ * Run both optimizations and print the ACMR/ATVR before and after.
+ */
+int optimize_model(Model* model);
+
+#endif /* OBJ_OPTIMIZE_H */
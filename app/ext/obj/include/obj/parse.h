@@ -0,0 +1,33 @@
+#ifndef OBJ_PARSE_H
+#define OBJ_PARSE_H
+
+/*
+ * In-place text scanning helpers for memory mapped model files.
+ *
+ * The buffers are not NUL-terminated, so every function takes the end of
+ * the buffer and never reads past it. The number parsers are locale-free.
+ */
+
+/**
+ * Skip spaces, tabs and carriage returns (but not the newline).
+ */
+const char* skip_spaces(const char* p, const char* end);
+
+/**
+ * Skip the rest of the line including the newline character.
+ */
+const char* skip_line(const char* p, const char* end);
+
+/**
+ * Parse a decimal integer. Returns the position after it, or NULL when there is no number
+ * or it doesn't fit into an int.
+ */
+const char* parse_int(const char* p, const char* end, int* value);
+
+/**
+ * Parse a decimal floating point number (with optional exponent).
+ * Returns the position after it, or NULL when there is no number.
+ */
+const char* parse_double(const char* p, const char* end, double* value);
+
+#endif /* OBJ_PARSE_H */
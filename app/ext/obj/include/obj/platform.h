@@ -0,0 +1,28 @@
+#ifndef OBJ_PLATFORM_H
+#define OBJ_PLATFORM_H
+
+/* Most tasks run_parallel() starts (the extra tasks are not run) */
+#define MAX_PARALLEL_TASKS 64
+
+/**
+ * Task function of a parallel run. It receives the shared context and the task index.
+ */
+typedef void (*ParallelTask)(void* context, int task_index);
+
+/**
+ * Number of logical processors (at least 1).
+ */
+int get_cpu_count(void);
+
+/**
+ * Run n_tasks instances of the task, each on its own thread, and wait for all of them.
+ * The calling thread runs the first task itself. n_tasks is at most MAX_PARALLEL_TASKS.
+ */
+void run_parallel(ParallelTask task, void* context, int n_tasks);
+
+/**
+ * Monotonic wall-clock time in seconds (for load time reports).
+ */
+double get_time_seconds(void);
+
+#endif /* OBJ_PLATFORM_H */
@@ -0,0 +1,42 @@
+#ifndef OBJ_QUANTIZE_H
+#define OBJ_QUANTIZE_H
+
+#include "model.h"
+
+#include <stddef.h>
+
+/**
+ * Build the quantized copy of the mesh vertices: 16 bit positions and uvs
+ * normalized to the bounds of the model and octahedral normals of
+ * 2x8 or 2x16 bits (normal_bits is 8 or 16).
+ * An earlier quantized copy is replaced.
+ */
+int quantize_model(Model* model, int normal_bits);
+
+/**
+ * Release the quantized vertices (the model is drawn from mesh_vertices again).
+ */
+void free_quantized_vertices(Model* model);
+
+/**
+ * Size of the vertex data drawn by the model in bytes (quantized or float).
+ */
+size_t get_vertex_data_size(const Model* model);
+
+/**
+ * Model space transformation of the quantized positions (column major, for glMultMatrixf).
+ */
+void get_dequantization_matrix(const Model* model, float matrix[16]);
+
+/**
+ * Remove the dequantization matrix from the end of a modelview matrix, giving the
+ * transformation of the float model space (used by the meshlet bounds).
+ */
+void remove_dequantization(const Model* model, float modelview[16]);
+
+/**
+ * Decode an octahedral normal (x and y in [-1, 1]) to a unit vector.
+ */
+void decode_octahedral_normal(float x, float y, float normal[3]);
+
+#endif /* OBJ_QUANTIZE_H */
@@ -0,0 +1,28 @@
+#ifndef OBJ_SANITIZE_H
+#define OBJ_SANITIZE_H
+
+#include "model.h"
+
+/**
+ * Counters of the sanitization pass
+ */
+typedef struct SanitizeStats
+{
+    int n_out_of_range;
+    int n_degenerate;
+    int n_missing_textures;
+    int n_missing_normals;
+} SanitizeStats;
+
+/**
+ * Validate and repair the triangles of the OBJ elements before welding.
+ *
+ * Triangles with a missing or out of range vertex index and degenerate
+ * triangles (repeated vertex or zero area) are dropped. Missing or out of range
+ * texture and normal indices are set to the default slot 0.
+ * The vertex_attributes of the model tell whether any corner has a real
+ * normal or texture coordinate, so the renderer can skip the attribute.
+ */
+int sanitize_model(Model* model, SanitizeStats* stats);
+
+#endif /* OBJ_SANITIZE_H */
@@ -0,0 +1,35 @@
+#ifndef OBJ_SIMPLIFY_H
+#define OBJ_SIMPLIFY_H
+
+#include "model.h"
+
+/**
+ * Enable or disable the level of detail generation of load_model().
+ * Enabled by default; the environment variable OBJ_LODS=0 disables it.
+ */
+void set_lod_generation_enabled(int enabled);
+
+/**
+ * Check whether load_model() builds the levels of detail.
+ */
+int is_lod_generation_enabled(void);
+
+/**
+ * Simplify a triangle list with quadric error metrics (edge collapses onto
+ * existing vertices, so the result indexes the same vertex array).
+ * Vertices on borders and on normal/texture seams are kept in place.
+ * Returns the index count written to the output (at most n_indices).
+ * The error is the geometric error of the result in model units.
+ */
+int simplify_indices(unsigned int* output, const unsigned int* indices, int n_indices,
+                     const MeshVertex* vertices, int n_vertices,
+                     int target_index_count, float max_error, float* result_error);
+
+/**
+ * Append the levels of detail to the index buffer of the welded model:
+ * each level has about half the triangles of the previous one.
+ * Every submesh (material) is simplified on its own.
+ */
+int generate_model_lods(Model* model);
+
+#endif /* OBJ_SIMPLIFY_H */
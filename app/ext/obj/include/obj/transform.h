@@ -4,7 +4,8 @@
 #include "model.h"
 
 /**
- * Scale the loaded model.
+ * Scale the loaded model. The meshlet bounds are updated, and the buffers and
+ * display lists of the model are rebuilt when it has some (needs its GL context).
  */
 void scale_model(Model* model, double sx, double sy, double sz);
 
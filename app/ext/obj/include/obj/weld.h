@@ -0,0 +1,19 @@
+#ifndef OBJ_WELD_H
+#define OBJ_WELD_H
+
+#include "model.h"
+
+/**
+ * Weld the (vertex, texture, normal) index triplets of the triangle corners.
+ *
+ * Every unique triplet becomes one interleaved MeshVertex and the triangles
+ * become an index buffer (16 bit when the vertex count allows it, 32 bit otherwise).
+ * The triangles are grouped by material into the submeshes of the full detail level.
+ * The indices have to be valid (see sanitize_model); missing texture and
+ * normal indices refer to the default slot 0.
+ * The double precision OBJ element arrays are released afterwards,
+ * unless keep_elements is TRUE.
+ */
+int weld_model(Model* model, int keep_elements);
+
+#endif /* OBJ_WELD_H */
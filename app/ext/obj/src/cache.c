@@ -0,0 +1,431 @@
+#include "cache.h"
+#include "mapfile.h"
+#include "material.h"
+#include "optimize.h"
+#include "simplify.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define MESH_CACHE_MAGIC 0x4D4A424FU /* "OBJM" */
+#define MESH_CACHE_VERSION 9
+#define MESH_CACHE_ALIGNMENT 16
+#define MESH_CACHE_SUFFIX ".mesh"
+#define CACHE_PATH_SIZE 512
+
+/* Header flags: the options the mesh was built with */
+#define MESH_CACHE_OPTIMIZED 0x1U
+#define MESH_CACHE_LODS 0x2U
+
+/**
+ * Arrays stored in the cache file
+ */
+typedef enum {
+    CACHE_MESH_VERTICES,
+    CACHE_INDICES,
+    CACHE_MESHLETS,
+    CACHE_SUBMESHES,
+    CACHE_MATERIALS,
+    N_CACHE_SECTIONS
+} CacheSection;
+
+typedef struct MeshCacheSection
+{
+    uint64_t offset;
+    uint64_t size;
+} MeshCacheSection;
+
+typedef struct MeshCacheLod
+{
+    int32_t first_index;
+    int32_t n_indices;
+    float error;
+    int32_t first_meshlet;
+    int32_t n_meshlets;
+    int32_t first_submesh;
+    int32_t n_submeshes;
+    int32_t reserved;
+} MeshCacheLod;
+
+typedef struct MeshCacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t file_size;
+    uint64_t source_size;
+    int64_t source_mtime;
+    uint64_t source_path_hash;
+    int32_t n_mesh_vertices;
+    int32_t n_indices;
+    int32_t index_size;
+    /* MESH_CACHE_OPTIMIZED, ... */
+    uint32_t flags;
+    int32_t n_lods;
+    int32_t n_meshlets;
+    /* MESH_HAS_NORMALS, MESH_HAS_UVS */
+    uint32_t vertex_attributes;
+    int32_t n_submeshes;
+    int32_t n_materials;
+    int32_t reserved;
+    /* mtllib of the source (empty without one) and the key of that file (0 when missing) */
+    uint64_t library_size;
+    int64_t library_mtime;
+    char material_library[MAX_MATERIAL_PATH];
+    MeshCacheLod lods[MAX_MODEL_LODS];
+    MeshCacheSection sections[N_CACHE_SECTIONS];
+} MeshCacheHeader;
+
+static int mesh_cache_state = -1;
+
+void set_mesh_cache_enabled(int enabled)
+{
+    mesh_cache_state = enabled ? TRUE : FALSE;
+}
+
+int is_mesh_cache_enabled(void)
+{
+    if (mesh_cache_state < 0) {
+        const char* env = getenv("OBJ_MESH_CACHE");
+        mesh_cache_state = (env != NULL && strcmp(env, "0") == 0) ? FALSE : TRUE;
+    }
+    return mesh_cache_state;
+}
+
+static uint64_t hash_path(const char* path)
+{
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    while (*path) {
+        hash ^= (unsigned char)*path++;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static int make_cache_path(char* out, size_t out_size, const char* source_filename)
+{
+    int length = snprintf(out, out_size, "%s%s", source_filename, MESH_CACHE_SUFFIX);
+    return length > 0 && (size_t)length < out_size;
+}
+
+static int get_source_key(const char* source_filename, MeshCacheHeader* header)
+{
+    struct stat info;
+
+    if (stat(source_filename, &info) != 0) {
+        return FALSE;
+    }
+    header->source_size = (uint64_t)info.st_size;
+    header->source_mtime = (int64_t)info.st_mtime;
+    header->source_path_hash = hash_path(source_filename);
+    header->flags = (is_mesh_optimization_enabled() ? MESH_CACHE_OPTIMIZED : 0)
+        | (is_lod_generation_enabled() ? MESH_CACHE_LODS : 0);
+    return TRUE;
+}
+
+/**
+ * Key of the material library: the materials of the cache are stale when it changes.
+ */
+static void get_library_key(const char* source_filename, const char* library, MeshCacheHeader* header)
+{
+    char path[MAX_MATERIAL_PATH * 2];
+    struct stat info;
+
+    header->library_size = 0;
+    header->library_mtime = 0;
+    if (library[0] == 0) {
+        return;
+    }
+    get_material_library_path(path, sizeof(path), source_filename, library);
+    if (stat(path, &info) == 0) {
+        header->library_size = (uint64_t)info.st_size;
+        header->library_mtime = (int64_t)info.st_mtime;
+    }
+}
+
+static uint64_t align_offset(uint64_t offset)
+{
+    return (offset + (MESH_CACHE_ALIGNMENT - 1)) & ~(uint64_t)(MESH_CACHE_ALIGNMENT - 1);
+}
+
+static int is_section_valid(const MappedFile* file, const MeshCacheHeader* header,
+                            CacheSection section, uint64_t expected_size)
+{
+    const MeshCacheSection* s = &header->sections[section];
+
+    return s->size == expected_size && s->offset % MESH_CACHE_ALIGNMENT == 0
+        && s->offset <= file->size && s->size <= file->size - s->offset;
+}
+
+/**
+ * Data of a valid section. An empty section is NULL, like an empty array of a
+ * loaded model: its offset may be the end of the file, outside of the mapping.
+ */
+static void* get_section(const MappedFile* file, const MeshCacheHeader* header, CacheSection section)
+{
+    const MeshCacheSection* s = &header->sections[section];
+
+    return (s->size > 0) ? (void*)(file->data + s->offset) : NULL;
+}
+
+static int validate_submeshes(const Model* model)
+{
+    int i;
+
+    for (i = 0; i < model->n_submeshes; ++i) {
+        const Submesh* submesh = &model->submeshes[i];
+        if (submesh->material < NO_MATERIAL || submesh->material >= model->n_materials
+            || submesh->first_index < 0 || submesh->n_indices < 0
+            || submesh->first_index > model->n_indices - submesh->n_indices
+            || submesh->first_meshlet < 0 || submesh->n_meshlets < 0
+            || submesh->first_meshlet > model->n_meshlets - submesh->n_meshlets) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/**
+ * Check the mapped data the draw loops index with: a corrupted file with a
+ * valid header must not read out of the arrays (one linear scan, far cheaper
+ * than parsing).
+ */
+static int validate_mesh_data(const Model* model)
+{
+    int i;
+
+    for (i = 0; i < model->n_indices; ++i) {
+        if (get_model_index(model, i) >= (unsigned int)model->n_mesh_vertices) {
+            return FALSE;
+        }
+    }
+    for (i = 0; i < model->n_meshlets; ++i) {
+        const Meshlet* meshlet = &model->meshlets[i];
+        if (meshlet->first_index < 0 || meshlet->n_indices < 0
+            || meshlet->first_index > model->n_indices - meshlet->n_indices) {
+            return FALSE;
+        }
+    }
+    for (i = 0; i < model->n_materials; ++i) {
+        const ObjMaterial* material = &model->materials[i];
+        if (memchr(material->name, 0, sizeof(material->name)) == NULL
+            || memchr(material->texture, 0, sizeof(material->texture)) == NULL) {
+            return FALSE;
+        }
+    }
+    return validate_submeshes(model);
+}
+
+static int attach_cache(Model* model, MappedFile* file, const MeshCacheHeader* key,
+                        const char* source_filename)
+{
+    MeshCacheHeader header;
+    MeshCacheHeader library_key;
+    int i;
+
+    if (file->size < sizeof(MeshCacheHeader)) {
+        return FALSE;
+    }
+    memcpy(&header, file->data, sizeof(header));
+    if (header.magic != MESH_CACHE_MAGIC || header.version != MESH_CACHE_VERSION
+        || header.file_size != file->size
+        || header.source_size != key->source_size
+        || header.source_mtime != key->source_mtime
+        || header.source_path_hash != key->source_path_hash
+        || header.n_mesh_vertices < 0 || header.n_indices < 0 || header.n_indices % 3 != 0
+        || header.flags != key->flags
+        || (header.index_size != 2 && header.index_size != 4)
+        || header.n_lods < 1 || header.n_lods > MAX_MODEL_LODS || header.n_meshlets < 0
+        || header.vertex_attributes > (MESH_HAS_NORMALS | MESH_HAS_UVS)
+        || header.n_submeshes < 0 || header.n_materials < 0
+        || memchr(header.material_library, 0, sizeof(header.material_library)) == NULL) {
+        return FALSE;
+    }
+    get_library_key(source_filename, header.material_library, &library_key);
+    if (header.library_size != library_key.library_size
+        || header.library_mtime != library_key.library_mtime) {
+        return FALSE;
+    }
+    for (i = 0; i < header.n_lods; ++i) {
+        const MeshCacheLod* lod = &header.lods[i];
+        if (lod->first_index < 0 || lod->n_indices < 0 || lod->n_indices % 3 != 0
+            || lod->first_index > header.n_indices - lod->n_indices
+            || lod->first_meshlet < 0 || lod->n_meshlets < 0
+            || lod->first_meshlet > header.n_meshlets - lod->n_meshlets
+            || lod->first_submesh < 0 || lod->n_submeshes < 0
+            || lod->first_submesh > header.n_submeshes - lod->n_submeshes) {
+            return FALSE;
+        }
+    }
+
+    init_model(model);
+    model->n_mesh_vertices = header.n_mesh_vertices;
+    model->n_indices = header.n_indices;
+    model->n_triangles = header.lods[0].n_indices / 3;
+    model->index_size = header.index_size;
+    model->vertex_attributes = (int)header.vertex_attributes;
+    model->n_lods = header.n_lods;
+    for (i = 0; i < header.n_lods; ++i) {
+        model->lods[i].first_index = header.lods[i].first_index;
+        model->lods[i].n_indices = header.lods[i].n_indices;
+        model->lods[i].error = header.lods[i].error;
+        model->lods[i].first_meshlet = header.lods[i].first_meshlet;
+        model->lods[i].n_meshlets = header.lods[i].n_meshlets;
+        model->lods[i].first_submesh = header.lods[i].first_submesh;
+        model->lods[i].n_submeshes = header.lods[i].n_submeshes;
+    }
+    model->n_meshlets = header.n_meshlets;
+    model->n_submeshes = header.n_submeshes;
+    model->n_materials = header.n_materials;
+    memcpy(model->material_library, header.material_library, sizeof(model->material_library));
+    if (is_section_valid(file, &header, CACHE_MESH_VERTICES,
+                         (uint64_t)header.n_mesh_vertices * sizeof(MeshVertex)) == FALSE
+        || is_section_valid(file, &header, CACHE_INDICES,
+                            (uint64_t)header.n_indices * (uint64_t)header.index_size) == FALSE
+        || is_section_valid(file, &header, CACHE_MESHLETS,
+                            (uint64_t)header.n_meshlets * sizeof(Meshlet)) == FALSE
+        || is_section_valid(file, &header, CACHE_SUBMESHES,
+                            (uint64_t)header.n_submeshes * sizeof(Submesh)) == FALSE
+        || is_section_valid(file, &header, CACHE_MATERIALS,
+                            (uint64_t)header.n_materials * sizeof(ObjMaterial)) == FALSE) {
+        init_model(model);
+        return FALSE;
+    }
+    model->mesh_vertices = (MeshVertex*)get_section(file, &header, CACHE_MESH_VERTICES);
+    model->indices = get_section(file, &header, CACHE_INDICES);
+    model->meshlets = (Meshlet*)get_section(file, &header, CACHE_MESHLETS);
+    model->submeshes = (Submesh*)get_section(file, &header, CACHE_SUBMESHES);
+    model->materials = (ObjMaterial*)get_section(file, &header, CACHE_MATERIALS);
+    if (validate_mesh_data(model) == FALSE) {
+        init_model(model);
+        return FALSE;
+    }
+    model->mapping = file;
+    return TRUE;
+}
+
+int load_mesh_cache(Model* model, const char* source_filename)
+{
+    char cache_path[CACHE_PATH_SIZE];
+    MeshCacheHeader key;
+    MappedFile* file;
+
+    if (make_cache_path(cache_path, sizeof(cache_path), source_filename) == FALSE
+        || get_source_key(source_filename, &key) == FALSE) {
+        return FALSE;
+    }
+    file = (MappedFile*)malloc(sizeof(MappedFile));
+    if (file == NULL) {
+        return FALSE;
+    }
+    if (map_file_private(file, cache_path) == FALSE) {
+        free(file);
+        return FALSE;
+    }
+    if (attach_cache(model, file, &key, source_filename) == FALSE) {
+        // Missing, stale or from another version: the caller rebuilds it.
+        unmap_file(file);
+        free(file);
+        return FALSE;
+    }
+    printf("Mapped mesh cache '%s'\n", cache_path);
+    return TRUE;
+}
+
+static int write_section(FILE* file, MeshCacheHeader* header, CacheSection section,
+                         const void* data, uint64_t size, uint64_t* offset_io)
+{
+    static const char padding[MESH_CACHE_ALIGNMENT] = { 0 };
+    const uint64_t offset = align_offset(*offset_io);
+
+    if (offset > *offset_io
+        && fwrite(padding, 1, (size_t)(offset - *offset_io), file) != (size_t)(offset - *offset_io)) {
+        return FALSE;
+    }
+    if (size > 0 && fwrite(data, 1, (size_t)size, file) != (size_t)size) {
+        return FALSE;
+    }
+    header->sections[section].offset = offset;
+    header->sections[section].size = size;
+    *offset_io = offset + size;
+    return TRUE;
+}
+
+int save_mesh_cache(const Model* model, const char* source_filename)
+{
+    char cache_path[CACHE_PATH_SIZE];
+    char temp_path[CACHE_PATH_SIZE + 4];
+    MeshCacheHeader header;
+    uint64_t offset;
+    FILE* file;
+    int success;
+    int i;
+
+    memset(&header, 0, sizeof(header));
+    if (make_cache_path(cache_path, sizeof(cache_path), source_filename) == FALSE
+        || get_source_key(source_filename, &header) == FALSE) {
+        return FALSE;
+    }
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", cache_path);
+
+    // Write to a temporary file first, so a half-written cache is never picked up.
+    file = fopen(temp_path, "wb");
+    if (file == NULL) {
+        return FALSE;
+    }
+    header.magic = MESH_CACHE_MAGIC;
+    header.version = MESH_CACHE_VERSION;
+    header.n_mesh_vertices = model->n_mesh_vertices;
+    header.n_indices = model->n_indices;
+    header.index_size = model->index_size;
+    header.n_lods = model->n_lods;
+    header.n_meshlets = model->n_meshlets;
+    header.vertex_attributes = (uint32_t)model->vertex_attributes;
+    for (i = 0; i < model->n_lods; ++i) {
+        header.lods[i].first_index = model->lods[i].first_index;
+        header.lods[i].n_indices = model->lods[i].n_indices;
+        header.lods[i].error = model->lods[i].error;
+        header.lods[i].first_meshlet = model->lods[i].first_meshlet;
+        header.lods[i].n_meshlets = model->lods[i].n_meshlets;
+        header.lods[i].first_submesh = model->lods[i].first_submesh;
+        header.lods[i].n_submeshes = model->lods[i].n_submeshes;
+    }
+    header.n_submeshes = model->n_submeshes;
+    header.n_materials = model->n_materials;
+    memcpy(header.material_library, model->material_library, sizeof(header.material_library));
+    get_library_key(source_filename, header.material_library, &header);
+
+    offset = sizeof(header);
+    success = fwrite(&header, sizeof(header), 1, file) == 1
+        && write_section(file, &header, CACHE_MESH_VERTICES, model->mesh_vertices,
+                         (uint64_t)model->n_mesh_vertices * sizeof(MeshVertex), &offset)
+        && write_section(file, &header, CACHE_INDICES, model->indices,
+                         (uint64_t)model->n_indices * (uint64_t)model->index_size, &offset)
+        && write_section(file, &header, CACHE_MESHLETS, model->meshlets,
+                         (uint64_t)model->n_meshlets * sizeof(Meshlet), &offset)
+        && write_section(file, &header, CACHE_SUBMESHES, model->submeshes,
+                         (uint64_t)model->n_submeshes * sizeof(Submesh), &offset)
+        && write_section(file, &header, CACHE_MATERIALS, model->materials,
+                         (uint64_t)model->n_materials * sizeof(ObjMaterial), &offset);
+
+    // The header is completed with the section table at the end.
+    header.file_size = offset;
+    success = success && fseek(file, 0, SEEK_SET) == 0
+        && fwrite(&header, sizeof(header), 1, file) == 1;
+    success = (fclose(file) == 0) && success;
+    if (success == FALSE) {
+        remove(temp_path);
+        return FALSE;
+    }
+#ifdef _WIN32
+    remove(cache_path);
+#endif
+    if (rename(temp_path, cache_path) != 0) {
+        remove(temp_path);
+        return FALSE;
+    }
+    return TRUE;
+}
@@ -1,55 +1,485 @@
 #include "draw.h"
+#include "gpu_mesh.h"
+#include "meshlet.h"
+#include "quantize.h"
 
 #include <GL/gl.h>
 
+#include <stddef.h>
+
+static DrawPath draw_path = DRAW_PATH_BUFFERS;
+
+void set_draw_path(DrawPath path)
+{
+    draw_path = path;
+}
+
+DrawPath get_draw_path(void)
+{
+    return draw_path;
+}
+
+/**
+ * Clamp the level and return it (there is always at least one level after welding).
+ */
+static int clamp_level(const Model* model, int level)
+{
+    if (level >= model->n_lods) {
+        level = model->n_lods - 1;
+    }
+    return (level > 0) ? level : 0;
+}
+
+/**
+ * Replay the display list of the level when the lists are selected.
+ * Returns FALSE when the model has to be drawn from its arrays.
+ */
+static int call_model_list(const Model* model, int level, int with_materials)
+{
+    GLuint list;
+
+    if (draw_path != DRAW_PATH_DISPLAY_LISTS || !has_model_lists(model)) {
+        return FALSE;
+    }
+    list = model->gpu.display_lists + (GLuint)(clamp_level(model, level) * model->gpu.list_stride);
+    if (with_materials && model->gpu.list_stride == 2) {
+        list += 1;
+    }
+    glCallList(list);
+    return TRUE;
+}
+
 void draw_model(const Model* model)
 {
-    draw_triangles(model);
+    draw_model_lod(model, 0);
 }
 
+void draw_model_lod(const Model* model, int level)
+{
+    if (call_model_list(model, level, FALSE)) {
+        return;
+    }
+    if (level >= model->n_lods) {
+        level = model->n_lods - 1;
+    }
+    if (level <= 0) {
+        draw_triangles(model);
+        return;
+    }
+    draw_index_range(model, model->lods[level].first_index, model->lods[level].n_indices);
+}
+
+typedef void (*EmitRangeFunction)(const MeshVertex* vertices, const void* indices, int n_indices);
+
+/*
+ * Branch-free vertex loop, specialized at compile time for the index type and
+ * for the attributes the model has (HAS_NORMALS and HAS_UVS are constants).
+ */
+#define DEFINE_EMIT_RANGE(name, INDEX_TYPE, HAS_NORMALS, HAS_UVS) \
+    static void name(const MeshVertex* vertices, const void* index_data, int n_indices) \
+    { \
+        const INDEX_TYPE* indices = (const INDEX_TYPE*)index_data; \
+        int i; \
+        for (i = 0; i < n_indices; ++i) { \
+            const MeshVertex* vertex = &vertices[indices[i]]; \
+            if (HAS_NORMALS) { \
+                glNormal3fv(vertex->normal); \
+            } \
+            if (HAS_UVS) { \
+                glTexCoord2fv(vertex->uv); \
+            } \
+            glVertex3fv(vertex->position); \
+        } \
+    }
+
+DEFINE_EMIT_RANGE(emit_range_16, unsigned short, 0, 0)
+DEFINE_EMIT_RANGE(emit_range_16_n, unsigned short, 1, 0)
+DEFINE_EMIT_RANGE(emit_range_16_t, unsigned short, 0, 1)
+DEFINE_EMIT_RANGE(emit_range_16_nt, unsigned short, 1, 1)
+DEFINE_EMIT_RANGE(emit_range_32, unsigned int, 0, 0)
+DEFINE_EMIT_RANGE(emit_range_32_n, unsigned int, 1, 0)
+DEFINE_EMIT_RANGE(emit_range_32_t, unsigned int, 0, 1)
+DEFINE_EMIT_RANGE(emit_range_32_nt, unsigned int, 1, 1)
+
+/* Indexed by [index_size == 4][vertex_attributes] */
+static const EmitRangeFunction emit_range_functions[2][4] = {
+    { emit_range_16, emit_range_16_n, emit_range_16_t, emit_range_16_nt },
+    { emit_range_32, emit_range_32_n, emit_range_32_t, emit_range_32_nt }
+};
+
 void draw_triangles(const Model* model)
 {
-    int i, k;
-    int vertex_index, texture_index, normal_index;
-    float x, y, z, u, v;
+    draw_index_range(model, 0, model->n_triangles * 3);
+}
+
+/**
+ * Normal factors of quantized models: the dequantization scale in the modelview
+ * matrix turns the normals by its inverse, so they are pre-scaled by the same
+ * (relative) scale. GL_NORMALIZE restores the unit length.
+ */
+static void calc_normal_scale(const VertexQuantization* quantization, float normal_scale[3])
+{
+    const float* scale = quantization->position_scale;
+    float max_scale = scale[0];
+    int k;
 
+    if (scale[1] > max_scale) {
+        max_scale = scale[1];
+    }
+    if (scale[2] > max_scale) {
+        max_scale = scale[2];
+    }
+    for (k = 0; k < 3; ++k) {
+        normal_scale[k] = scale[k] / max_scale;
+    }
+}
+
+static void draw_quantized_vertex(const short position[3], const short uv[2], float nx, float ny,
+                                  const VertexQuantization* quantization, const float normal_scale[3])
+{
+    float normal[3];
+
+    decode_octahedral_normal(nx, ny, normal);
+    glNormal3f(normal[0] * normal_scale[0], normal[1] * normal_scale[1], normal[2] * normal_scale[2]);
+    glTexCoord2f(quantization->uv_offset[0] + (float)uv[0] * quantization->uv_scale[0],
+                 quantization->uv_offset[1] + (float)uv[1] * quantization->uv_scale[1]);
+    glVertex3sv(position);
+}
+
+static void emit_quantized_index_range(const Model* model, int first_index, int n_indices)
+{
+    const VertexQuantization* quantization = &model->quantization;
+    float normal_scale[3];
+    int i;
+
+    calc_normal_scale(quantization, normal_scale);
+    if (quantization->normal_bits == 8) {
+        const QuantizedVertex8* vertices = (const QuantizedVertex8*)model->quantized_vertices;
+        for (i = 0; i < n_indices; ++i) {
+            const QuantizedVertex8* vertex = &vertices[get_model_index(model, first_index + i)];
+            draw_quantized_vertex(vertex->position, vertex->uv,
+                                  vertex->normal[0] / 127.0f, vertex->normal[1] / 127.0f,
+                                  quantization, normal_scale);
+        }
+    }
+    else {
+        const QuantizedVertex16* vertices = (const QuantizedVertex16*)model->quantized_vertices;
+        for (i = 0; i < n_indices; ++i) {
+            const QuantizedVertex16* vertex = &vertices[get_model_index(model, first_index + i)];
+            draw_quantized_vertex(vertex->position, vertex->uv,
+                                  vertex->normal[0] / 32767.0f, vertex->normal[1] / 32767.0f,
+                                  quantization, normal_scale);
+        }
+    }
+}
+
+static void emit_index_range(const Model* model, int first_index, int n_indices)
+{
+    // The welded mesh has no invalid indices (see sanitize_model). An attribute
+    // the file doesn't have is set once to the default slot value.
+    const int attributes = model->vertex_attributes & (MESH_HAS_NORMALS | MESH_HAS_UVS);
+    const int is_32bit = (model->index_size == 4);
+
+    if (model->quantized_vertices != NULL) {
+        emit_quantized_index_range(model, first_index, n_indices);
+        return;
+    }
+    if ((attributes & MESH_HAS_NORMALS) == 0) {
+        glNormal3f(0.0f, 0.0f, 1.0f);
+    }
+    if ((attributes & MESH_HAS_UVS) == 0) {
+        glTexCoord2f(0.0f, 1.0f);
+    }
+    emit_range_functions[is_32bit][attributes](model->mesh_vertices,
+        (const char*)model->indices + (size_t)first_index * (size_t)model->index_size, n_indices);
+}
+
+/**
+ * Draw a range of the index buffer from the bound buffers of the model.
+ */
+static void draw_elements(const Model* model, int first_index, int n_indices)
+{
+    const GLenum type = (model->index_size == 4) ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
+
+    if (n_indices > 0) {
+        glDrawElements(GL_TRIANGLES, n_indices, type,
+                       (const void*)((size_t)first_index * (size_t)model->index_size));
+    }
+}
+
+/**
+ * Bind the buffers of the model for a series of ranges.
+ * Returns FALSE when the model is drawn in immediate mode.
+ */
+static int begin_buffered_draw(const Model* model)
+{
+    if (draw_path == DRAW_PATH_IMMEDIATE || !has_model_buffers(model)) {
+        return FALSE;
+    }
+    bind_model_buffers(model);
+    return TRUE;
+}
+
+/**
+ * Draw a range from the bound buffers or in immediate mode.
+ */
+static void draw_range(const Model* model, int first_index, int n_indices, int is_buffered)
+{
+    if (is_buffered) {
+        draw_elements(model, first_index, n_indices);
+        return;
+    }
     glBegin(GL_TRIANGLES);
+    emit_index_range(model, first_index, n_indices);
+    glEnd();
+}
 
-    for (i = 0; i < model->n_triangles; ++i) {
-        for (k = 0; k < 3; ++k) {
-
-            normal_index = model->triangles[i].points[k].normal_index;
-            if (model->n_normals > 0 && normal_index > 0 && normal_index <= model->n_normals) {
-                x = model->normals[normal_index].x;
-                y = model->normals[normal_index].y;
-                z = model->normals[normal_index].z;
-            } else {
-                // Safe default normal (Z-up)
-                x = 0.0f; y = 0.0f; z = 1.0f;
+void draw_index_range(const Model* model, int first_index, int n_indices)
+{
+    const int is_buffered = begin_buffered_draw(model);
+
+    draw_range(model, first_index, n_indices, is_buffered);
+    if (is_buffered) {
+        unbind_model_buffers(model);
+    }
+}
+
+void apply_material(const ObjMaterial* material)
+{
+    // GL_COLOR_MATERIAL tracks the current color for the ambient and diffuse terms.
+    const float shininess = material->shininess * 128.0f / 1000.0f;
+    float specular[4];
+
+    specular[0] = material->specular[0];
+    specular[1] = material->specular[1];
+    specular[2] = material->specular[2];
+    specular[3] = 1.0f;
+    glColor4f(material->diffuse[0], material->diffuse[1], material->diffuse[2], material->alpha);
+    glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, specular);
+    glMaterialf(GL_FRONT_AND_BACK, GL_SHININESS, (shininess < 128.0f) ? shininess : 128.0f);
+}
+
+/**
+ * Draw the ranges of a level (with the materials of its submeshes).
+ */
+static void draw_level(const Model* model, int level, int is_buffered)
+{
+    const ModelLod* lod;
+    int i;
+
+    if (model->n_lods == 0) {
+        draw_range(model, 0, model->n_triangles * 3, is_buffered);
+        return;
+    }
+    lod = &model->lods[level];
+    if (lod->n_submeshes == 0) {
+        draw_range(model, lod->first_index, lod->n_indices, is_buffered);
+        return;
+    }
+    for (i = lod->first_submesh; i < lod->first_submesh + lod->n_submeshes; ++i) {
+        const Submesh* submesh = &model->submeshes[i];
+        if (submesh->material != NO_MATERIAL) {
+            apply_material(&model->materials[submesh->material]);
+        }
+        draw_range(model, submesh->first_index, submesh->n_indices, is_buffered);
+    }
+}
+
+void draw_model_materials(const Model* model, int level)
+{
+    int is_buffered;
+
+    level = clamp_level(model, level);
+    if (model->n_lods == 0 || model->lods[level].n_submeshes == 0) {
+        draw_model_lod(model, level);
+        return;
+    }
+    if (call_model_list(model, level, TRUE)) {
+        return;
+    }
+    is_buffered = begin_buffered_draw(model);
+    draw_level(model, level, is_buffered);
+    if (is_buffered) {
+        unbind_model_buffers(model);
+    }
+}
+
+int draw_model_instanced(const Model* model, int level, const ModelPlacement* placements, int n_placements,
+                         int* n_texture_binds)
+{
+    const ModelLod* lod;
+    int n_draws = 0;
+    int first;
+    int count;
+    int i;
+
+    *n_texture_binds = 0;
+    if (draw_path != DRAW_PATH_BUFFERS || model->n_lods == 0
+        || !begin_instanced_draw(model, placements, n_placements, (int)sizeof(ModelPlacement))) {
+        return 0;
+    }
+    lod = &model->lods[clamp_level(model, level)];
+    for (first = 0; first < n_placements; first += count) {
+        count = 1;
+        while (first + count < n_placements && placements[first + count].texture == placements[first].texture) {
+            count++;
+        }
+        glBindTexture(GL_TEXTURE_2D, placements[first].texture);
+        *n_texture_binds += 1;
+        if (lod->n_submeshes == 0) {
+            draw_instanced_range(model, lod->first_index, lod->n_indices, first, count);
+            n_draws += 1;
+            continue;
+        }
+        for (i = lod->first_submesh; i < lod->first_submesh + lod->n_submeshes; ++i) {
+            const Submesh* submesh = &model->submeshes[i];
+            if (submesh->material != NO_MATERIAL) {
+                apply_material(&model->materials[submesh->material]);
             }
-            glNormal3f(x, y, z);
-
-            texture_index = model->triangles[i].points[k].texture_index;
-            if (model->n_texture_vertices > 0 && texture_index > 0 && texture_index <= model->n_texture_vertices) {
-                u = model->texture_vertices[texture_index].u;
-                v = model->texture_vertices[texture_index].v;
-            } else {
-                u = 0.0f; v = 0.0f;
+            draw_instanced_range(model, submesh->first_index, submesh->n_indices, first, count);
+            n_draws += 1;
+        }
+    }
+    end_instanced_draw(model);
+    return n_draws;
+}
+
+/**
+ * Draw the visible meshlets of a range. From buffers, the runs of visible
+ * meshlets that are contiguous in the index buffer are drawn by one call.
+ */
+static void draw_meshlet_range(const Model* model, int first_meshlet, int n_meshlets,
+                               const MeshletCuller* culler, MeshletStats* stats, int is_buffered)
+{
+    int run_first = 0;
+    int run_count = 0;
+    int i;
+
+    if (!is_buffered) {
+        glBegin(GL_TRIANGLES);
+    }
+    for (i = first_meshlet; i < first_meshlet + n_meshlets; ++i) {
+        const Meshlet* meshlet = &model->meshlets[i];
+        const MeshletVisibility visibility = cull_meshlet(culler, meshlet);
+
+        stats->n_meshlets += 1;
+        stats->n_triangles += meshlet->n_indices / 3;
+        if (visibility == MESHLET_VISIBLE) {
+            if (!is_buffered) {
+                emit_index_range(model, meshlet->first_index, meshlet->n_indices);
+            }
+            else if (run_count > 0 && run_first + run_count == meshlet->first_index) {
+                run_count += meshlet->n_indices;
             }
-            glTexCoord2f(u, 1.0f - v);
-
-            vertex_index = model->triangles[i].points[k].vertex_index;
-            if (vertex_index > 0 && vertex_index <= model->n_vertices) {
-                x = model->vertices[vertex_index].x;
-                y = model->vertices[vertex_index].y;
-                z = model->vertices[vertex_index].z;
-                glVertex3f(x, y, z);
-            } else {
-                // Skip invalid vertex
-                glVertex3f(0.0f, 0.0f, 0.0f);
+            else {
+                draw_elements(model, run_first, run_count);
+                run_first = meshlet->first_index;
+                run_count = meshlet->n_indices;
             }
+            continue;
+        }
+        if (visibility == MESHLET_OUTSIDE_FRUSTUM) {
+            stats->n_frustum_culled += 1;
+        }
+        else {
+            stats->n_backface_culled += 1;
         }
+        stats->n_triangles_culled += meshlet->n_indices / 3;
     }
+    if (is_buffered) {
+        draw_elements(model, run_first, run_count);
+    }
+    else {
+        glEnd();
+    }
+}
 
-    glEnd();
+void draw_model_culled(const Model* model, int level, const MeshletCuller* culler, MeshletStats* stats)
+{
+    const ModelLod* lod;
+    int is_buffered;
+    int i;
+
+    level = clamp_level(model, level);
+    if (model->n_lods == 0 || model->lods[level].n_meshlets == 0) {
+        draw_model_materials(model, level);
+        return;
+    }
+    // A display list can't skip the culled meshlets: the whole level is replayed.
+    if (call_model_list(model, level, TRUE)) {
+        return;
+    }
+    lod = &model->lods[level];
+    is_buffered = begin_buffered_draw(model);
+    if (lod->n_submeshes == 0) {
+        draw_meshlet_range(model, lod->first_meshlet, lod->n_meshlets, culler, stats, is_buffered);
+    }
+    else {
+        // The material state changes once per submesh, not per meshlet.
+        for (i = lod->first_submesh; i < lod->first_submesh + lod->n_submeshes; ++i) {
+            const Submesh* submesh = &model->submeshes[i];
+            if (submesh->material != NO_MATERIAL) {
+                apply_material(&model->materials[submesh->material]);
+            }
+            draw_meshlet_range(model, submesh->first_meshlet, submesh->n_meshlets, culler, stats, is_buffered);
+        }
+    }
+    if (is_buffered) {
+        unbind_model_buffers(model);
+    }
+}
+
+int compile_model_lists(Model* model)
+{
+    const int has_materials = (model->n_materials > 0 && model->n_submeshes > 0);
+    const DrawPath path = draw_path;
+    const int n_levels = (model->n_lods > 0) ? model->n_lods : 1;
+    int level;
+
+    release_model_lists(model);
+    if (model->n_indices == 0) {
+        return FALSE;
+    }
+    model->gpu.list_stride = has_materials ? 2 : 1;
+    model->gpu.display_lists = glGenLists(n_levels * model->gpu.list_stride);
+    if (model->gpu.display_lists == 0) {
+        model->gpu.list_stride = 0;
+        return FALSE;
+    }
+    // The lists record the vertices themselves: compile from the immediate path.
+    draw_path = DRAW_PATH_IMMEDIATE;
+    for (level = 0; level < n_levels; ++level) {
+        const GLuint list = model->gpu.display_lists + (GLuint)(level * model->gpu.list_stride);
+        glNewList(list, GL_COMPILE);
+        draw_model_lod(model, level);
+        glEndList();
+        if (has_materials) {
+            glNewList(list + 1, GL_COMPILE);
+            draw_model_materials(model, level);
+            glEndList();
+        }
+    }
+    draw_path = path;
+    if (glGetError() == GL_OUT_OF_MEMORY) {
+        release_model_lists(model);
+        return FALSE;
+    }
+    model->gpu.list_normal_bits = model->quantization.normal_bits;
+    return TRUE;
+}
+
+void release_model_lists(Model* model)
+{
+    if (model->gpu.display_lists != 0) {
+        const int n_levels = (model->n_lods > 0) ? model->n_lods : 1;
+        glDeleteLists(model->gpu.display_lists, n_levels * model->gpu.list_stride);
+    }
+    model->gpu.display_lists = 0;
+    model->gpu.list_stride = 0;
+    model->gpu.list_normal_bits = 0;
+}
+
+int has_model_lists(const Model* model)
+{
+    return model->gpu.display_lists != 0 && model->gpu.list_normal_bits == model->quantization.normal_bits;
 }
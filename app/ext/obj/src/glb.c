@@ -0,0 +1,689 @@
+#include "glb.h"
+#include "cache.h"
+#include "json.h"
+#include "load.h"
+#include "mapfile.h"
+#include "platform.h"
+
+#include <stddef.h> /* offsetof */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GLB_MAGIC 0x46546C67U /* "glTF" */
+#define GLB_VERSION 2
+#define GLB_CHUNK_JSON 0x4E4F534AU /* "JSON" */
+#define GLB_CHUNK_BIN 0x004E4942U /* "BIN\0" */
+#define GLB_HEADER_SIZE 12
+#define GLB_CHUNK_HEADER_SIZE 8
+
+#define GLTF_BYTE 5120
+#define GLTF_UNSIGNED_BYTE 5121
+#define GLTF_SHORT 5122
+#define GLTF_UNSIGNED_SHORT 5123
+#define GLTF_UNSIGNED_INT 5125
+#define GLTF_FLOAT 5126
+#define GLTF_TRIANGLES 4
+
+#define MAX_16BIT_VERTICES 65536
+
+/* glTF material not yet added to the material table */
+#define UNMAPPED_MATERIAL (-2)
+
+/**
+ * The JSON description and the binary chunk of the file
+ */
+typedef struct GlbDocument
+{
+    const char* json;
+    JsonToken* tokens;
+    const unsigned char* bin;
+    size_t bin_size;
+} GlbDocument;
+
+/**
+ * Typed view of an accessor in the binary chunk
+ */
+typedef struct GlbAccessor
+{
+    const unsigned char* data;
+    int count;
+    int component_type;
+    int n_components;
+    int stride;
+} GlbAccessor;
+
+/**
+ * Accessors of a triangle primitive (NULL data when the attribute is missing)
+ */
+typedef struct GlbPrimitive
+{
+    int position_accessor;
+    int normal_accessor;
+    int texcoord_accessor;
+    GlbAccessor position;
+    GlbAccessor normal;
+    GlbAccessor texcoord;
+    GlbAccessor indices;
+    int material;
+    int n_indices;
+} GlbPrimitive;
+
+static uint32_t read_u32(const char* p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static int open_document(GlbDocument* document, const MappedFile* file)
+{
+    size_t offset = GLB_HEADER_SIZE;
+    int n_tokens;
+
+    memset(document, 0, sizeof(*document));
+    if (file->size < GLB_HEADER_SIZE + GLB_CHUNK_HEADER_SIZE
+        || read_u32(file->data) != GLB_MAGIC || read_u32(file->data + 4) != GLB_VERSION
+        || read_u32(file->data + 8) > file->size) {
+        return FALSE;
+    }
+    while (offset + GLB_CHUNK_HEADER_SIZE <= file->size) {
+        const size_t length = read_u32(file->data + offset);
+        const uint32_t type = read_u32(file->data + offset + 4);
+        const char* data = file->data + offset + GLB_CHUNK_HEADER_SIZE;
+
+        if (length > file->size - offset - GLB_CHUNK_HEADER_SIZE) {
+            return FALSE;
+        }
+        if (type == GLB_CHUNK_JSON && document->json == NULL) {
+            document->json = data;
+            document->tokens = tokenize_json(data, length, &n_tokens);
+            if (document->tokens == NULL || document->tokens[0].type != JSON_OBJECT) {
+                return FALSE;
+            }
+        }
+        else if (type == GLB_CHUNK_BIN && document->bin == NULL) {
+            document->bin = (const unsigned char*)data;
+            document->bin_size = length;
+        }
+        // Chunks are 4 byte aligned.
+        offset += GLB_CHUNK_HEADER_SIZE + ((length + 3) & ~(size_t)3);
+    }
+    return document->tokens != NULL;
+}
+
+static int get_element(const GlbDocument* document, const char* array, int index)
+{
+    return get_json_element(document->tokens, find_json_key(document->json, document->tokens, 0, array), index);
+}
+
+static int get_int(const GlbDocument* document, int object, const char* key, int fallback)
+{
+    return get_json_int(document->json, document->tokens,
+                        find_json_key(document->json, document->tokens, object, key), fallback);
+}
+
+static int get_component_size(int component_type)
+{
+    switch (component_type) {
+    case GLTF_BYTE:
+    case GLTF_UNSIGNED_BYTE:
+        return 1;
+    case GLTF_SHORT:
+    case GLTF_UNSIGNED_SHORT:
+        return 2;
+    case GLTF_UNSIGNED_INT:
+    case GLTF_FLOAT:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+static int get_component_count(const GlbDocument* document, int type)
+{
+    static const char* const names[4] = { "SCALAR", "VEC2", "VEC3", "VEC4" };
+    int i;
+
+    for (i = 0; i < 4; ++i) {
+        if (type >= 0 && is_json_string(document->json, &document->tokens[type], names[i])) {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Resolve an accessor to a range of the binary chunk, with bounds checks.
+ */
+static int read_accessor(const GlbDocument* document, int index, GlbAccessor* accessor)
+{
+    const int object = get_element(document, "accessors", index);
+    int view;
+    int component_size;
+    int element_size;
+    uint64_t view_offset;
+    uint64_t view_length;
+    uint64_t offset;
+
+    if (object < 0 || document->bin == NULL
+        || find_json_key(document->json, document->tokens, object, "sparse") >= 0) {
+        return FALSE;
+    }
+    view = get_element(document, "bufferViews", get_int(document, object, "bufferView", -1));
+    if (view < 0 || get_int(document, view, "buffer", 0) != 0) {
+        return FALSE;
+    }
+    accessor->component_type = get_int(document, object, "componentType", 0);
+    accessor->n_components = get_component_count(document,
+        find_json_key(document->json, document->tokens, object, "type"));
+    accessor->count = get_int(document, object, "count", -1);
+    component_size = get_component_size(accessor->component_type);
+    element_size = component_size * accessor->n_components;
+    accessor->stride = get_int(document, view, "byteStride", 0);
+    if (accessor->stride == 0) {
+        accessor->stride = element_size;
+    }
+    view_offset = (uint64_t)get_int(document, view, "byteOffset", 0);
+    view_length = (uint64_t)get_int(document, view, "byteLength", -1);
+    offset = (uint64_t)get_int(document, object, "byteOffset", 0);
+    if (element_size == 0 || accessor->count < 0 || accessor->stride < element_size
+        || view_offset > document->bin_size || view_length > document->bin_size - view_offset
+        || (view_offset + offset) % (uint64_t)component_size != 0
+        || (accessor->count > 0
+            && offset + (uint64_t)(accessor->count - 1) * (uint64_t)accessor->stride + (uint64_t)element_size
+               > view_length)) {
+        return FALSE;
+    }
+    accessor->data = document->bin + view_offset + offset;
+    return TRUE;
+}
+
+static float read_component(const unsigned char* p, int component_type)
+{
+    unsigned short value16;
+    float value;
+
+    // Integer texture coordinates are normalized.
+    if (component_type == GLTF_UNSIGNED_BYTE) {
+        return (float)*p / 255.0f;
+    }
+    if (component_type == GLTF_UNSIGNED_SHORT) {
+        memcpy(&value16, p, sizeof(value16));
+        return (float)value16 / 65535.0f;
+    }
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static unsigned int read_index(const GlbAccessor* indices, int i)
+{
+    const unsigned char* p = indices->data + (size_t)i * (size_t)indices->stride;
+    unsigned short value16;
+    unsigned int value;
+
+    if (indices->component_type == GLTF_UNSIGNED_BYTE) {
+        return *p;
+    }
+    if (indices->component_type == GLTF_UNSIGNED_SHORT) {
+        memcpy(&value16, p, sizeof(value16));
+        return value16;
+    }
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static int is_valid_primitive(const GlbPrimitive* primitive)
+{
+    const GlbAccessor* texcoord = &primitive->texcoord;
+
+    if (primitive->position.component_type != GLTF_FLOAT || primitive->position.n_components != 3) {
+        return FALSE;
+    }
+    if (primitive->normal.data != NULL
+        && (primitive->normal.component_type != GLTF_FLOAT || primitive->normal.n_components != 3
+            || primitive->normal.count != primitive->position.count)) {
+        return FALSE;
+    }
+    if (texcoord->data != NULL
+        && (texcoord->n_components != 2 || texcoord->count != primitive->position.count
+            || (texcoord->component_type != GLTF_FLOAT && texcoord->component_type != GLTF_UNSIGNED_BYTE
+                && texcoord->component_type != GLTF_UNSIGNED_SHORT))) {
+        return FALSE;
+    }
+    if (primitive->indices.data != NULL
+        && (primitive->indices.n_components != 1
+            || (primitive->indices.component_type != GLTF_UNSIGNED_BYTE
+                && primitive->indices.component_type != GLTF_UNSIGNED_SHORT
+                && primitive->indices.component_type != GLTF_UNSIGNED_INT))) {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/**
+ * Collect the triangle primitives of all meshes (other modes are skipped).
+ */
+static GlbPrimitive* read_primitives(const GlbDocument* document, int* n_primitives)
+{
+    const int meshes = find_json_key(document->json, document->tokens, 0, "meshes");
+    GlbPrimitive* primitives = NULL;
+    int count = 0;
+    int m, p;
+
+    for (m = 0; meshes >= 0 && m < document->tokens[meshes].size; ++m) {
+        const int list = find_json_key(document->json, document->tokens,
+                                       get_json_element(document->tokens, meshes, m), "primitives");
+        for (p = 0; list >= 0 && p < document->tokens[list].size; ++p) {
+            const int object = get_json_element(document->tokens, list, p);
+            const int attributes = find_json_key(document->json, document->tokens, object, "attributes");
+            const int indices = get_int(document, object, "indices", -1);
+            GlbPrimitive* primitive;
+            GlbPrimitive* grown;
+
+            if (get_int(document, object, "mode", GLTF_TRIANGLES) != GLTF_TRIANGLES) {
+                continue;
+            }
+            grown = (GlbPrimitive*)realloc(primitives, ((size_t)count + 1) * sizeof(GlbPrimitive));
+            if (grown == NULL) {
+                free(primitives);
+                return NULL;
+            }
+            primitives = grown;
+            primitive = &primitives[count];
+            memset(primitive, 0, sizeof(*primitive));
+            primitive->position_accessor = get_int(document, attributes, "POSITION", -1);
+            primitive->normal_accessor = get_int(document, attributes, "NORMAL", -1);
+            primitive->texcoord_accessor = get_int(document, attributes, "TEXCOORD_0", -1);
+            primitive->material = get_int(document, object, "material", -1);
+            if (read_accessor(document, primitive->position_accessor, &primitive->position) == FALSE
+                || (primitive->normal_accessor >= 0
+                    && read_accessor(document, primitive->normal_accessor, &primitive->normal) == FALSE)
+                || (primitive->texcoord_accessor >= 0
+                    && read_accessor(document, primitive->texcoord_accessor, &primitive->texcoord) == FALSE)
+                || (indices >= 0 && read_accessor(document, indices, &primitive->indices) == FALSE)
+                || is_valid_primitive(primitive) == FALSE) {
+                printf("ERROR: Invalid or unsupported glTF primitive (mesh %d, primitive %d)!\n", m, p);
+                free(primitives);
+                return NULL;
+            }
+            primitive->n_indices = (indices >= 0) ? primitive->indices.count : primitive->position.count;
+            primitive->n_indices -= primitive->n_indices % 3;
+            ++count;
+        }
+    }
+    *n_primitives = count;
+    return primitives;
+}
+
+static int has_shared_vertices(const GlbPrimitive* primitives, int n_primitives)
+{
+    int i;
+
+    for (i = 1; i < n_primitives; ++i) {
+        if (primitives[i].position_accessor != primitives[0].position_accessor
+            || primitives[i].normal_accessor != primitives[0].normal_accessor
+            || primitives[i].texcoord_accessor != primitives[0].texcoord_accessor) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/**
+ * The attributes are interleaved exactly like MeshVertex.
+ */
+static int has_mesh_vertex_layout(const GlbPrimitive* primitive)
+{
+    const unsigned char* base = primitive->position.data;
+
+    return primitive->position.stride == (int)sizeof(MeshVertex)
+        && primitive->normal.data == base + offsetof(MeshVertex, normal)
+        && primitive->normal.stride == (int)sizeof(MeshVertex)
+        && primitive->texcoord.data == base + offsetof(MeshVertex, uv)
+        && primitive->texcoord.stride == (int)sizeof(MeshVertex)
+        && primitive->texcoord.component_type == GLTF_FLOAT;
+}
+
+/**
+ * The index accessors of the primitives follow each other in one tightly packed 16 or 32 bit array.
+ */
+static int has_contiguous_indices(const GlbPrimitive* primitives, int n_primitives)
+{
+    const int component_type = primitives[0].indices.component_type;
+    const int size = get_component_size(component_type);
+    size_t offset = 0;
+    int i;
+
+    if (component_type != GLTF_UNSIGNED_SHORT && component_type != GLTF_UNSIGNED_INT) {
+        return FALSE;
+    }
+    for (i = 0; i < n_primitives; ++i) {
+        const GlbAccessor* indices = &primitives[i].indices;
+        if (indices->data != primitives[0].indices.data + offset || indices->component_type != component_type
+            || indices->stride != size || indices->count != primitives[i].n_indices) {
+            return FALSE;
+        }
+        offset += (size_t)indices->count * (size_t)size;
+    }
+    return TRUE;
+}
+
+static void gather_vertices(MeshVertex* vertices, const GlbPrimitive* primitive)
+{
+    int i;
+
+    for (i = 0; i < primitive->position.count; ++i) {
+        MeshVertex* vertex = &vertices[i];
+        const size_t index = (size_t)i;
+
+        memcpy(vertex->position, primitive->position.data + index * (size_t)primitive->position.stride,
+               sizeof(vertex->position));
+        if (primitive->normal.data != NULL) {
+            memcpy(vertex->normal, primitive->normal.data + index * (size_t)primitive->normal.stride,
+                   sizeof(vertex->normal));
+        }
+        else {
+            vertex->normal[0] = 0.0f;
+            vertex->normal[1] = 0.0f;
+            vertex->normal[2] = 1.0f;
+        }
+        if (primitive->texcoord.data != NULL) {
+            const unsigned char* uv = primitive->texcoord.data + index * (size_t)primitive->texcoord.stride;
+            const int size = get_component_size(primitive->texcoord.component_type);
+            // glTF and the mesh vertices both have the uv origin at the top left.
+            vertex->uv[0] = read_component(uv, primitive->texcoord.component_type);
+            vertex->uv[1] = read_component(uv + size, primitive->texcoord.component_type);
+        }
+        else {
+            vertex->uv[0] = 0.0f;
+            vertex->uv[1] = 0.0f;
+        }
+    }
+}
+
+/**
+ * Point the mesh vertices into the file, or gather them (per primitive when they are not shared).
+ */
+static int build_vertices(Model* model, const GlbPrimitive* primitives, int n_primitives,
+                          int shared, int* vertex_bases)
+{
+    int n_vertices = 0;
+    int i;
+
+    for (i = 0; i < n_primitives; ++i) {
+        vertex_bases[i] = shared ? 0 : n_vertices;
+        if (i == 0 || !shared) {
+            if (primitives[i].position.count > INT32_MAX - n_vertices) {
+                return FALSE;
+            }
+            n_vertices += primitives[i].position.count;
+        }
+    }
+    model->n_mesh_vertices = n_vertices;
+    if (shared && has_mesh_vertex_layout(&primitives[0])) {
+        model->mesh_vertices = (MeshVertex*)primitives[0].position.data;
+        return TRUE;
+    }
+    model->mesh_vertices = (MeshVertex*)malloc(((size_t)n_vertices + 1) * sizeof(MeshVertex));
+    if (model->mesh_vertices == NULL) {
+        return FALSE;
+    }
+    for (i = 0; i < n_primitives; ++i) {
+        if (i == 0 || !shared) {
+            gather_vertices(&model->mesh_vertices[vertex_bases[i]], &primitives[i]);
+        }
+    }
+    return TRUE;
+}
+
+/**
+ * Point the index buffer into the file, or gather it with the vertex bases applied.
+ */
+static int build_indices(Model* model, const GlbPrimitive* primitives, int n_primitives,
+                         int shared, const int* vertex_bases)
+{
+    int n_indices = 0;
+    int first_index = 0;
+    int i, k;
+
+    for (i = 0; i < n_primitives; ++i) {
+        if (primitives[i].n_indices > INT32_MAX - n_indices) {
+            return FALSE;
+        }
+        n_indices += primitives[i].n_indices;
+    }
+    model->n_indices = n_indices;
+    if (shared && has_contiguous_indices(primitives, n_primitives)) {
+        model->indices = (void*)primitives[0].indices.data;
+        model->index_size = get_component_size(primitives[0].indices.component_type);
+        return TRUE;
+    }
+    model->index_size = (model->n_mesh_vertices <= MAX_16BIT_VERTICES) ? 2 : 4;
+    model->indices = malloc(((size_t)n_indices + 1) * (size_t)model->index_size);
+    if (model->indices == NULL) {
+        return FALSE;
+    }
+    for (i = 0; i < n_primitives; ++i) {
+        const GlbPrimitive* primitive = &primitives[i];
+        for (k = 0; k < primitive->n_indices; ++k) {
+            const unsigned int index = (unsigned int)vertex_bases[i]
+                + ((primitive->indices.data != NULL) ? read_index(&primitive->indices, k) : (unsigned int)k);
+            if (model->index_size == 2) {
+                ((unsigned short*)model->indices)[first_index + k] = (unsigned short)index;
+            }
+            else {
+                ((unsigned int*)model->indices)[first_index + k] = index;
+            }
+        }
+        first_index += primitive->n_indices;
+    }
+    return TRUE;
+}
+
+/**
+ * Every index of a primitive has to address its own vertices (the draw loop doesn't check).
+ */
+static int check_indices(const GlbPrimitive* primitives, int n_primitives)
+{
+    int i, k;
+
+    for (i = 0; i < n_primitives; ++i) {
+        const GlbPrimitive* primitive = &primitives[i];
+        if (primitive->indices.data == NULL) {
+            continue;
+        }
+        for (k = 0; k < primitive->n_indices; ++k) {
+            if (read_index(&primitive->indices, k) >= (unsigned int)primitive->position.count) {
+                return FALSE;
+            }
+        }
+    }
+    return TRUE;
+}
+
+static void copy_json_string(char* target, size_t size, const GlbDocument* document, int token)
+{
+    size_t length = 0;
+
+    if (token >= 0 && document->tokens[token].type == JSON_STRING) {
+        length = (size_t)(document->tokens[token].end - document->tokens[token].start);
+        if (length >= size) {
+            length = size - 1;
+        }
+        memcpy(target, document->json + document->tokens[token].start, length);
+    }
+    target[length] = 0;
+}
+
+/**
+ * Add the glTF material as an OBJ material: the base color is the diffuse color,
+ * its alpha is the dissolve, the base color image uri is the texture.
+ */
+static int add_gltf_material(Model* model, const GlbDocument* document, int index)
+{
+    const char* json = document->json;
+    const JsonToken* tokens = document->tokens;
+    const int object = get_element(document, "materials", index);
+    const int pbr = find_json_key(json, tokens, object, "pbrMetallicRoughness");
+    const int color = find_json_key(json, tokens, pbr, "baseColorFactor");
+    const int texture = find_json_key(json, tokens, pbr, "baseColorTexture");
+    char name[MAX_MATERIAL_NAME];
+    ObjMaterial* material;
+    int material_index;
+    int image;
+    int k;
+
+    copy_json_string(name, sizeof(name), document, find_json_key(json, tokens, object, "name"));
+    if (name[0] == 0) {
+        sprintf(name, "material%d", index);
+    }
+    material_index = add_model_material(model, name);
+    if (material_index == NO_MATERIAL) {
+        return NO_MATERIAL;
+    }
+    material = &model->materials[material_index];
+    for (k = 0; k < 3; ++k) {
+        material->diffuse[k] = (float)get_json_double(json, tokens, get_json_element(tokens, color, k), 1.0);
+    }
+    material->alpha = (float)get_json_double(json, tokens, get_json_element(tokens, color, 3), 1.0);
+    image = get_element(document, "textures", get_int(document, texture, "index", -1));
+    image = get_element(document, "images", get_int(document, image, "source", -1));
+    copy_json_string(material->texture, sizeof(material->texture), document,
+                     find_json_key(json, tokens, image, "uri"));
+    return material_index;
+}
+
+static int build_submeshes(Model* model, const GlbDocument* document,
+                           const GlbPrimitive* primitives, int n_primitives)
+{
+    const int materials = find_json_key(document->json, document->tokens, 0, "materials");
+    const int n_gltf_materials = (materials >= 0 && document->tokens[materials].type == JSON_ARRAY)
+        ? document->tokens[materials].size : 0;
+    int* material_map;
+    int first_index = 0;
+    int i;
+
+    model->submeshes = (Submesh*)malloc((size_t)n_primitives * sizeof(Submesh));
+    material_map = (int*)malloc(((size_t)n_gltf_materials + 1) * sizeof(int));
+    if (model->submeshes == NULL || material_map == NULL) {
+        free(material_map);
+        return FALSE;
+    }
+    for (i = 0; i < n_gltf_materials; ++i) {
+        material_map[i] = UNMAPPED_MATERIAL;
+    }
+    for (i = 0; i < n_primitives; ++i) {
+        const int gltf_material = primitives[i].material;
+        Submesh* submesh = &model->submeshes[i];
+
+        submesh->material = NO_MATERIAL;
+        if (gltf_material >= 0 && gltf_material < n_gltf_materials) {
+            if (material_map[gltf_material] == UNMAPPED_MATERIAL) {
+                material_map[gltf_material] = add_gltf_material(model, document, gltf_material);
+            }
+            submesh->material = material_map[gltf_material];
+        }
+        submesh->first_index = first_index;
+        submesh->n_indices = primitives[i].n_indices;
+        submesh->first_meshlet = 0;
+        submesh->n_meshlets = 0;
+        first_index += primitives[i].n_indices;
+    }
+    free(material_map);
+    model->n_submeshes = n_primitives;
+    return TRUE;
+}
+
+static int read_glb_mesh(Model* model, const GlbDocument* document)
+{
+    GlbPrimitive* primitives;
+    int* vertex_bases;
+    int n_primitives = 0;
+    int shared;
+    int i;
+
+    primitives = read_primitives(document, &n_primitives);
+    if (primitives == NULL || n_primitives == 0 || check_indices(primitives, n_primitives) == FALSE) {
+        free(primitives);
+        return FALSE;
+    }
+    vertex_bases = (int*)malloc((size_t)n_primitives * sizeof(int));
+    shared = has_shared_vertices(primitives, n_primitives);
+    if (vertex_bases == NULL
+        || build_vertices(model, primitives, n_primitives, shared, vertex_bases) == FALSE
+        || build_indices(model, primitives, n_primitives, shared, vertex_bases) == FALSE
+        || build_submeshes(model, document, primitives, n_primitives) == FALSE) {
+        free(vertex_bases);
+        free(primitives);
+        return FALSE;
+    }
+    model->vertex_attributes = MESH_HAS_NORMALS | MESH_HAS_UVS;
+    for (i = 0; i < n_primitives; ++i) {
+        if (primitives[i].normal.data == NULL) {
+            model->vertex_attributes &= ~MESH_HAS_NORMALS;
+        }
+        if (primitives[i].texcoord.data == NULL) {
+            model->vertex_attributes &= ~MESH_HAS_UVS;
+        }
+    }
+    free(vertex_bases);
+    free(primitives);
+
+    model->n_triangles = model->n_indices / 3;
+    model->n_lods = 1;
+    model->lods[0].first_index = 0;
+    model->lods[0].n_indices = model->n_indices;
+    model->lods[0].error = 0.0f;
+    model->lods[0].first_meshlet = 0;
+    model->lods[0].n_meshlets = 0;
+    model->lods[0].first_submesh = 0;
+    model->lods[0].n_submeshes = model->n_submeshes;
+    return model->n_triangles > 0;
+}
+
+int load_glb_model(Model* model, const char* filename)
+{
+    GlbDocument document;
+    MappedFile* file;
+    double start_time;
+    int success;
+
+    printf("Load model '%s' ...\n", filename);
+    if (is_mesh_cache_enabled() && load_mesh_cache(model, filename) == TRUE) {
+        return TRUE;
+    }
+    init_model(model);
+    file = (MappedFile*)malloc(sizeof(MappedFile));
+    if (file == NULL) {
+        return FALSE;
+    }
+    // Copy-on-write: the mesh optimizations may reorder the buffers in place.
+    if (map_file_private(file, filename) == FALSE) {
+        printf("ERROR: Unable to open '%s' file!\n", filename);
+        free(file);
+        return FALSE;
+    }
+    start_time = get_time_seconds();
+    // The model owns the mapping while its arrays may point into it.
+    model->mapping = file;
+    success = open_document(&document, file) && read_glb_mesh(model, &document);
+    free(document.tokens);
+    if (success == FALSE) {
+        printf("ERROR: Unable to read the glTF model data!\n");
+        free_model(model);
+        return FALSE;
+    }
+    printf("Mapped %d triangles in %.1f ms (%s vertices, %s indices)\n", model->n_triangles,
+           (get_time_seconds() - start_time) * 1000.0,
+           is_model_array_mapped(model, model->mesh_vertices) ? "zero-copy" : "gathered",
+           is_model_array_mapped(model, model->indices) ? "zero-copy" : "gathered");
+    if (is_model_array_mapped(model, model->mesh_vertices) == FALSE
+        && is_model_array_mapped(model, model->indices) == FALSE) {
+        unmap_file(file);
+        free(file);
+        model->mapping = NULL;
+    }
+    return process_loaded_mesh(model, filename);
+}
@@ -0,0 +1,652 @@
+#include "gpu_mesh.h"
+#include "quantize.h"
+
+#include <GL/gl.h>
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+#ifndef GL_ARRAY_BUFFER
+#define GL_ARRAY_BUFFER 0x8892
+#endif
+#ifndef GL_ELEMENT_ARRAY_BUFFER
+#define GL_ELEMENT_ARRAY_BUFFER 0x8893
+#endif
+#ifndef GL_STATIC_DRAW
+#define GL_STATIC_DRAW 0x88E4
+#endif
+#ifndef GL_STREAM_DRAW
+#define GL_STREAM_DRAW 0x88E0
+#endif
+#ifndef GL_VERTEX_SHADER
+#define GL_VERTEX_SHADER 0x8B31
+#endif
+#ifndef GL_COMPILE_STATUS
+#define GL_COMPILE_STATUS 0x8B81
+#endif
+#ifndef GL_LINK_STATUS
+#define GL_LINK_STATUS 0x8B82
+#endif
+#ifndef GL_MAX_VERTEX_ATTRIBS
+#define GL_MAX_VERTEX_ATTRIBS 0x8869
+#endif
+
+/* First of the 4 generic attributes (columns) of the instance matrix; 12..15
+   alias the unused texture coordinates 4..7 on drivers with fixed aliasing. */
+#define INSTANCE_ATTRIBUTE 12
+/* Lights the instancing program evaluates (GL_LIGHT0 ...) */
+#define MAX_INSTANCED_LIGHTS 8
+
+/* GL 1.5 and 3.0 entry points (the Windows headers stop at GL 1.1). */
+typedef void (APIENTRY *GenNamesFunction)(GLsizei n, GLuint* names);
+typedef void (APIENTRY *DeleteNamesFunction)(GLsizei n, const GLuint* names);
+typedef void (APIENTRY *BindBufferFunction)(GLenum target, GLuint buffer);
+typedef void (APIENTRY *BufferDataFunction)(GLenum target, ptrdiff_t size, const void* data, GLenum usage);
+typedef void (APIENTRY *BindVertexArrayFunction)(GLuint array);
+
+/* GL 2.0 shaders, GL 3.1 / ARB_draw_instanced and GL 3.3 / ARB_instanced_arrays. */
+typedef GLuint (APIENTRY *CreateShaderFunction)(GLenum type);
+typedef void (APIENTRY *ShaderSourceFunction)(GLuint shader, GLsizei count, const char* const* sources,
+                                              const GLint* lengths);
+typedef void (APIENTRY *ObjectFunction)(GLuint object);
+typedef void (APIENTRY *GetObjectParameterFunction)(GLuint object, GLenum name, GLint* value);
+typedef void (APIENTRY *GetInfoLogFunction)(GLuint object, GLsizei size, GLsizei* length, char* log);
+typedef GLuint (APIENTRY *CreateProgramFunction)(void);
+typedef void (APIENTRY *AttachShaderFunction)(GLuint program, GLuint shader);
+typedef void (APIENTRY *BindAttribLocationFunction)(GLuint program, GLuint index, const char* name);
+typedef GLint (APIENTRY *GetUniformLocationFunction)(GLuint program, const char* name);
+typedef void (APIENTRY *Uniform1iFunction)(GLint location, GLint value);
+typedef void (APIENTRY *VertexAttribPointerFunction)(GLuint index, GLint size, GLenum type, GLboolean normalized,
+                                                     GLsizei stride, const void* pointer);
+typedef void (APIENTRY *VertexAttribDivisorFunction)(GLuint index, GLuint divisor);
+typedef void (APIENTRY *DrawElementsInstancedFunction)(GLenum mode, GLsizei count, GLenum type,
+                                                       const void* indices, GLsizei n_instances);
+
+typedef struct GpuFunctions
+{
+    GenNamesFunction gen_buffers;
+    DeleteNamesFunction delete_buffers;
+    BindBufferFunction bind_buffer;
+    BufferDataFunction buffer_data;
+    GenNamesFunction gen_vertex_arrays;
+    DeleteNamesFunction delete_vertex_arrays;
+    BindVertexArrayFunction bind_vertex_array;
+
+    CreateShaderFunction create_shader;
+    ShaderSourceFunction shader_source;
+    ObjectFunction compile_shader;
+    GetObjectParameterFunction get_shader_iv;
+    GetInfoLogFunction get_shader_info_log;
+    ObjectFunction delete_shader;
+    CreateProgramFunction create_program;
+    AttachShaderFunction attach_shader;
+    BindAttribLocationFunction bind_attrib_location;
+    ObjectFunction link_program;
+    GetObjectParameterFunction get_program_iv;
+    ObjectFunction delete_program;
+    ObjectFunction use_program;
+    GetUniformLocationFunction get_uniform_location;
+    Uniform1iFunction uniform_1i;
+    VertexAttribPointerFunction vertex_attrib_pointer;
+    ObjectFunction enable_vertex_attrib_array;
+    ObjectFunction disable_vertex_attrib_array;
+    VertexAttribDivisorFunction vertex_attrib_divisor;
+    DrawElementsInstancedFunction draw_elements_instanced;
+} GpuFunctions;
+
+/**
+ * Program and stream buffer of the instanced draws
+ */
+typedef struct GpuInstancing
+{
+    GLuint program;
+    GLint light_count;
+    GLint lighting;
+    GLint color_material;
+    GLuint instance_buffer;
+    /* Bytes from one instance to the next in the instance buffer */
+    GLsizei stride;
+} GpuInstancing;
+
+/*
+ * Vertex program of the instanced draws: the instance matrix (a per-instance
+ * attribute) goes before the modelview, and the fixed-function lighting of the
+ * scene (point lights, GL_COLOR_MATERIAL for ambient and diffuse, non-local
+ * viewer) is evaluated per vertex like GL does. Texturing stays fixed-function.
+ */
+static const char* const instancing_vertex_program =
+    "#version 120\n"
+    "attribute mat4 instance_matrix;\n"
+    "uniform int light_count;\n"
+    "uniform bool lighting;\n"
+    "uniform bool color_material;\n"
+    "void main()\n"
+    "{\n"
+    "    vec4 eye = gl_ModelViewMatrix * (instance_matrix * gl_Vertex);\n"
+    "    mat3 m = mat3(instance_matrix);\n"
+    "    // Cofactor matrix = det(M) inverse transpose: the sign of det keeps mirrored normals outside.\n"
+    "    mat3 cofactor = mat3(cross(m[1], m[2]), cross(m[2], m[0]), cross(m[0], m[1]));\n"
+    "    float side = (dot(m[0], cofactor[0]) < 0.0) ? -1.0 : 1.0;\n"
+    "    vec3 normal = normalize(gl_NormalMatrix * (cofactor * gl_Normal) * side);\n"
+    "    vec4 ambient = color_material ? gl_Color : gl_FrontMaterial.ambient;\n"
+    "    vec4 diffuse = color_material ? gl_Color : gl_FrontMaterial.diffuse;\n"
+    "    vec4 color = gl_FrontMaterial.emission + gl_LightModel.ambient * ambient;\n"
+    "    for (int i = 0; i < light_count; ++i) {\n"
+    "        vec3 to_light = gl_LightSource[i].position.xyz - eye.xyz * gl_LightSource[i].position.w;\n"
+    "        float d = length(to_light);\n"
+    "        vec3 l = to_light / d;\n"
+    "        float attenuation = (gl_LightSource[i].position.w == 0.0) ? 1.0\n"
+    "            : 1.0 / (gl_LightSource[i].constantAttenuation + d * gl_LightSource[i].linearAttenuation\n"
+    "                     + d * d * gl_LightSource[i].quadraticAttenuation);\n"
+    "        float n_dot_l = max(dot(normal, l), 0.0);\n"
+    "        vec4 light = gl_LightSource[i].ambient * ambient + n_dot_l * gl_LightSource[i].diffuse * diffuse;\n"
+    "        if (n_dot_l > 0.0) {\n"
+    "            float n_dot_h = max(dot(normal, normalize(l + vec3(0.0, 0.0, 1.0))), 0.0);\n"
+    "            light += pow(n_dot_h, gl_FrontMaterial.shininess)\n"
+    "                * gl_LightSource[i].specular * gl_FrontMaterial.specular;\n"
+    "        }\n"
+    "        color += attenuation * light;\n"
+    "    }\n"
+    "    gl_FrontColor = lighting ? vec4(color.rgb, diffuse.a) : gl_Color;\n"
+    "    gl_TexCoord[0] = gl_TextureMatrix[0] * gl_MultiTexCoord0;\n"
+    "    gl_Position = gl_ProjectionMatrix * eye;\n"
+    "}\n";
+
+/**
+ * Vertex of the buffers of a quantized model (16 bytes)
+ */
+typedef struct GpuQuantizedVertex
+{
+    short position[3];
+    short uv[2];
+    short normal[3];
+} GpuQuantizedVertex;
+
+static GpuFunctions gl;
+static int gpu_buffers_state = -1;
+static GpuInstancing instancing;
+
+static void* load_function(GlProcLoader loader, const char* name)
+{
+    return loader(name);
+}
+
+/* ISO C has no cast between object and function pointers: copy the address. */
+#define LOAD_FUNCTION(loader, target, name) \
+    do { \
+        void* address = load_function(loader, name); \
+        memset(&(target), 0, sizeof(target)); \
+        if (address != NULL && sizeof(target) == sizeof(address)) { \
+            memcpy(&(target), &address, sizeof(target)); \
+        } \
+    } while (0)
+
+static int has_extension(const char* name)
+{
+    const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+    const size_t length = strlen(name);
+    const char* found;
+
+    while (extensions != NULL && (found = strstr(extensions, name)) != NULL) {
+        if ((found == extensions || found[-1] == ' ') && (found[length] == ' ' || found[length] == 0)) {
+            return TRUE;
+        }
+        extensions = found + length;
+    }
+    return FALSE;
+}
+
+static int is_gl_version_at_least(int major, int minor)
+{
+    const char* version = (const char*)glGetString(GL_VERSION);
+    int context_major = 0;
+    int context_minor = 0;
+
+    if (version == NULL || sscanf(version, "%d.%d", &context_major, &context_minor) != 2) {
+        return FALSE;
+    }
+    return context_major > major || (context_major == major && context_minor >= minor);
+}
+
+int init_gpu_buffers(GlProcLoader loader)
+{
+    const char* env = getenv("OBJ_GPU_BUFFERS");
+
+    memset(&gl, 0, sizeof(gl));
+    gpu_buffers_state = FALSE;
+    if (env != NULL && strcmp(env, "0") == 0) {
+        printf("Models: immediate mode (OBJ_GPU_BUFFERS=0)\n");
+        return FALSE;
+    }
+
+    if (is_gl_version_at_least(1, 5)) {
+        LOAD_FUNCTION(loader, gl.gen_buffers, "glGenBuffers");
+        LOAD_FUNCTION(loader, gl.delete_buffers, "glDeleteBuffers");
+        LOAD_FUNCTION(loader, gl.bind_buffer, "glBindBuffer");
+        LOAD_FUNCTION(loader, gl.buffer_data, "glBufferData");
+    }
+    else if (has_extension("GL_ARB_vertex_buffer_object")) {
+        LOAD_FUNCTION(loader, gl.gen_buffers, "glGenBuffersARB");
+        LOAD_FUNCTION(loader, gl.delete_buffers, "glDeleteBuffersARB");
+        LOAD_FUNCTION(loader, gl.bind_buffer, "glBindBufferARB");
+        LOAD_FUNCTION(loader, gl.buffer_data, "glBufferDataARB");
+    }
+    if (gl.gen_buffers == NULL || gl.delete_buffers == NULL || gl.bind_buffer == NULL || gl.buffer_data == NULL) {
+        printf("Models: immediate mode (no vertex buffer objects)\n");
+        return FALSE;
+    }
+
+    // Some loaders return addresses for anything: check the version or the extension first.
+    if (is_gl_version_at_least(3, 0) || has_extension("GL_ARB_vertex_array_object")) {
+        LOAD_FUNCTION(loader, gl.gen_vertex_arrays, "glGenVertexArrays");
+        LOAD_FUNCTION(loader, gl.delete_vertex_arrays, "glDeleteVertexArrays");
+        LOAD_FUNCTION(loader, gl.bind_vertex_array, "glBindVertexArray");
+        if (gl.gen_vertex_arrays == NULL || gl.delete_vertex_arrays == NULL || gl.bind_vertex_array == NULL) {
+            gl.gen_vertex_arrays = NULL;
+        }
+    }
+    gpu_buffers_state = TRUE;
+    printf("Models: vertex buffer objects%s\n", (gl.gen_vertex_arrays != NULL) ? " + vertex array objects" : "");
+    if (init_gpu_instancing(loader)) {
+        printf("Models: instanced draws (per-instance matrix attribute)\n");
+    }
+    return TRUE;
+}
+
+/**
+ * Compile and link the vertex program. Returns 0 on error.
+ */
+static GLuint create_instancing_program(void)
+{
+    char log[512];
+    GLuint shader;
+    GLuint program;
+    GLint status = 0;
+
+    shader = gl.create_shader(GL_VERTEX_SHADER);
+    gl.shader_source(shader, 1, &instancing_vertex_program, NULL);
+    gl.compile_shader(shader);
+    gl.get_shader_iv(shader, GL_COMPILE_STATUS, &status);
+    if (status == 0) {
+        gl.get_shader_info_log(shader, (GLsizei)sizeof(log), NULL, log);
+        printf("Instancing vertex program: %s\n", log);
+        gl.delete_shader(shader);
+        return 0;
+    }
+    program = gl.create_program();
+    gl.attach_shader(program, shader);
+    gl.bind_attrib_location(program, INSTANCE_ATTRIBUTE, "instance_matrix");
+    gl.link_program(program);
+    // The program keeps the shader until it is deleted itself.
+    gl.delete_shader(shader);
+    gl.get_program_iv(program, GL_LINK_STATUS, &status);
+    if (status == 0) {
+        gl.delete_program(program);
+        return 0;
+    }
+    return program;
+}
+
+int init_gpu_instancing(GlProcLoader loader)
+{
+    const char* env = getenv("OBJ_GPU_INSTANCING");
+    const int has_instanced_draws = is_gl_version_at_least(3, 1) || has_extension("GL_ARB_draw_instanced");
+    const int has_divisors = is_gl_version_at_least(3, 3) || has_extension("GL_ARB_instanced_arrays");
+    GLint max_attributes = 0;
+
+    memset(&instancing, 0, sizeof(instancing));
+    if ((env != NULL && strcmp(env, "0") == 0) || gpu_buffers_state != TRUE
+        || !is_gl_version_at_least(2, 0) || !has_instanced_draws || !has_divisors) {
+        return FALSE;
+    }
+    glGetIntegerv(GL_MAX_VERTEX_ATTRIBS, &max_attributes);
+    if (max_attributes < INSTANCE_ATTRIBUTE + 4) {
+        return FALSE;
+    }
+    LOAD_FUNCTION(loader, gl.create_shader, "glCreateShader");
+    LOAD_FUNCTION(loader, gl.shader_source, "glShaderSource");
+    LOAD_FUNCTION(loader, gl.compile_shader, "glCompileShader");
+    LOAD_FUNCTION(loader, gl.get_shader_iv, "glGetShaderiv");
+    LOAD_FUNCTION(loader, gl.get_shader_info_log, "glGetShaderInfoLog");
+    LOAD_FUNCTION(loader, gl.delete_shader, "glDeleteShader");
+    LOAD_FUNCTION(loader, gl.create_program, "glCreateProgram");
+    LOAD_FUNCTION(loader, gl.attach_shader, "glAttachShader");
+    LOAD_FUNCTION(loader, gl.bind_attrib_location, "glBindAttribLocation");
+    LOAD_FUNCTION(loader, gl.link_program, "glLinkProgram");
+    LOAD_FUNCTION(loader, gl.get_program_iv, "glGetProgramiv");
+    LOAD_FUNCTION(loader, gl.delete_program, "glDeleteProgram");
+    LOAD_FUNCTION(loader, gl.use_program, "glUseProgram");
+    LOAD_FUNCTION(loader, gl.get_uniform_location, "glGetUniformLocation");
+    LOAD_FUNCTION(loader, gl.uniform_1i, "glUniform1i");
+    LOAD_FUNCTION(loader, gl.vertex_attrib_pointer, "glVertexAttribPointer");
+    LOAD_FUNCTION(loader, gl.enable_vertex_attrib_array, "glEnableVertexAttribArray");
+    LOAD_FUNCTION(loader, gl.disable_vertex_attrib_array, "glDisableVertexAttribArray");
+    if (is_gl_version_at_least(3, 1)) {
+        LOAD_FUNCTION(loader, gl.draw_elements_instanced, "glDrawElementsInstanced");
+    }
+    else {
+        LOAD_FUNCTION(loader, gl.draw_elements_instanced, "glDrawElementsInstancedARB");
+    }
+    if (is_gl_version_at_least(3, 3)) {
+        LOAD_FUNCTION(loader, gl.vertex_attrib_divisor, "glVertexAttribDivisor");
+    }
+    else {
+        LOAD_FUNCTION(loader, gl.vertex_attrib_divisor, "glVertexAttribDivisorARB");
+    }
+    if (gl.create_shader == NULL || gl.shader_source == NULL || gl.compile_shader == NULL
+        || gl.get_shader_iv == NULL || gl.get_shader_info_log == NULL || gl.delete_shader == NULL
+        || gl.create_program == NULL || gl.attach_shader == NULL || gl.bind_attrib_location == NULL
+        || gl.link_program == NULL || gl.get_program_iv == NULL || gl.delete_program == NULL
+        || gl.use_program == NULL || gl.get_uniform_location == NULL || gl.uniform_1i == NULL
+        || gl.vertex_attrib_pointer == NULL || gl.enable_vertex_attrib_array == NULL
+        || gl.disable_vertex_attrib_array == NULL || gl.draw_elements_instanced == NULL
+        || gl.vertex_attrib_divisor == NULL) {
+        return FALSE;
+    }
+
+    instancing.program = create_instancing_program();
+    if (instancing.program == 0) {
+        return FALSE;
+    }
+    instancing.light_count = gl.get_uniform_location(instancing.program, "light_count");
+    instancing.lighting = gl.get_uniform_location(instancing.program, "lighting");
+    instancing.color_material = gl.get_uniform_location(instancing.program, "color_material");
+    gl.gen_buffers(1, &instancing.instance_buffer);
+    return TRUE;
+}
+
+int is_gpu_instancing_enabled(void)
+{
+    return instancing.program != 0;
+}
+
+void release_gpu_instancing(void)
+{
+    if (instancing.program != 0) {
+        gl.delete_program(instancing.program);
+        gl.delete_buffers(1, &instancing.instance_buffer);
+    }
+    memset(&instancing, 0, sizeof(instancing));
+}
+
+/**
+ * Point the matrix attribute at the instances from first on.
+ */
+static void set_instance_pointers(int first_instance)
+{
+    const size_t offset = (size_t)first_instance * (size_t)instancing.stride;
+    GLuint column;
+
+    for (column = 0; column < 4; ++column) {
+        gl.vertex_attrib_pointer(INSTANCE_ATTRIBUTE + column, 4, GL_FLOAT, GL_FALSE, instancing.stride,
+                                 (const void*)(offset + column * 4 * sizeof(float)));
+    }
+}
+
+int begin_instanced_draw(const Model* model, const void* instances, int n_instances, int stride)
+{
+    GLint light_count = 0;
+    GLuint column;
+
+    if (instancing.program == 0 || !has_model_buffers(model) || n_instances <= 0) {
+        return FALSE;
+    }
+    gl.bind_buffer(GL_ARRAY_BUFFER, instancing.instance_buffer);
+    // A new store each batch: the driver doesn't wait for the draws of the previous one.
+    gl.buffer_data(GL_ARRAY_BUFFER, (ptrdiff_t)((size_t)n_instances * (size_t)stride), instances,
+                   GL_STREAM_DRAW);
+    instancing.stride = (GLsizei)stride;
+
+    // The lights are enabled from GL_LIGHT0 on (the program has no enable flags).
+    while (light_count < MAX_INSTANCED_LIGHTS && glIsEnabled(GL_LIGHT0 + light_count)) {
+        light_count++;
+    }
+    gl.use_program(instancing.program);
+    gl.uniform_1i(instancing.light_count, light_count);
+    gl.uniform_1i(instancing.lighting, glIsEnabled(GL_LIGHTING) ? 1 : 0);
+    gl.uniform_1i(instancing.color_material, glIsEnabled(GL_COLOR_MATERIAL) ? 1 : 0);
+
+    // With a vertex array object the instance attributes are recorded in it
+    // (and disabled again in end_instanced_draw()).
+    bind_model_buffers(model);
+    gl.bind_buffer(GL_ARRAY_BUFFER, instancing.instance_buffer);
+    for (column = 0; column < 4; ++column) {
+        gl.enable_vertex_attrib_array(INSTANCE_ATTRIBUTE + column);
+        gl.vertex_attrib_divisor(INSTANCE_ATTRIBUTE + column, 1);
+    }
+    set_instance_pointers(0);
+    return TRUE;
+}
+
+void draw_instanced_range(const Model* model, int first_index, int n_indices, int first_instance,
+                          int n_instances)
+{
+    const GLenum type = (model->index_size == 4) ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
+
+    if (n_indices <= 0 || n_instances <= 0) {
+        return;
+    }
+    set_instance_pointers(first_instance);
+    gl.draw_elements_instanced(GL_TRIANGLES, n_indices, type,
+                               (const void*)((size_t)first_index * (size_t)model->index_size),
+                               (GLsizei)n_instances);
+}
+
+void end_instanced_draw(const Model* model)
+{
+    GLuint column;
+
+    for (column = 0; column < 4; ++column) {
+        gl.vertex_attrib_divisor(INSTANCE_ATTRIBUTE + column, 0);
+        gl.disable_vertex_attrib_array(INSTANCE_ATTRIBUTE + column);
+    }
+    gl.use_program(0);
+    unbind_model_buffers(model);
+    gl.bind_buffer(GL_ARRAY_BUFFER, 0);
+}
+
+int is_gpu_buffers_enabled(void)
+{
+    return gpu_buffers_state == TRUE;
+}
+
+static void set_vertex_pointers(const Model* model)
+{
+    if (model->gpu.normal_bits == 0) {
+        const GLsizei stride = (GLsizei)sizeof(MeshVertex);
+        glVertexPointer(3, GL_FLOAT, stride, (const void*)offsetof(MeshVertex, position));
+        glNormalPointer(GL_FLOAT, stride, (const void*)offsetof(MeshVertex, normal));
+        glTexCoordPointer(2, GL_FLOAT, stride, (const void*)offsetof(MeshVertex, uv));
+    }
+    else {
+        const GLsizei stride = (GLsizei)sizeof(GpuQuantizedVertex);
+        glVertexPointer(3, GL_SHORT, stride, (const void*)offsetof(GpuQuantizedVertex, position));
+        glNormalPointer(GL_SHORT, stride, (const void*)offsetof(GpuQuantizedVertex, normal));
+        glTexCoordPointer(2, GL_SHORT, stride, (const void*)offsetof(GpuQuantizedVertex, uv));
+    }
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+}
+
+/**
+ * Quantized vertices for the GPU: the normals are decoded from their octahedral
+ * form (there is no fixed-function decoder) and pre-scaled like in immediate mode.
+ */
+static GpuQuantizedVertex* build_quantized_vertices(const Model* model)
+{
+    const VertexQuantization* quantization = &model->quantization;
+    const float* scale = quantization->position_scale;
+    GpuQuantizedVertex* vertices;
+    float normal_scale[3];
+    float max_scale;
+    float normal[3];
+    int i;
+    int k;
+
+    vertices = (GpuQuantizedVertex*)malloc(((size_t)model->n_mesh_vertices + 1) * sizeof(GpuQuantizedVertex));
+    if (vertices == NULL) {
+        return NULL;
+    }
+    max_scale = scale[0];
+    if (scale[1] > max_scale) {
+        max_scale = scale[1];
+    }
+    if (scale[2] > max_scale) {
+        max_scale = scale[2];
+    }
+    for (k = 0; k < 3; ++k) {
+        normal_scale[k] = scale[k] / max_scale;
+    }
+    for (i = 0; i < model->n_mesh_vertices; ++i) {
+        const short* position;
+        const short* uv;
+        if (quantization->normal_bits == 8) {
+            const QuantizedVertex8* vertex = &((const QuantizedVertex8*)model->quantized_vertices)[i];
+            decode_octahedral_normal(vertex->normal[0] / 127.0f, vertex->normal[1] / 127.0f, normal);
+            position = vertex->position;
+            uv = vertex->uv;
+        }
+        else {
+            const QuantizedVertex16* vertex = &((const QuantizedVertex16*)model->quantized_vertices)[i];
+            decode_octahedral_normal(vertex->normal[0] / 32767.0f, vertex->normal[1] / 32767.0f, normal);
+            position = vertex->position;
+            uv = vertex->uv;
+        }
+        for (k = 0; k < 3; ++k) {
+            vertices[i].position[k] = position[k];
+            vertices[i].normal[k] = (short)(normal[k] * normal_scale[k] * 32767.0f);
+        }
+        vertices[i].uv[0] = uv[0];
+        vertices[i].uv[1] = uv[1];
+    }
+    return vertices;
+}
+
+int upload_model_buffers(Model* model)
+{
+    GpuQuantizedVertex* quantized = NULL;
+    const void* vertex_data = model->mesh_vertices;
+    size_t vertex_size = sizeof(MeshVertex);
+    GLuint buffers[2];
+
+    if (gpu_buffers_state != TRUE || model->n_mesh_vertices == 0 || model->n_indices == 0) {
+        return FALSE;
+    }
+    if (model->quantized_vertices != NULL) {
+        quantized = build_quantized_vertices(model);
+        if (quantized == NULL) {
+            return FALSE;
+        }
+        vertex_data = quantized;
+        vertex_size = sizeof(GpuQuantizedVertex);
+    }
+    release_model_buffers(model);
+
+    gl.gen_buffers(2, buffers);
+    gl.bind_buffer(GL_ARRAY_BUFFER, buffers[0]);
+    gl.buffer_data(GL_ARRAY_BUFFER, (ptrdiff_t)((size_t)model->n_mesh_vertices * vertex_size), vertex_data,
+                   GL_STATIC_DRAW);
+    gl.bind_buffer(GL_ELEMENT_ARRAY_BUFFER, buffers[1]);
+    gl.buffer_data(GL_ELEMENT_ARRAY_BUFFER, (ptrdiff_t)((size_t)model->n_indices * (size_t)model->index_size),
+                   model->indices, GL_STATIC_DRAW);
+    free(quantized);
+    if (glGetError() == GL_OUT_OF_MEMORY) {
+        gl.bind_buffer(GL_ARRAY_BUFFER, 0);
+        gl.bind_buffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        gl.delete_buffers(2, buffers);
+        return FALSE;
+    }
+    model->gpu.vertex_buffer = buffers[0];
+    model->gpu.index_buffer = buffers[1];
+    model->gpu.normal_bits = model->quantization.normal_bits;
+
+    // The vertex array object records the pointers and the index buffer binding.
+    if (gl.gen_vertex_arrays != NULL) {
+        gl.gen_vertex_arrays(1, &model->gpu.vertex_array);
+        gl.bind_vertex_array(model->gpu.vertex_array);
+        gl.bind_buffer(GL_ELEMENT_ARRAY_BUFFER, model->gpu.index_buffer);
+        set_vertex_pointers(model);
+        gl.bind_vertex_array(0);
+    }
+    gl.bind_buffer(GL_ARRAY_BUFFER, 0);
+    gl.bind_buffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    return TRUE;
+}
+
+void release_model_buffers(Model* model)
+{
+    GLuint buffers[2];
+
+    if (model->gpu.vertex_array != 0) {
+        gl.delete_vertex_arrays(1, &model->gpu.vertex_array);
+    }
+    if (model->gpu.vertex_buffer != 0) {
+        buffers[0] = model->gpu.vertex_buffer;
+        buffers[1] = model->gpu.index_buffer;
+        gl.delete_buffers(2, buffers);
+    }
+    model->gpu.vertex_buffer = 0;
+    model->gpu.index_buffer = 0;
+    model->gpu.vertex_array = 0;
+    model->gpu.normal_bits = 0;
+}
+
+int has_model_buffers(const Model* model)
+{
+    return model->gpu.vertex_buffer != 0 && model->gpu.normal_bits == model->quantization.normal_bits;
+}
+
+size_t get_model_vertex_buffer_size(const Model* model)
+{
+    if (model->gpu.vertex_buffer == 0) {
+        return 0;
+    }
+    return (size_t)model->n_mesh_vertices
+        * ((model->gpu.normal_bits == 0) ? sizeof(MeshVertex) : sizeof(GpuQuantizedVertex));
+}
+
+void bind_model_buffers(const Model* model)
+{
+    if (model->gpu.vertex_array != 0) {
+        gl.bind_vertex_array(model->gpu.vertex_array);
+    }
+    else {
+        gl.bind_buffer(GL_ARRAY_BUFFER, model->gpu.vertex_buffer);
+        gl.bind_buffer(GL_ELEMENT_ARRAY_BUFFER, model->gpu.index_buffer);
+        set_vertex_pointers(model);
+    }
+    if (model->gpu.normal_bits != 0) {
+        // The 16 bit uvs are dequantized by the texture matrix.
+        const VertexQuantization* quantization = &model->quantization;
+        glMatrixMode(GL_TEXTURE);
+        glPushMatrix();
+        glTranslatef(quantization->uv_offset[0], quantization->uv_offset[1], 0.0f);
+        glScalef(quantization->uv_scale[0], quantization->uv_scale[1], 1.0f);
+        glMatrixMode(GL_MODELVIEW);
+    }
+}
+
+void unbind_model_buffers(const Model* model)
+{
+    if (model->gpu.normal_bits != 0) {
+        glMatrixMode(GL_TEXTURE);
+        glPopMatrix();
+        glMatrixMode(GL_MODELVIEW);
+    }
+    if (model->gpu.vertex_array != 0) {
+        gl.bind_vertex_array(0);
+    }
+    else {
+        glDisableClientState(GL_VERTEX_ARRAY);
+        glDisableClientState(GL_NORMAL_ARRAY);
+        glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+        gl.bind_buffer(GL_ARRAY_BUFFER, 0);
+        gl.bind_buffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    }
+}
@@ -1,13 +1,28 @@
 #include "info.h"
+#include "quantize.h"
 
 #include <stdio.h>
 
 void print_model_info(const Model* model)
 {
+    int i;
+
     printf("Vertices: %d\n", model->n_vertices);
     printf("Texture vertices: %d\n", model->n_texture_vertices);
     printf("Normals: %d\n", model->n_normals);
     printf("Triangles: %d\n", model->n_triangles);
+    printf("Mesh vertices: %d\n", model->n_mesh_vertices);
+    printf("Indices: %d (%d bit)\n", model->n_indices, model->index_size * 8);
+    printf("Meshlets: %d\n", model->n_meshlets);
+    printf("Materials: %d (%d submeshes)\n", model->n_materials, model->n_submeshes);
+    if (model->quantized_vertices != NULL) {
+        printf("Quantized vertices: %u bytes (2x%d bit normals)\n",
+               (unsigned int)get_vertex_data_size(model), model->quantization.normal_bits);
+    }
+    for (i = 1; i < model->n_lods; ++i) {
+        printf("LOD %d: %d triangles (error %f)\n",
+               i, model->lods[i].n_indices / 3, model->lods[i].error);
+    }
 }
 
 void print_bounding_box(const Model* model)
@@ -16,21 +31,21 @@ void print_bounding_box(const Model* model)
     double x, y, z;
     double min_x, max_x, min_y, max_y, min_z, max_z;
 
-    if (model->n_vertices == 0) {
+    if (model->n_mesh_vertices == 0) {
         return;
     }
 
-    min_x = model->vertices[0].x;
-    max_x = model->vertices[0].x;
-    min_y = model->vertices[0].y;
-    max_y = model->vertices[0].y;
-    min_z = model->vertices[0].z;
-    max_z = model->vertices[0].z;
-
-    for (i = 0; i < model->n_vertices; ++i) {
-        x = model->vertices[i].x;
-        y = model->vertices[i].y;
-        z = model->vertices[i].z;
+    min_x = model->mesh_vertices[0].position[0];
+    max_x = model->mesh_vertices[0].position[0];
+    min_y = model->mesh_vertices[0].position[1];
+    max_y = model->mesh_vertices[0].position[1];
+    min_z = model->mesh_vertices[0].position[2];
+    max_z = model->mesh_vertices[0].position[2];
+
+    for (i = 0; i < model->n_mesh_vertices; ++i) {
+        x = model->mesh_vertices[i].position[0];
+        y = model->mesh_vertices[i].position[1];
+        z = model->mesh_vertices[i].position[2];
         if (x < min_x) {
             min_x = x;
         }
@@ -0,0 +1,183 @@
+#include "json.h"
+#include "parse.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_TOKEN_CAPACITY 256
+#define MAX_JSON_DEPTH 64
+
+static int add_token(JsonToken** tokens, int* n_tokens, int* capacity, JsonType type, int start)
+{
+    JsonToken* token;
+
+    if (*n_tokens == *capacity) {
+        const int new_capacity = (*capacity > 0) ? *capacity * 2 : INITIAL_TOKEN_CAPACITY;
+        JsonToken* grown = (JsonToken*)realloc(*tokens, (size_t)new_capacity * sizeof(JsonToken));
+        if (grown == NULL) {
+            return -1;
+        }
+        *tokens = grown;
+        *capacity = new_capacity;
+    }
+    token = &(*tokens)[*n_tokens];
+    token->type = type;
+    token->start = start;
+    token->end = start;
+    token->size = 0;
+    return (*n_tokens)++;
+}
+
+JsonToken* tokenize_json(const char* text, size_t length, int* n_tokens)
+{
+    // Open containers and keys; a key is closed by its value.
+    int stack[MAX_JSON_DEPTH];
+    JsonToken* tokens = NULL;
+    JsonType type;
+    int capacity = 0;
+    int depth = 0;
+    int count = 0;
+    int index;
+    size_t i = 0;
+
+    while (i < length) {
+        const char c = text[i];
+        const int parent = (depth > 0) ? stack[depth - 1] : -1;
+
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == ',' || c == ':') {
+            ++i;
+            continue;
+        }
+        if (c == '}' || c == ']') {
+            if (depth == 0 || tokens[parent].type != ((c == '}') ? JSON_OBJECT : JSON_ARRAY)) {
+                break;
+            }
+            tokens[parent].end = (int)i + 1;
+            --depth;
+            ++i;
+            continue;
+        }
+        type = (c == '{') ? JSON_OBJECT : (c == '[') ? JSON_ARRAY
+            : (c == '"') ? JSON_STRING : JSON_PRIMITIVE;
+
+        index = add_token(&tokens, &count, &capacity, type, (int)i);
+        if (index < 0) {
+            break;
+        }
+        if (parent >= 0) {
+            ++tokens[parent].size;
+        }
+        if (type == JSON_STRING) {
+            size_t end = i + 1;
+            while (end < length && text[end] != '"') {
+                end += (text[end] == '\\') ? 2 : 1;
+            }
+            if (end >= length) {
+                break;
+            }
+            tokens[index].start = (int)i + 1;
+            tokens[index].end = (int)end;
+            i = end + 1;
+        }
+        else if (type == JSON_PRIMITIVE) {
+            size_t end = i;
+            while (end < length && strchr(" \t\r\n,:]}", text[end]) == NULL) {
+                ++end;
+            }
+            tokens[index].end = (int)end;
+            i = end;
+        }
+        else {
+            ++i;
+        }
+        // Keys stay open until their value has been read.
+        if (parent >= 0 && tokens[parent].type == JSON_STRING) {
+            --depth;
+        }
+        if (type == JSON_OBJECT || type == JSON_ARRAY
+            || (type == JSON_STRING && parent >= 0 && tokens[parent].type == JSON_OBJECT)) {
+            if (depth == MAX_JSON_DEPTH) {
+                break;
+            }
+            stack[depth++] = index;
+        }
+    }
+    if (i < length || depth != 0 || count == 0) {
+        free(tokens);
+        return NULL;
+    }
+    *n_tokens = count;
+    return tokens;
+}
+
+int skip_json_token(const JsonToken* tokens, int index)
+{
+    int remaining = 1;
+
+    while (remaining > 0) {
+        remaining += tokens[index].size - 1;
+        ++index;
+    }
+    return index;
+}
+
+int find_json_key(const char* text, const JsonToken* tokens, int object, const char* key)
+{
+    int index = object + 1;
+    int i;
+
+    if (object < 0 || tokens[object].type != JSON_OBJECT) {
+        return -1;
+    }
+    for (i = 0; i < tokens[object].size; ++i) {
+        if (is_json_string(text, &tokens[index], key)) {
+            return index + 1;
+        }
+        index = skip_json_token(tokens, index);
+    }
+    return -1;
+}
+
+int get_json_element(const JsonToken* tokens, int array, int n)
+{
+    int index = array + 1;
+    int i;
+
+    if (array < 0 || tokens[array].type != JSON_ARRAY || n < 0 || n >= tokens[array].size) {
+        return -1;
+    }
+    for (i = 0; i < n; ++i) {
+        index = skip_json_token(tokens, index);
+    }
+    return index;
+}
+
+int is_json_string(const char* text, const JsonToken* token, const char* value)
+{
+    const size_t length = strlen(value);
+
+    return token->type == JSON_STRING && (size_t)(token->end - token->start) == length
+        && memcmp(text + token->start, value, length) == 0;
+}
+
+int get_json_int(const char* text, const JsonToken* tokens, int index, int fallback)
+{
+    int value;
+
+    if (index < 0 || tokens[index].type != JSON_PRIMITIVE
+        || parse_int(text + tokens[index].start, text + tokens[index].end, &value) == NULL) {
+        return fallback;
+    }
+    return value;
+}
+
+double get_json_double(const char* text, const JsonToken* tokens, int index, double fallback)
+{
+    double value;
+
+    if (index < 0 || tokens[index].type != JSON_PRIMITIVE
+        || parse_double(text + tokens[index].start, text + tokens[index].end, &value) == NULL) {
+        return fallback;
+    }
+    return value;
+}
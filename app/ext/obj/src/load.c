@@ -1,92 +1,203 @@
 #include "load.h"
+#include "cache.h"
+#include "mapfile.h"
+#include "material.h"
+#include "meshlet.h"
+#include "optimize.h"
+#include "parse.h"
+#include "platform.h"
+#include "sanitize.h"
+#include "simplify.h"
+#include "weld.h"
 
 #include <stdlib.h>
-#include <string.h> /* strchr, memcpy */
+#include <string.h> /* strchr, strspn, memcpy */
 
 #define LINE_BUFFER_SIZE 1024
+#define INITIAL_CAPACITY 64
+#define MIN_CHUNK_SIZE (256 * 1024)
+
+/* Indices of a face point given relative to the end of the element arrays */
+#define RELATIVE_VERTEX 1
+#define RELATIVE_TEXTURE 2
+#define RELATIVE_NORMAL 4
+
+/* Material of the faces of a chunk before its first usemtl (set when stitching) */
+#define INHERITED_MATERIAL (-2)
+
+static int load_thread_count = 0;
+static int keep_high_precision = FALSE;
+
+void set_high_precision_import(int enabled)
+{
+    keep_high_precision = enabled ? TRUE : FALSE;
+}
+
+int is_high_precision_import(void)
+{
+    return keep_high_precision;
+}
+
+void set_load_thread_count(int count)
+{
+    load_thread_count = (count > 0) ? count : 0;
+}
+
+int get_load_thread_count(void)
+{
+    const char* env;
+    int count;
+
+    if (load_thread_count > 0) {
+        return load_thread_count;
+    }
+    env = getenv("OBJ_LOAD_THREADS");
+    if (env != NULL) {
+        count = atoi(env);
+        if (count > 0) {
+            return count;
+        }
+    }
+    return get_cpu_count();
+}
 
 int load_model(Model* model, const char* filename)
 {
+    MappedFile mapped;
+    SanitizeStats sanitize_stats;
     FILE* obj_file;
     int success;
+    int n_threads;
+    double start_time;
 
-    obj_file = fopen(filename, "r");
     printf("Load model '%s' ...\n", filename);
-    if (obj_file == NULL) {
-        printf("ERROR: Unable to open '%s' file!\n", filename);
-        return FALSE;
+    // The cache only holds the single precision mesh.
+    if (is_mesh_cache_enabled() && keep_high_precision == FALSE
+        && load_mesh_cache(model, filename) == TRUE) {
+        return TRUE;
+    }
+    if (map_file(&mapped, filename) == TRUE) {
+        n_threads = get_load_thread_count();
+        if (n_threads > MAX_PARALLEL_TASKS) {
+            n_threads = MAX_PARALLEL_TASKS;
+        }
+        if ((size_t)n_threads * MIN_CHUNK_SIZE > mapped.size) {
+            n_threads = (int)(mapped.size / MIN_CHUNK_SIZE);
+        }
+        start_time = get_time_seconds();
+        if (n_threads > 1) {
+            success = read_elements_parallel(model, mapped.data, mapped.size, n_threads);
+        }
+        else {
+            n_threads = 1;
+            success = read_elements_from_memory(model, mapped.data, mapped.size);
+        }
+        unmap_file(&mapped);
+        if (success == TRUE) {
+            printf("Parsed %d triangles in %.1f ms (%d thread%s)\n", model->n_triangles,
+                   (get_time_seconds() - start_time) * 1000.0, n_threads, (n_threads > 1) ? "s" : "");
+        }
+    }
+    else {
+        // Fallback when the file can't be mapped: line by line stream reading.
+        obj_file = fopen(filename, "r");
+        if (obj_file == NULL) {
+            printf("ERROR: Unable to open '%s' file!\n", filename);
+            return FALSE;
+        }
+        printf("Read model data ...\n");
+        success = read_elements(model, obj_file);
+        fclose(obj_file);
     }
-    printf("Count the elements ...\n");
-    count_elements(model, obj_file);
-    printf("Allocate memory for model ...\n");
-    allocate_model(model);
-    printf("Read model data ...\n");
-    fseek(obj_file, 0, SEEK_SET);
-    success = read_elements(model, obj_file);
     if (success == FALSE) {
         printf("ERROR: Unable to read the model data!\n");
+        free_model(model);
+        return FALSE;
+    }
+    if (model->material_library[0] != 0) {
+        // The model is still drawn without the library, with the default materials.
+        load_material_library(model, filename);
+    }
+    if (sanitize_model(model, &sanitize_stats) == FALSE) {
+        printf("ERROR: The model has no valid triangles!\n");
+        free_model(model);
+        return FALSE;
+    }
+    if (sanitize_stats.n_out_of_range > 0 || sanitize_stats.n_degenerate > 0) {
+        printf("Dropped %d out of range and %d degenerate triangles\n",
+               sanitize_stats.n_out_of_range, sanitize_stats.n_degenerate);
+    }
+    if (weld_model(model, keep_high_precision) == FALSE) {
+        printf("ERROR: Unable to weld the model vertices!\n");
+        free_model(model);
         return FALSE;
     }
+    return process_loaded_mesh(model, filename);
+}
+
+int process_loaded_mesh(Model* model, const char* filename)
+{
+    if (is_lod_generation_enabled() && generate_model_lods(model) == FALSE) {
+        printf("Unable to build the levels of detail of '%s'\n", filename);
+    }
+    if (is_mesh_optimization_enabled() && optimize_model(model) == FALSE) {
+        free_model(model);
+        return FALSE;
+    }
+    if (build_meshlets(model) == FALSE) {
+        printf("Unable to build the meshlets of '%s'\n", filename);
+    }
+    if (is_mesh_cache_enabled() && save_mesh_cache(model, filename) == FALSE) {
+        printf("Unable to write the mesh cache of '%s'\n", filename);
+    }
     return TRUE;
 }
 
-static int count_face_points_in_line(const char* line)
+/**
+ * Allocated element counts of the arrays while the model is being read.
+ * (The model counts are the used element counts.)
+ */
+typedef struct Capacity
 {
-    // Counts how many vertex references appear after 'f'.
-    // Works for: f v, f v/vt, f v//vn, f v/vt/vn
-    int count = 0;
-    int i = 0;
+    int vertices;
+    int texture_vertices;
+    int normals;
+    int triangles;
+} Capacity;
 
-    // find 'f'
-    while (line[i] != 0 && line[i] != 'f') i++;
-    if (line[i] == 0) return 0;
-    i++;
+static int reserve_elements(void** array, int* capacity, int needed, size_t element_size)
+{
+    // Geometric growth, so the single pass stays amortized O(n).
+    void* grown;
+    int new_capacity;
 
-    while (line[i] != 0) {
-        // skip spaces
-        while (line[i] == ' ' || line[i] == '\t') i++;
-        if (line[i] == 0 || line[i] == '\n' || line[i] == '\r') break;
-        // must start with a digit or '-' for an index
-        if (is_numeric(line[i]) == TRUE) {
-            count++;
-            // skip token
-            while (line[i] != 0 && line[i] != ' ' && line[i] != '\t' && line[i] != '\n' && line[i] != '\r') i++;
-        } else {
-            // unknown token, skip
-            while (line[i] != 0 && line[i] != ' ' && line[i] != '\t' && line[i] != '\n' && line[i] != '\r') i++;
-        }
+    if (needed <= *capacity) {
+        return TRUE;
+    }
+    new_capacity = (*capacity > 0) ? *capacity : INITIAL_CAPACITY;
+    while (new_capacity < needed) {
+        new_capacity *= 2;
     }
-    return count;
+    grown = realloc(*array, (size_t)new_capacity * element_size);
+    if (grown == NULL) {
+        printf("ERROR: Out of memory while reading the model!\n");
+        return FALSE;
+    }
+    *array = grown;
+    *capacity = new_capacity;
+    return TRUE;
 }
 
-void count_elements(Model* model, FILE* file)
+static void shrink_elements(void** array, int count, size_t element_size)
 {
-    char line[LINE_BUFFER_SIZE];
+    void* shrunk;
 
-    init_model(model);
-    while (fgets(line, LINE_BUFFER_SIZE, file) != NULL) {
-        switch (calc_element_type(line)) {
-        case NONE:
-            break;
-        case VERTEX:
-            ++model->n_vertices;
-            break;
-        case TEXTURE_VERTEX:
-            ++model->n_texture_vertices;
-            break;
-        case NORMAL:
-            ++model->n_normals;
-            break;
-        case FACE:
-        {
-            // Faces can be triangles or polygons. We triangulate by fan: (n-2) triangles.
-            int n = count_face_points_in_line(line);
-            if (n >= 3) {
-                model->n_triangles += (n - 2);
-            }
-            break;
-        }
-        }
+    if (*array == NULL || count <= 0) {
+        return;
+    }
+    shrunk = realloc(*array, (size_t)count * element_size);
+    if (shrunk != NULL) {
+        *array = shrunk;
     }
 }
 
@@ -110,6 +221,29 @@ static void set_default_slots(Model* model)
     }
 }
 
+/**
+ * Turn the negative (relative) OBJ indices of the face point into 1-based indices
+ * with the element counts read so far. Returns the RELATIVE_* bits of the changed indices.
+ */
+static int resolve_relative_indices(FacePoint* point, const Model* model)
+{
+    int relative = 0;
+
+    if (point->vertex_index < 0) {
+        point->vertex_index += model->n_vertices + 1;
+        relative |= RELATIVE_VERTEX;
+    }
+    if (point->texture_index < 0) {
+        point->texture_index += model->n_texture_vertices + 1;
+        relative |= RELATIVE_TEXTURE;
+    }
+    if (point->normal_index < 0) {
+        point->normal_index += model->n_normals + 1;
+        relative |= RELATIVE_NORMAL;
+    }
+    return relative;
+}
+
 static int parse_face_point(FacePoint* out, const char* tok)
 {
     // Parses: v, v/vt, v//vn, v/vt/vn
@@ -149,7 +283,53 @@ static int parse_face_point(FacePoint* out, const char* tok)
     return TRUE;
 }
 
-static int read_face_triangulated(Model* model, int* triangle_index_io, const char* text)
+/**
+ * Copy the rest of the line (a material or file name) without the surrounding spaces.
+ */
+static void copy_name(char* name, size_t size, const char* p, const char* end)
+{
+    const char* stop;
+    size_t length;
+
+    p = skip_spaces(p, end);
+    stop = p;
+    while (stop < end && *stop != '\n' && *stop != 0) {
+        ++stop;
+    }
+    while (stop > p && (stop[-1] == ' ' || stop[-1] == '\t' || stop[-1] == '\r')) {
+        --stop;
+    }
+    length = (size_t)(stop - p);
+    if (length >= size) {
+        length = size - 1;
+    }
+    memcpy(name, p, length);
+    name[length] = 0;
+}
+
+/**
+ * Handle an mtllib or usemtl record (text points after the keyword).
+ * The current material is updated by usemtl.
+ */
+static int read_material_record(Model* model, ElementType type, const char* text, const char* end,
+                                int* current_material)
+{
+    char name[MAX_MATERIAL_PATH];
+
+    copy_name(name, sizeof(name), text, end);
+    if (type == MATERIAL_LIBRARY) {
+        // Only the first library is used.
+        if (model->material_library[0] == 0) {
+            memcpy(model->material_library, name, sizeof(model->material_library));
+        }
+        return TRUE;
+    }
+    name[MAX_MATERIAL_NAME - 1] = 0;
+    *current_material = add_model_material(model, name);
+    return *current_material != NO_MATERIAL;
+}
+
+static int read_face_triangulated(Model* model, Capacity* capacity, const char* text, int material)
 {
     // Triangulate a polygon face line into model->triangles.
     // We split by whitespace after 'f'.
@@ -180,18 +360,25 @@ static int read_face_triangulated(Model* model, int* triangle_index_io, const ch
         tok[cpy] = 0;
 
         if (parse_face_point(&pts[n], tok) == FALSE) return FALSE;
+        resolve_relative_indices(&pts[n], model);
         n++;
     }
 
     if (n < 3) return FALSE;
 
+    if (reserve_elements((void**)&model->triangles, &capacity->triangles,
+                         model->n_triangles + (n - 2), sizeof(Triangle)) == FALSE) {
+        return FALSE;
+    }
+
     // Fan triangulation: (0, i, i+1)
     for (int i = 1; i < n - 1; i++) {
-        Triangle* tri = &model->triangles[*triangle_index_io];
+        Triangle* tri = &model->triangles[model->n_triangles];
         tri->points[0] = pts[0];
         tri->points[1] = pts[i];
         tri->points[2] = pts[i + 1];
-        (*triangle_index_io)++;
+        tri->material = material;
+        model->n_triangles++;
     }
     return TRUE;
 }
@@ -199,48 +386,71 @@ static int read_face_triangulated(Model* model, int* triangle_index_io, const ch
 int read_elements(Model* model, FILE* file)
 {
     char line[LINE_BUFFER_SIZE];
-    int vertex_index;
-    int texture_index;
-    int normal_index;
-    int triangle_index;
+    Capacity capacity = { 0, 0, 0, 0 };
+    int material = NO_MATERIAL;
     int success;
 
-    allocate_model(model);
+    // Single pass: the arrays grow while reading and are shrunk to fit at the end.
+    // Slot 0 of the vertex, texture and normal arrays is the default slot.
+    init_model(model);
+    if (reserve_elements((void**)&model->vertices, &capacity.vertices, 1, sizeof(Vertex)) == FALSE ||
+        reserve_elements((void**)&model->texture_vertices, &capacity.texture_vertices, 1, sizeof(TextureVertex)) == FALSE ||
+        reserve_elements((void**)&model->normals, &capacity.normals, 1, sizeof(Vertex)) == FALSE) {
+        return FALSE;
+    }
     set_default_slots(model);
-    vertex_index = 1;
-    texture_index = 1;
-    normal_index = 1;
-    triangle_index = 0;
     while (fgets(line, LINE_BUFFER_SIZE, file) != NULL) {
-        switch (calc_element_type(line)) {
+        const ElementType type = calc_element_type(line);
+        switch (type) {
         case NONE:
             break;
+        case MATERIAL_LIBRARY:
+        case USE_MATERIAL:
+            // Both keywords have 6 characters.
+            if (read_material_record(model, type, line + strspn(line, " \t") + 6, line + strlen(line),
+                                     &material) == FALSE) {
+                printf("Unable to read material data!\n");
+                return FALSE;
+            }
+            break;
         case VERTEX:
-            success = read_vertex(&(model->vertices[vertex_index]), line);
+            if (reserve_elements((void**)&model->vertices, &capacity.vertices,
+                                 model->n_vertices + 2, sizeof(Vertex)) == FALSE) {
+                return FALSE;
+            }
+            success = read_vertex(&(model->vertices[model->n_vertices + 1]), line);
             if (success == FALSE) {
                 printf("Unable to read vertex data!\n");
                 return FALSE;
             }
-            ++vertex_index;
+            ++model->n_vertices;
             break;
         case TEXTURE_VERTEX:
-            success = read_texture_vertex(&(model->texture_vertices[texture_index]), line);
+            if (reserve_elements((void**)&model->texture_vertices, &capacity.texture_vertices,
+                                 model->n_texture_vertices + 2, sizeof(TextureVertex)) == FALSE) {
+                return FALSE;
+            }
+            success = read_texture_vertex(&(model->texture_vertices[model->n_texture_vertices + 1]), line);
             if (success == FALSE) {
                 printf("Unable to read texture vertex data!\n");
                 return FALSE;
             }
-            ++texture_index;
+            ++model->n_texture_vertices;
             break;
         case NORMAL:
-            success = read_normal(&(model->normals[normal_index]), line);
+            if (reserve_elements((void**)&model->normals, &capacity.normals,
+                                 model->n_normals + 2, sizeof(Vertex)) == FALSE) {
+                return FALSE;
+            }
+            success = read_normal(&(model->normals[model->n_normals + 1]), line);
             if (success == FALSE) {
                 printf("Unable to read normal vector data!\n");
                 return FALSE;
             }
-            ++normal_index;
+            ++model->n_normals;
             break;
         case FACE:
-            success = read_face_triangulated(model, &triangle_index, line);
+            success = read_face_triangulated(model, &capacity, line, material);
             if (success == FALSE) {
                 printf("Unable to read face data!\n");
                 return FALSE;
@@ -248,9 +458,447 @@ int read_elements(Model* model, FILE* file)
             break;
         }
     }
+
+    shrink_elements((void**)&model->vertices, model->n_vertices + 1, sizeof(Vertex));
+    shrink_elements((void**)&model->texture_vertices, model->n_texture_vertices + 1, sizeof(TextureVertex));
+    shrink_elements((void**)&model->normals, model->n_normals + 1, sizeof(Vertex));
+    shrink_elements((void**)&model->triangles, model->n_triangles, sizeof(Triangle));
     return TRUE;
 }
 
+static const char* read_vector_in_place(const char* p, const char* end, double* values, int n_required, int n_values)
+{
+    // Reads whitespace separated numbers of a v/vt/vn record.
+    // Optional trailing components (e.g. the w of "v x y z w") are ignored.
+    int i;
+
+    for (i = 0; i < n_values; ++i) {
+        const char* next;
+        p = skip_spaces(p, end);
+        next = parse_double(p, end, &values[i]);
+        if (next == NULL) {
+            if (i < n_required) {
+                return NULL;
+            }
+            values[i] = 0.0;
+            continue;
+        }
+        p = next;
+    }
+    return skip_line(p, end);
+}
+
+static const char* parse_face_point_in_place(FacePoint* out, const char* p, const char* end)
+{
+    // Parses: v, v/vt, v//vn, v/vt/vn directly from the buffer.
+    // Missing vt/vn become 0.
+    out->texture_index = 0;
+    out->normal_index = 0;
+
+    p = parse_int(p, end, &out->vertex_index);
+    if (p == NULL) {
+        return NULL;
+    }
+    if (p < end && *p == '/') {
+        ++p;
+        if (p < end && *p != '/') {
+            p = parse_int(p, end, &out->texture_index);
+            if (p == NULL) {
+                return NULL;
+            }
+        }
+        if (p < end && *p == '/') {
+            ++p;
+            p = parse_int(p, end, &out->normal_index);
+            if (p == NULL) {
+                return NULL;
+            }
+        }
+    }
+    return p;
+}
+
+/**
+ * Triangle corners of a chunk with relative indices. The indices were resolved
+ * with the chunk's own element counts, so they are rebased when the chunks are stitched.
+ */
+typedef struct RelativeCorner
+{
+    int corner;
+    int mask;
+} RelativeCorner;
+
+typedef struct RelativeCorners
+{
+    RelativeCorner* items;
+    int count;
+    int capacity;
+} RelativeCorners;
+
+static int add_relative_corners(RelativeCorners* relative, int triangle, const int masks[3])
+{
+    int i;
+
+    for (i = 0; i < 3; ++i) {
+        if (masks[i] == 0) {
+            continue;
+        }
+        if (reserve_elements((void**)&relative->items, &relative->capacity,
+                             relative->count + 1, sizeof(RelativeCorner)) == FALSE) {
+            return FALSE;
+        }
+        relative->items[relative->count].corner = triangle * 3 + i;
+        relative->items[relative->count].mask = masks[i];
+        ++relative->count;
+    }
+    return TRUE;
+}
+
+static const char* read_face_in_place(Model* model, Capacity* capacity, RelativeCorners* relative,
+                                      int material, const char* p, const char* end)
+{
+    // Streamed fan triangulation: (first, previous, current) for every new point,
+    // so there is no limit on the number of polygon points.
+    FacePoint first;
+    FacePoint previous;
+    FacePoint current;
+    int masks[3] = { 0, 0, 0 };
+    int current_mask;
+    int n = 0;
+
+    for (;;) {
+        p = skip_spaces(p, end);
+        if (p >= end || *p == '\n') {
+            break;
+        }
+        p = parse_face_point_in_place(&current, p, end);
+        if (p == NULL) {
+            return NULL;
+        }
+        current_mask = resolve_relative_indices(&current, model);
+        if (n >= 2) {
+            Triangle* tri;
+            if (reserve_elements((void**)&model->triangles, &capacity->triangles,
+                                 model->n_triangles + 1, sizeof(Triangle)) == FALSE) {
+                return NULL;
+            }
+            tri = &model->triangles[model->n_triangles++];
+            tri->points[0] = first;
+            tri->points[1] = previous;
+            tri->points[2] = current;
+            tri->material = material;
+            masks[2] = current_mask;
+            if (relative != NULL && (masks[0] | masks[1] | masks[2]) != 0
+                && add_relative_corners(relative, model->n_triangles - 1, masks) == FALSE) {
+                return NULL;
+            }
+        }
+        else if (n == 0) {
+            first = current;
+            masks[0] = current_mask;
+        }
+        previous = current;
+        masks[1] = current_mask;
+        ++n;
+    }
+    if (n < 3) {
+        return NULL;
+    }
+    return skip_line(p, end);
+}
+
+static int has_keyword(const char* p, const char* end, const char* keyword)
+{
+    const size_t length = strlen(keyword);
+    return (size_t)(end - p) > length && memcmp(p, keyword, length) == 0
+        && (p[length] == ' ' || p[length] == '\t');
+}
+
+/**
+ * material: the material of the faces before the first usemtl;
+ * it is the material of the last usemtl on return.
+ */
+static int read_records_in_place(Model* model, RelativeCorners* relative, int* material,
+                                 const char* p, const char* end)
+{
+    Capacity capacity = { 0, 0, 0, 0 };
+    double values[3];
+
+    init_model(model);
+    if (reserve_elements((void**)&model->vertices, &capacity.vertices, 1, sizeof(Vertex)) == FALSE ||
+        reserve_elements((void**)&model->texture_vertices, &capacity.texture_vertices, 1, sizeof(TextureVertex)) == FALSE ||
+        reserve_elements((void**)&model->normals, &capacity.normals, 1, sizeof(Vertex)) == FALSE) {
+        return FALSE;
+    }
+    set_default_slots(model);
+    while (p < end) {
+        p = skip_spaces(p, end);
+        if (p + 1 >= end) {
+            break;
+        }
+        if (p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')) {
+            if (reserve_elements((void**)&model->vertices, &capacity.vertices,
+                                 model->n_vertices + 2, sizeof(Vertex)) == FALSE) {
+                return FALSE;
+            }
+            p = read_vector_in_place(p + 2, end, values, 3, 3);
+            if (p == NULL) {
+                printf("Unable to read vertex data!\n");
+                return FALSE;
+            }
+            ++model->n_vertices;
+            model->vertices[model->n_vertices].x = values[0];
+            model->vertices[model->n_vertices].y = values[1];
+            model->vertices[model->n_vertices].z = values[2];
+        }
+        else if (p[0] == 'v' && p[1] == 't') {
+            if (reserve_elements((void**)&model->texture_vertices, &capacity.texture_vertices,
+                                 model->n_texture_vertices + 2, sizeof(TextureVertex)) == FALSE) {
+                return FALSE;
+            }
+            p = read_vector_in_place(p + 2, end, values, 1, 2);
+            if (p == NULL) {
+                printf("Unable to read texture vertex data!\n");
+                return FALSE;
+            }
+            ++model->n_texture_vertices;
+            model->texture_vertices[model->n_texture_vertices].u = values[0];
+            model->texture_vertices[model->n_texture_vertices].v = values[1];
+        }
+        else if (p[0] == 'v' && p[1] == 'n') {
+            if (reserve_elements((void**)&model->normals, &capacity.normals,
+                                 model->n_normals + 2, sizeof(Vertex)) == FALSE) {
+                return FALSE;
+            }
+            p = read_vector_in_place(p + 2, end, values, 3, 3);
+            if (p == NULL) {
+                printf("Unable to read normal vector data!\n");
+                return FALSE;
+            }
+            ++model->n_normals;
+            model->normals[model->n_normals].x = values[0];
+            model->normals[model->n_normals].y = values[1];
+            model->normals[model->n_normals].z = values[2];
+        }
+        else if (p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+            p = read_face_in_place(model, &capacity, relative, *material, p + 2, end);
+            if (p == NULL) {
+                printf("Unable to read face data!\n");
+                return FALSE;
+            }
+        }
+        else if (has_keyword(p, end, "mtllib") || has_keyword(p, end, "usemtl")) {
+            const ElementType type = (p[0] == 'm') ? MATERIAL_LIBRARY : USE_MATERIAL;
+            if (read_material_record(model, type, p + 6, end, material) == FALSE) {
+                printf("Unable to read material data!\n");
+                return FALSE;
+            }
+            p = skip_line(p, end);
+        }
+        else {
+            p = skip_line(p, end);
+        }
+    }
+    return TRUE;
+}
+
+int read_elements_from_memory(Model* model, const char* data, size_t size)
+{
+    int material = NO_MATERIAL;
+
+    if (read_records_in_place(model, NULL, &material, data, data + size) == FALSE) {
+        return FALSE;
+    }
+    shrink_elements((void**)&model->vertices, model->n_vertices + 1, sizeof(Vertex));
+    shrink_elements((void**)&model->texture_vertices, model->n_texture_vertices + 1, sizeof(TextureVertex));
+    shrink_elements((void**)&model->normals, model->n_normals + 1, sizeof(Vertex));
+    shrink_elements((void**)&model->triangles, model->n_triangles, sizeof(Triangle));
+    return TRUE;
+}
+
+/**
+ * Part of the OBJ text parsed by one worker thread
+ */
+typedef struct ModelChunk
+{
+    const char* begin;
+    const char* end;
+    Model part;
+    RelativeCorners relative;
+    /* Material of the last usemtl of the chunk (or INHERITED_MATERIAL) */
+    int material;
+    int success;
+} ModelChunk;
+
+static void read_chunk_task(void* context, int task_index)
+{
+    ModelChunk* chunk = &((ModelChunk*)context)[task_index];
+
+    chunk->material = INHERITED_MATERIAL;
+    chunk->success = read_records_in_place(&chunk->part, &chunk->relative, &chunk->material,
+                                           chunk->begin, chunk->end);
+}
+
+static void rebase_relative_corners(Model* model, const RelativeCorners* relative, int triangle_base,
+                                    int vertex_base, int texture_base, int normal_base)
+{
+    int i;
+
+    for (i = 0; i < relative->count; ++i) {
+        const RelativeCorner* item = &relative->items[i];
+        FacePoint* point = &model->triangles[triangle_base + item->corner / 3].points[item->corner % 3];
+        if (item->mask & RELATIVE_VERTEX) {
+            point->vertex_index += vertex_base;
+        }
+        if (item->mask & RELATIVE_TEXTURE) {
+            point->texture_index += texture_base;
+        }
+        if (item->mask & RELATIVE_NORMAL) {
+            point->normal_index += normal_base;
+        }
+    }
+}
+
+/**
+ * Move the materials of the chunk into the material table of the model by name.
+ * Faces before the first usemtl of the chunk get the current material of the previous chunks.
+ */
+static int stitch_materials(Model* model, const ModelChunk* chunk, int triangle_base, int* current_material)
+{
+    const Model* part = &chunk->part;
+    int* remap = NULL;
+    int i;
+
+    if (model->material_library[0] == 0) {
+        memcpy(model->material_library, part->material_library, sizeof(model->material_library));
+    }
+    if (part->n_materials > 0) {
+        remap = (int*)malloc((size_t)part->n_materials * sizeof(int));
+        if (remap == NULL) {
+            return FALSE;
+        }
+        for (i = 0; i < part->n_materials; ++i) {
+            remap[i] = add_model_material(model, part->materials[i].name);
+        }
+    }
+    for (i = 0; i < part->n_triangles; ++i) {
+        Triangle* triangle = &model->triangles[triangle_base + i];
+        if (triangle->material == INHERITED_MATERIAL) {
+            triangle->material = *current_material;
+        }
+        else if (triangle->material != NO_MATERIAL) {
+            triangle->material = remap[triangle->material];
+        }
+    }
+    if (chunk->material != INHERITED_MATERIAL) {
+        *current_material = (chunk->material != NO_MATERIAL) ? remap[chunk->material] : NO_MATERIAL;
+    }
+    free(remap);
+    return TRUE;
+}
+
+static int stitch_chunks(Model* model, ModelChunk* chunks, int n_chunks)
+{
+    // Prefix sums of the per-chunk counts give the position of every chunk in the
+    // final arrays. Chunks are stitched in file order, so the 1-based global OBJ
+    // indices of the faces refer to the same elements as in the serial reader.
+    int vertex_base = 0;
+    int texture_base = 0;
+    int normal_base = 0;
+    int triangle_base = 0;
+    int material = NO_MATERIAL;
+    int i;
+
+    init_model(model);
+    for (i = 0; i < n_chunks; ++i) {
+        model->n_vertices += chunks[i].part.n_vertices;
+        model->n_texture_vertices += chunks[i].part.n_texture_vertices;
+        model->n_normals += chunks[i].part.n_normals;
+        model->n_triangles += chunks[i].part.n_triangles;
+    }
+    allocate_model(model);
+    if (model->vertices == NULL || model->texture_vertices == NULL || model->normals == NULL
+        || (model->triangles == NULL && model->n_triangles > 0)) {
+        printf("ERROR: Out of memory while reading the model!\n");
+        return FALSE;
+    }
+    set_default_slots(model);
+    for (i = 0; i < n_chunks; ++i) {
+        const Model* part = &chunks[i].part;
+        memcpy(&model->vertices[1 + vertex_base], &part->vertices[1],
+               (size_t)part->n_vertices * sizeof(Vertex));
+        memcpy(&model->texture_vertices[1 + texture_base], &part->texture_vertices[1],
+               (size_t)part->n_texture_vertices * sizeof(TextureVertex));
+        memcpy(&model->normals[1 + normal_base], &part->normals[1],
+               (size_t)part->n_normals * sizeof(Vertex));
+        if (part->n_triangles > 0) {
+            memcpy(&model->triangles[triangle_base], part->triangles,
+                   (size_t)part->n_triangles * sizeof(Triangle));
+        }
+        rebase_relative_corners(model, &chunks[i].relative, triangle_base,
+                                vertex_base, texture_base, normal_base);
+        if (stitch_materials(model, &chunks[i], triangle_base, &material) == FALSE) {
+            printf("ERROR: Out of memory while reading the model!\n");
+            return FALSE;
+        }
+        vertex_base += part->n_vertices;
+        texture_base += part->n_texture_vertices;
+        normal_base += part->n_normals;
+        triangle_base += part->n_triangles;
+    }
+    return TRUE;
+}
+
+int read_elements_parallel(Model* model, const char* data, size_t size, int n_threads)
+{
+    ModelChunk* chunks;
+    const char* end = data + size;
+    const char* begin = data;
+    int success;
+    int i;
+
+    if (n_threads <= 1) {
+        return read_elements_from_memory(model, data, size);
+    }
+    chunks = (ModelChunk*)calloc((size_t)n_threads, sizeof(ModelChunk));
+    if (chunks == NULL) {
+        return read_elements_from_memory(model, data, size);
+    }
+
+    // Split at newline boundaries so every record belongs to exactly one chunk.
+    for (i = 0; i < n_threads; ++i) {
+        const char* split = (i == n_threads - 1) ? end : data + size / (size_t)n_threads * (size_t)(i + 1);
+        if (split < begin) {
+            split = begin;
+        }
+        if (split < end) {
+            split = skip_line(split, end);
+        }
+        chunks[i].begin = begin;
+        chunks[i].end = split;
+        init_model(&chunks[i].part);
+        begin = split;
+    }
+
+    run_parallel(read_chunk_task, chunks, n_threads);
+
+    success = TRUE;
+    for (i = 0; i < n_threads; ++i) {
+        if (chunks[i].success == FALSE) {
+            success = FALSE;
+        }
+    }
+    if (success == TRUE) {
+        success = stitch_chunks(model, chunks, n_threads);
+    }
+    for (i = 0; i < n_threads; ++i) {
+        free_model(&chunks[i].part);
+        free(chunks[i].relative.items);
+    }
+    free(chunks);
+    return success;
+}
+
 ElementType calc_element_type(const char* text)
 {
     int i;
@@ -271,6 +919,12 @@ ElementType calc_element_type(const char* text)
         else if (text[i] == 'f') {
             return FACE;
         }
+        else if (strncmp(&text[i], "mtllib", 6) == 0) {
+            return MATERIAL_LIBRARY;
+        }
+        else if (strncmp(&text[i], "usemtl", 6) == 0) {
+            return USE_MATERIAL;
+        }
         else if (text[i] != ' ' && text[i] != '\t') {
             return NONE;
         }
@@ -0,0 +1,126 @@
+#include "mapfile.h"
+#include "model.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+static int map_file_with_access(MappedFile* file, const char* filename, int copy_on_write)
+{
+    HANDLE handle;
+    HANDLE mapping;
+    LARGE_INTEGER size;
+    void* view;
+
+    file->data = NULL;
+    file->size = 0;
+    file->handle = NULL;
+
+    handle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+                         OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return FALSE;
+    }
+    if (GetFileSizeEx(handle, &size) == 0) {
+        CloseHandle(handle);
+        return FALSE;
+    }
+    if (size.QuadPart == 0) {
+        CloseHandle(handle);
+        return TRUE;
+    }
+    mapping = CreateFileMappingA(handle, NULL, copy_on_write ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(handle);
+    if (mapping == NULL) {
+        return FALSE;
+    }
+    view = MapViewOfFile(mapping, copy_on_write ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+    if (view == NULL) {
+        CloseHandle(mapping);
+        return FALSE;
+    }
+    file->data = (const char*)view;
+    file->size = (size_t)size.QuadPart;
+    file->handle = mapping;
+    return TRUE;
+}
+
+void unmap_file(MappedFile* file)
+{
+    if (file->data != NULL) {
+        UnmapViewOfFile(file->data);
+    }
+    if (file->handle != NULL) {
+        CloseHandle((HANDLE)file->handle);
+    }
+    file->data = NULL;
+    file->size = 0;
+    file->handle = NULL;
+}
+
+#else
+
+static int map_file_with_access(MappedFile* file, const char* filename, int copy_on_write)
+{
+    int fd;
+    struct stat info;
+    void* view;
+
+    file->data = NULL;
+    file->size = 0;
+    file->handle = NULL;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return FALSE;
+    }
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        return FALSE;
+    }
+    if (info.st_size == 0) {
+        close(fd);
+        return TRUE;
+    }
+    view = mmap(NULL, (size_t)info.st_size, copy_on_write ? (PROT_READ | PROT_WRITE) : PROT_READ,
+                MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (view == MAP_FAILED) {
+        return FALSE;
+    }
+    if (!copy_on_write) {
+        madvise(view, (size_t)info.st_size, MADV_SEQUENTIAL);
+    }
+    file->data = (const char*)view;
+    file->size = (size_t)info.st_size;
+    return TRUE;
+}
+
+void unmap_file(MappedFile* file)
+{
+    if (file->data != NULL) {
+        munmap((void*)file->data, file->size);
+    }
+    file->data = NULL;
+    file->size = 0;
+    file->handle = NULL;
+}
+
+#endif
+
+int map_file(MappedFile* file, const char* filename)
+{
+    return map_file_with_access(file, filename, FALSE);
+}
+
+int map_file_private(MappedFile* file, const char* filename)
+{
+    return map_file_with_access(file, filename, TRUE);
+}
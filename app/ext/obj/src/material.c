@@ -0,0 +1,138 @@
+#include "material.h"
+#include "mapfile.h"
+#include "parse.h"
+
+#include <stdio.h>
+#include <string.h>
+
+void get_material_library_path(char* path, size_t size, const char* obj_filename, const char* library)
+{
+    const char* slash = strrchr(obj_filename, '/');
+    const char* backslash = strrchr(obj_filename, '\\');
+    size_t length;
+
+    if (backslash != NULL && (slash == NULL || backslash > slash)) {
+        slash = backslash;
+    }
+    length = (slash != NULL) ? (size_t)(slash - obj_filename + 1) : 0;
+    if (length >= size) {
+        length = size - 1;
+    }
+    memcpy(path, obj_filename, length);
+    path[length] = 0;
+    strncat(path, library, size - length - 1);
+}
+
+static int has_keyword(const char* p, const char* end, const char* keyword)
+{
+    const size_t length = strlen(keyword);
+    return (size_t)(end - p) > length && memcmp(p, keyword, length) == 0
+        && (p[length] == ' ' || p[length] == '\t');
+}
+
+static void read_name(char* name, size_t size, const char* p, const char* end)
+{
+    const char* stop;
+    size_t length;
+
+    p = skip_spaces(p, end);
+    stop = p;
+    while (stop < end && *stop != '\n') {
+        ++stop;
+    }
+    while (stop > p && (stop[-1] == ' ' || stop[-1] == '\t' || stop[-1] == '\r')) {
+        --stop;
+    }
+    length = (size_t)(stop - p);
+    if (length >= size) {
+        length = size - 1;
+    }
+    memcpy(name, p, length);
+    name[length] = 0;
+}
+
+static void read_color(float color[3], const char* p, const char* end)
+{
+    double value;
+    int k;
+
+    for (k = 0; k < 3; ++k) {
+        p = parse_double(skip_spaces(p, end), end, &value);
+        if (p == NULL) {
+            // A single value is a gray color.
+            if (k == 1) {
+                color[1] = color[0];
+                color[2] = color[0];
+            }
+            return;
+        }
+        color[k] = (float)value;
+    }
+}
+
+static void read_scalar(float* scalar, const char* p, const char* end)
+{
+    double value;
+
+    if (parse_double(skip_spaces(p, end), end, &value) != NULL) {
+        *scalar = (float)value;
+    }
+}
+
+int load_material_library(Model* model, const char* obj_filename)
+{
+    char path[MAX_MATERIAL_PATH * 2];
+    char name[MAX_MATERIAL_NAME];
+    MappedFile mapped;
+    ObjMaterial* material = NULL;
+    const char* p;
+    const char* end;
+    int n_found = 0;
+    int index;
+
+    get_material_library_path(path, sizeof(path), obj_filename, model->material_library);
+    if (map_file(&mapped, path) == FALSE) {
+        printf("WARNING: Unable to open the material library '%s'!\n", path);
+        return FALSE;
+    }
+    p = mapped.data;
+    end = mapped.data + mapped.size;
+    while (p != NULL && p < end) {
+        p = skip_spaces(p, end);
+        if (has_keyword(p, end, "newmtl")) {
+            read_name(name, sizeof(name), p + 6, end);
+            index = find_model_material(model, name);
+            material = (index != NO_MATERIAL) ? &model->materials[index] : NULL;
+            n_found += (material != NULL);
+        }
+        else if (material != NULL) {
+            if (has_keyword(p, end, "Ka")) {
+                read_color(material->ambient, p + 2, end);
+            }
+            else if (has_keyword(p, end, "Kd")) {
+                read_color(material->diffuse, p + 2, end);
+            }
+            else if (has_keyword(p, end, "Ks")) {
+                read_color(material->specular, p + 2, end);
+            }
+            else if (has_keyword(p, end, "Ns")) {
+                read_scalar(&material->shininess, p + 2, end);
+            }
+            else if (has_keyword(p, end, "d")) {
+                read_scalar(&material->alpha, p + 1, end);
+            }
+            else if (has_keyword(p, end, "Tr")) {
+                // Transparency is the inverse of the dissolve.
+                read_scalar(&material->alpha, p + 2, end);
+                material->alpha = 1.0f - material->alpha;
+            }
+            else if (has_keyword(p, end, "map_Kd")) {
+                read_name(material->texture, sizeof(material->texture), p + 6, end);
+            }
+        }
+        p = skip_line(p, end);
+    }
+    unmap_file(&mapped);
+    printf("Read %d of %d materials from '%s'\n", n_found, model->n_materials, path);
+    return TRUE;
+}
@@ -0,0 +1,305 @@
+#include "meshlet.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Normal cones wider than this (minimal normal dot product) are not worth testing */
+#define MIN_CONE_DOT 0.1f
+
+static void calc_meshlet_bounds(Meshlet* meshlet, const Model* model)
+{
+    const MeshVertex* vertices = model->mesh_vertices;
+    float min[3], max[3];
+    float axis[3] = { 0.0f, 0.0f, 0.0f };
+    float length;
+    float min_dot = 1.0f;
+    float radius_squared = 0.0f;
+    int i, k;
+
+    for (k = 0; k < 3; ++k) {
+        min[k] = vertices[get_model_index(model, meshlet->first_index)].position[k];
+        max[k] = min[k];
+    }
+    for (i = 0; i < meshlet->n_indices; ++i) {
+        const float* p = vertices[get_model_index(model, meshlet->first_index + i)].position;
+        for (k = 0; k < 3; ++k) {
+            if (p[k] < min[k]) {
+                min[k] = p[k];
+            }
+            if (p[k] > max[k]) {
+                max[k] = p[k];
+            }
+        }
+    }
+    for (k = 0; k < 3; ++k) {
+        meshlet->center[k] = 0.5f * (min[k] + max[k]);
+    }
+    for (i = 0; i < meshlet->n_indices; ++i) {
+        const float* p = vertices[get_model_index(model, meshlet->first_index + i)].position;
+        const float dx = p[0] - meshlet->center[0];
+        const float dy = p[1] - meshlet->center[1];
+        const float dz = p[2] - meshlet->center[2];
+        const float d = dx * dx + dy * dy + dz * dz;
+        if (d > radius_squared) {
+            radius_squared = d;
+        }
+    }
+    meshlet->radius = sqrtf(radius_squared);
+
+    // Normal cone: the area weighted average of the face normals (front face is CCW),
+    // opened up to contain every face normal.
+    for (i = 0; i < meshlet->n_indices; i += 3) {
+        const float* p0 = vertices[get_model_index(model, meshlet->first_index + i)].position;
+        const float* p1 = vertices[get_model_index(model, meshlet->first_index + i + 1)].position;
+        const float* p2 = vertices[get_model_index(model, meshlet->first_index + i + 2)].position;
+        const float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+        const float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+        axis[0] += e1[1] * e2[2] - e1[2] * e2[1];
+        axis[1] += e1[2] * e2[0] - e1[0] * e2[2];
+        axis[2] += e1[0] * e2[1] - e1[1] * e2[0];
+    }
+    length = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    if (length > 0.0f) {
+        for (k = 0; k < 3; ++k) {
+            axis[k] /= length;
+        }
+        for (i = 0; i < meshlet->n_indices; i += 3) {
+            const float* p0 = vertices[get_model_index(model, meshlet->first_index + i)].position;
+            const float* p1 = vertices[get_model_index(model, meshlet->first_index + i + 1)].position;
+            const float* p2 = vertices[get_model_index(model, meshlet->first_index + i + 2)].position;
+            const float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+            const float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+            const float n[3] = {
+                e1[1] * e2[2] - e1[2] * e2[1],
+                e1[2] * e2[0] - e1[0] * e2[2],
+                e1[0] * e2[1] - e1[1] * e2[0]
+            };
+            const float n_length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            if (n_length > 0.0f) {
+                const float d = (n[0] * axis[0] + n[1] * axis[1] + n[2] * axis[2]) / n_length;
+                if (d < min_dot) {
+                    min_dot = d;
+                }
+            }
+        }
+    }
+    else {
+        min_dot = -1.0f;
+    }
+    for (k = 0; k < 3; ++k) {
+        meshlet->cone_axis[k] = axis[k];
+    }
+    // A cutoff of 1 never culls.
+    meshlet->cone_cutoff = (min_dot <= MIN_CONE_DOT) ? 1.0f : sqrtf(1.0f - min_dot * min_dot);
+}
+
+/**
+ * Split an index range into meshlets. Returns the meshlet count (or -1).
+ */
+static int split_range(Model* model, Meshlet** meshlets, int* n_meshlets, int* capacity,
+                       int first_index, int n_indices, unsigned char* used)
+{
+    unsigned int vertices[MESHLET_MAX_VERTICES];
+    const int first_meshlet = *n_meshlets;
+    int n_vertices = 0;
+    int start = first_index;
+    int i, k;
+
+    for (i = first_index; i <= first_index + n_indices; i += 3) {
+        int n_new = 0;
+        const int is_end = (i == first_index + n_indices);
+
+        if (is_end == FALSE) {
+            const unsigned int a = get_model_index(model, i);
+            const unsigned int b = get_model_index(model, i + 1);
+            const unsigned int c = get_model_index(model, i + 2);
+            n_new = (used[a] == 0) + (used[b] == 0 && b != a) + (used[c] == 0 && c != a && c != b);
+        }
+        if (is_end || n_vertices + n_new > MESHLET_MAX_VERTICES
+            || (i - start) / 3 >= MESHLET_MAX_TRIANGLES) {
+            if (i > start) {
+                Meshlet* meshlet;
+                if (*n_meshlets == *capacity) {
+                    Meshlet* grown;
+                    *capacity = (*capacity > 0) ? *capacity * 2 : 64;
+                    grown = (Meshlet*)realloc(*meshlets, (size_t)*capacity * sizeof(Meshlet));
+                    if (grown == NULL) {
+                        return -1;
+                    }
+                    *meshlets = grown;
+                }
+                meshlet = &(*meshlets)[(*n_meshlets)++];
+                meshlet->first_index = start;
+                meshlet->n_indices = i - start;
+                calc_meshlet_bounds(meshlet, model);
+            }
+            for (k = 0; k < n_vertices; ++k) {
+                used[vertices[k]] = 0;
+            }
+            n_vertices = 0;
+            start = i;
+            if (is_end) {
+                break;
+            }
+        }
+        for (k = 0; k < 3; ++k) {
+            const unsigned int v = get_model_index(model, i + k);
+            if (used[v] == 0) {
+                used[v] = 1;
+                vertices[n_vertices++] = v;
+            }
+        }
+    }
+    return *n_meshlets - first_meshlet;
+}
+
+int build_meshlets(Model* model)
+{
+    Meshlet* meshlets = NULL;
+    unsigned char* used;
+    int n_meshlets = 0;
+    int capacity = 0;
+    int level, i;
+
+    if (model->n_lods == 0 || model->n_mesh_vertices == 0) {
+        return TRUE;
+    }
+    used = (unsigned char*)calloc((size_t)model->n_mesh_vertices, 1);
+    if (used == NULL) {
+        return FALSE;
+    }
+    // Meshlets don't cross submeshes, so they can be drawn with one material.
+    for (level = 0; level < model->n_lods; ++level) {
+        ModelLod* lod = &model->lods[level];
+        lod->first_meshlet = n_meshlets;
+        for (i = lod->first_submesh; i < lod->first_submesh + lod->n_submeshes; ++i) {
+            Submesh* submesh = &model->submeshes[i];
+            submesh->first_meshlet = n_meshlets;
+            if (split_range(model, &meshlets, &n_meshlets, &capacity,
+                            submesh->first_index, submesh->n_indices, used) < 0) {
+                free(meshlets);
+                free(used);
+                return FALSE;
+            }
+            submesh->n_meshlets = n_meshlets - submesh->first_meshlet;
+        }
+        lod->n_meshlets = n_meshlets - lod->first_meshlet;
+    }
+    free(used);
+
+    if (model->meshlets != NULL && is_model_array_mapped(model, model->meshlets) == FALSE) {
+        free(model->meshlets);
+    }
+    model->meshlets = meshlets;
+    model->n_meshlets = n_meshlets;
+    return TRUE;
+}
+
+void update_meshlet_bounds(Model* model)
+{
+    int i;
+
+    for (i = 0; i < model->n_meshlets; ++i) {
+        if (model->meshlets[i].n_indices > 0) {
+            calc_meshlet_bounds(&model->meshlets[i], model);
+        }
+    }
+}
+
+static void normalize_plane(float* plane)
+{
+    const float length = sqrtf(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+    int k;
+
+    if (length > 0.0f) {
+        for (k = 0; k < 4; ++k) {
+            plane[k] /= length;
+        }
+    }
+}
+
+void init_meshlet_culler(MeshletCuller* culler, const float modelview[16],
+                         const float projection[16], int cone_culling)
+{
+    const float* m = modelview;
+    float clip[16];
+    float det;
+    int row, col, k;
+
+    // clip = projection * modelview (column major)
+    for (col = 0; col < 4; ++col) {
+        for (row = 0; row < 4; ++row) {
+            float sum = 0.0f;
+            for (k = 0; k < 4; ++k) {
+                sum += projection[k * 4 + row] * modelview[col * 4 + k];
+            }
+            clip[col * 4 + row] = sum;
+        }
+    }
+    // Gribb-Hartmann plane extraction: row 3 +- row 0/1/2
+    for (k = 0; k < 3; ++k) {
+        for (col = 0; col < 4; ++col) {
+            culler->planes[k * 2][col] = clip[col * 4 + 3] + clip[col * 4 + k];
+            culler->planes[k * 2 + 1][col] = clip[col * 4 + 3] - clip[col * 4 + k];
+        }
+        normalize_plane(culler->planes[k * 2]);
+        normalize_plane(culler->planes[k * 2 + 1]);
+    }
+
+    // Camera (eye space origin) in model space: solve A * camera = -t.
+    det = m[0] * (m[5] * m[10] - m[9] * m[6])
+        - m[4] * (m[1] * m[10] - m[9] * m[2])
+        + m[8] * (m[1] * m[6] - m[5] * m[2]);
+    if (fabsf(det) > 1e-20f) {
+        const float tx = -m[12], ty = -m[13], tz = -m[14];
+        // Cramer's rule with the columns of A
+        culler->camera[0] = (tx * (m[5] * m[10] - m[9] * m[6])
+            - m[4] * (ty * m[10] - m[9] * tz)
+            + m[8] * (ty * m[6] - m[5] * tz)) / det;
+        culler->camera[1] = (m[0] * (ty * m[10] - m[9] * tz)
+            - tx * (m[1] * m[10] - m[9] * m[2])
+            + m[8] * (m[1] * tz - ty * m[2])) / det;
+        culler->camera[2] = (m[0] * (m[5] * tz - ty * m[6])
+            - m[4] * (m[1] * tz - ty * m[2])
+            + tx * (m[1] * m[6] - m[5] * m[2])) / det;
+        culler->cone_culling = cone_culling;
+    }
+    else {
+        culler->camera[0] = culler->camera[1] = culler->camera[2] = 0.0f;
+        culler->cone_culling = FALSE;
+    }
+}
+
+MeshletVisibility cull_meshlet(const MeshletCuller* culler, const Meshlet* meshlet)
+{
+    const float* c = meshlet->center;
+    int i;
+
+    for (i = 0; i < 6; ++i) {
+        const float* p = culler->planes[i];
+        if (p[0] * c[0] + p[1] * c[1] + p[2] * c[2] + p[3] < -meshlet->radius) {
+            return MESHLET_OUTSIDE_FRUSTUM;
+        }
+    }
+    if (culler->cone_culling && meshlet->cone_cutoff < 1.0f) {
+        // Every triangle faces away if the camera is inside the "back" cone
+        // (tested against the bounding sphere).
+        const float d[3] = {
+            c[0] - culler->camera[0],
+            c[1] - culler->camera[1],
+            c[2] - culler->camera[2]
+        };
+        const float distance = sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+        const float* a = meshlet->cone_axis;
+        if (d[0] * a[0] + d[1] * a[1] + d[2] * a[2] >= meshlet->cone_cutoff * distance + meshlet->radius) {
+            return MESHLET_BACKFACING;
+        }
+    }
+    return MESHLET_VISIBLE;
+}
+
+void reset_meshlet_stats(MeshletStats* stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
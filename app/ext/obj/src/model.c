@@ -1,6 +1,8 @@
 #include "model.h"
+#include "mapfile.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 void init_model(Model* model)
 {
@@ -12,6 +14,30 @@ void init_model(Model* model)
     model->texture_vertices = NULL;
     model->normals = NULL;
     model->triangles = NULL;
+    model->n_mesh_vertices = 0;
+    model->n_indices = 0;
+    model->index_size = 0;
+    model->vertex_attributes = MESH_HAS_NORMALS | MESH_HAS_UVS;
+    model->mesh_vertices = NULL;
+    model->indices = NULL;
+    model->n_lods = 0;
+    model->n_meshlets = 0;
+    model->meshlets = NULL;
+    model->n_submeshes = 0;
+    model->submeshes = NULL;
+    model->n_materials = 0;
+    model->materials = NULL;
+    model->material_library[0] = 0;
+    model->quantized_vertices = NULL;
+    model->quantization.normal_bits = 0;
+    model->gpu.vertex_buffer = 0;
+    model->gpu.index_buffer = 0;
+    model->gpu.vertex_array = 0;
+    model->gpu.normal_bits = 0;
+    model->gpu.display_lists = 0;
+    model->gpu.list_stride = 0;
+    model->gpu.list_normal_bits = 0;
+    model->mapping = NULL;
 }
 
 void allocate_model(Model* model)
@@ -26,7 +52,75 @@ void allocate_model(Model* model)
         (Triangle*)malloc(model->n_triangles * sizeof(Triangle));
 }
 
-void free_model(Model* model)
+unsigned int get_model_index(const Model* model, int i)
+{
+    if (model->index_size == 2) {
+        return ((const unsigned short*)model->indices)[i];
+    }
+    return ((const unsigned int*)model->indices)[i];
+}
+
+int is_model_array_mapped(const Model* model, const void* array)
+{
+    const MappedFile* file = (const MappedFile*)model->mapping;
+
+    return file != NULL && array != NULL
+        && (const char*)array >= file->data && (const char*)array < file->data + file->size;
+}
+
+/**
+ * Free the array unless it lives in the mapped file.
+ */
+static void free_model_array(const Model* model, void* array)
+{
+    if (array != NULL && is_model_array_mapped(model, array) == FALSE) {
+        free(array);
+    }
+}
+
+int find_model_material(const Model* model, const char* name)
+{
+    int i;
+
+    for (i = 0; i < model->n_materials; ++i) {
+        if (strcmp(model->materials[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return NO_MATERIAL;
+}
+
+int add_model_material(Model* model, const char* name)
+{
+    ObjMaterial* materials;
+    ObjMaterial* material;
+    int index;
+    int k;
+
+    index = find_model_material(model, name);
+    if (index != NO_MATERIAL) {
+        return index;
+    }
+    materials = (ObjMaterial*)realloc(model->materials, ((size_t)model->n_materials + 1) * sizeof(ObjMaterial));
+    if (materials == NULL) {
+        return NO_MATERIAL;
+    }
+    model->materials = materials;
+    material = &materials[model->n_materials];
+    memset(material, 0, sizeof(*material));
+    strncpy(material->name, name, MAX_MATERIAL_NAME - 1);
+    // MTL defaults: white diffuse, no specular, opaque.
+    for (k = 0; k < 3; ++k) {
+        material->ambient[k] = 0.2f;
+        material->diffuse[k] = 1.0f;
+        material->specular[k] = 0.0f;
+    }
+    material->shininess = 0.0f;
+    material->alpha = 1.0f;
+    return model->n_materials++;
+}
+
+void free_model_elements(Model* model)
 {
     if (model->vertices != NULL) {
         free(model->vertices);
@@ -40,5 +134,27 @@ void free_model(Model* model)
     if (model->triangles != NULL) {
         free(model->triangles);
     }
+    model->n_vertices = 0;
+    model->n_texture_vertices = 0;
+    model->n_normals = 0;
+    model->vertices = NULL;
+    model->texture_vertices = NULL;
+    model->normals = NULL;
+    model->triangles = NULL;
+}
+
+void free_model(Model* model)
+{
+    free_model_elements(model);
+    free_model_array(model, model->quantized_vertices);
+    free_model_array(model, model->mesh_vertices);
+    free_model_array(model, model->indices);
+    free_model_array(model, model->meshlets);
+    free_model_array(model, model->submeshes);
+    free_model_array(model, model->materials);
+    if (model->mapping != NULL) {
+        unmap_file((MappedFile*)model->mapping);
+        free(model->mapping);
+    }
     init_model(model);
 }
@@ -0,0 +1,364 @@
+#include "optimize.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Modelled LRU cache of the optimizer (Forsyth) */
+#define OPTIMIZER_CACHE_SIZE 32
+/* FIFO cache size for the reported statistics (typical of current GPUs) */
+#define REPORT_CACHE_SIZE 16
+#define LAST_TRIANGLE_SCORE 0.75f
+#define CACHE_DECAY_POWER 1.5f
+#define VALENCE_BOOST_SCALE 2.0f
+#define VALENCE_BOOST_POWER 0.5f
+#define MAX_VALENCE_SCORE 64
+
+static int optimization_state = -1;
+static float cache_position_scores[OPTIMIZER_CACHE_SIZE];
+static float valence_scores[MAX_VALENCE_SCORE];
+static int scores_initialized = FALSE;
+
+void set_mesh_optimization_enabled(int enabled)
+{
+    optimization_state = enabled ? TRUE : FALSE;
+}
+
+int is_mesh_optimization_enabled(void)
+{
+    if (optimization_state < 0) {
+        const char* env = getenv("OBJ_OPTIMIZE");
+        optimization_state = (env != NULL && strcmp(env, "0") == 0) ? FALSE : TRUE;
+    }
+    return optimization_state;
+}
+
+static void init_scores(void)
+{
+    int i;
+
+    for (i = 0; i < OPTIMIZER_CACHE_SIZE; ++i) {
+        if (i < 3) {
+            // The vertices of the last triangle get a fixed score, so the
+            // next triangle doesn't simply reuse the same edge over and over.
+            cache_position_scores[i] = LAST_TRIANGLE_SCORE;
+        }
+        else {
+            const float scale = 1.0f / (float)(OPTIMIZER_CACHE_SIZE - 3);
+            cache_position_scores[i] = powf(1.0f - (float)(i - 3) * scale, CACHE_DECAY_POWER);
+        }
+    }
+    for (i = 1; i < MAX_VALENCE_SCORE; ++i) {
+        // Favour vertices with few remaining triangles, to finish them off.
+        valence_scores[i] = VALENCE_BOOST_SCALE * powf((float)i, -VALENCE_BOOST_POWER);
+    }
+    valence_scores[0] = 0.0f;
+    scores_initialized = TRUE;
+}
+
+static float vertex_score(int cache_position, int remaining_valence)
+{
+    float score;
+
+    if (remaining_valence == 0) {
+        return -1.0f;
+    }
+    score = (cache_position >= 0) ? cache_position_scores[cache_position] : 0.0f;
+    if (remaining_valence < MAX_VALENCE_SCORE) {
+        score += valence_scores[remaining_valence];
+    }
+    else {
+        score += VALENCE_BOOST_SCALE * powf((float)remaining_valence, -VALENCE_BOOST_POWER);
+    }
+    return score;
+}
+
+static unsigned int* copy_indices_32(const Model* model)
+{
+    unsigned int* indices = (unsigned int*)malloc(((size_t)model->n_indices + 1) * sizeof(unsigned int));
+    int i;
+
+    if (indices == NULL) {
+        return NULL;
+    }
+    for (i = 0; i < model->n_indices; ++i) {
+        indices[i] = get_model_index(model, i);
+    }
+    return indices;
+}
+
+static void store_indices_32(Model* model, const unsigned int* indices)
+{
+    int i;
+
+    if (model->index_size == 2) {
+        unsigned short* target = (unsigned short*)model->indices;
+        for (i = 0; i < model->n_indices; ++i) {
+            target[i] = (unsigned short)indices[i];
+        }
+    }
+    else {
+        memcpy(model->indices, indices, (size_t)model->n_indices * sizeof(unsigned int));
+    }
+}
+
+VertexCacheStats analyze_vertex_cache(const Model* model, int cache_size)
+{
+    const int n_indices = (model->n_lods > 0) ? model->lods[0].n_indices : model->n_indices;
+    VertexCacheStats stats = { 0.0f, 0.0f };
+    unsigned int* timestamps;
+    unsigned int time;
+    int misses = 0;
+    int i;
+
+    if (n_indices == 0 || model->n_mesh_vertices == 0) {
+        return stats;
+    }
+    timestamps = (unsigned int*)calloc((size_t)model->n_mesh_vertices, sizeof(unsigned int));
+    if (timestamps == NULL) {
+        return stats;
+    }
+    // FIFO: a vertex is in the cache if it was inserted less than cache_size misses ago.
+    time = (unsigned int)cache_size + 1;
+    for (i = 0; i < n_indices; ++i) {
+        const unsigned int v = get_model_index(model, i);
+        if (time - timestamps[v] > (unsigned int)cache_size) {
+            timestamps[v] = time++;
+            ++misses;
+        }
+    }
+    free(timestamps);
+    stats.acmr = (float)misses / (float)(n_indices / 3);
+    stats.atvr = (float)misses / (float)model->n_mesh_vertices;
+    return stats;
+}
+
+static int optimize_triangle_order(unsigned int* indices, int n_indices, int n_vertices)
+{
+    const int n_triangles = n_indices / 3;
+    unsigned int* output;
+    int* offsets;
+    int* remaining;
+    int* adjacency;
+    int* cache_positions;
+    float* vertex_scores;
+    float* triangle_scores;
+    char* emitted;
+    int cache[OPTIMIZER_CACHE_SIZE + 3];
+    int new_cache[OPTIMIZER_CACHE_SIZE + 3];
+    int cache_count = 0;
+    int best_triangle;
+    int next_unemitted = 0;
+    int t, i, k;
+
+    if (n_triangles == 0) {
+        return TRUE;
+    }
+    if (!scores_initialized) {
+        init_scores();
+    }
+
+    output = (unsigned int*)malloc((size_t)n_indices * sizeof(unsigned int));
+    offsets = (int*)calloc((size_t)n_vertices + 1, sizeof(int));
+    remaining = (int*)calloc((size_t)n_vertices, sizeof(int));
+    adjacency = (int*)malloc((size_t)n_indices * sizeof(int));
+    cache_positions = (int*)malloc((size_t)n_vertices * sizeof(int));
+    vertex_scores = (float*)malloc((size_t)n_vertices * sizeof(float));
+    triangle_scores = (float*)malloc((size_t)n_triangles * sizeof(float));
+    emitted = (char*)calloc((size_t)n_triangles, 1);
+    if (output == NULL || offsets == NULL || remaining == NULL || adjacency == NULL
+        || cache_positions == NULL || vertex_scores == NULL || triangle_scores == NULL || emitted == NULL) {
+        free(output); free(offsets); free(remaining); free(adjacency);
+        free(cache_positions); free(vertex_scores); free(triangle_scores); free(emitted);
+        return FALSE;
+    }
+
+    // Vertex -> triangle adjacency (counting sort).
+    for (i = 0; i < n_indices; ++i) {
+        ++remaining[indices[i]];
+    }
+    for (i = 0; i < n_vertices; ++i) {
+        offsets[i + 1] = offsets[i] + remaining[i];
+        remaining[i] = 0;
+    }
+    for (i = 0; i < n_indices; ++i) {
+        const unsigned int v = indices[i];
+        adjacency[offsets[v] + remaining[v]++] = i / 3;
+    }
+
+    for (i = 0; i < n_vertices; ++i) {
+        cache_positions[i] = -1;
+        vertex_scores[i] = vertex_score(-1, remaining[i]);
+    }
+    best_triangle = 0;
+    for (t = 0; t < n_triangles; ++t) {
+        triangle_scores[t] = vertex_scores[indices[t * 3]]
+            + vertex_scores[indices[t * 3 + 1]]
+            + vertex_scores[indices[t * 3 + 2]];
+        if (triangle_scores[t] > triangle_scores[best_triangle]) {
+            best_triangle = t;
+        }
+    }
+
+    for (t = 0; t < n_triangles; ++t) {
+        int new_count = 0;
+        float best_score = -1.0f;
+
+        if (best_triangle < 0) {
+            // Nothing adjacent to the cache is left: continue with the next unused triangle.
+            while (emitted[next_unemitted]) {
+                ++next_unemitted;
+            }
+            best_triangle = next_unemitted;
+        }
+
+        emitted[best_triangle] = 1;
+        for (k = 0; k < 3; ++k) {
+            const unsigned int v = indices[best_triangle * 3 + k];
+            int* list = &adjacency[offsets[v]];
+            int j;
+
+            output[t * 3 + k] = v;
+            // Remove the triangle from the remaining triangles of the vertex.
+            for (j = 0; j < remaining[v]; ++j) {
+                if (list[j] == best_triangle) {
+                    list[j] = list[remaining[v] - 1];
+                    break;
+                }
+            }
+            --remaining[v];
+            new_cache[new_count++] = (int)v;
+        }
+
+        // LRU update: the new triangle's vertices go to the front.
+        for (i = 0; i < cache_count; ++i) {
+            const int v = cache[i];
+            if (v != new_cache[0] && v != new_cache[1] && v != new_cache[2]) {
+                new_cache[new_count++] = v;
+            }
+        }
+        if (new_count > OPTIMIZER_CACHE_SIZE + 3) {
+            new_count = OPTIMIZER_CACHE_SIZE + 3;
+        }
+
+        for (i = 0; i < new_count; ++i) {
+            const int v = new_cache[i];
+            cache_positions[v] = (i < OPTIMIZER_CACHE_SIZE) ? i : -1;
+            vertex_scores[v] = vertex_score(cache_positions[v], remaining[v]);
+        }
+
+        // Rescore the triangles touched by the cache and pick the best one.
+        best_triangle = -1;
+        for (i = 0; i < new_count; ++i) {
+            const int v = new_cache[i];
+            const int* list = &adjacency[offsets[v]];
+            int j;
+            for (j = 0; j < remaining[v]; ++j) {
+                const int tri = list[j];
+                const float score = vertex_scores[indices[tri * 3]]
+                    + vertex_scores[indices[tri * 3 + 1]]
+                    + vertex_scores[indices[tri * 3 + 2]];
+                triangle_scores[tri] = score;
+                if (score > best_score) {
+                    best_score = score;
+                    best_triangle = tri;
+                }
+            }
+        }
+
+        cache_count = (new_count < OPTIMIZER_CACHE_SIZE) ? new_count : OPTIMIZER_CACHE_SIZE;
+        memcpy(cache, new_cache, (size_t)cache_count * sizeof(int));
+    }
+
+    memcpy(indices, output, (size_t)n_indices * sizeof(unsigned int));
+
+    free(output); free(offsets); free(remaining); free(adjacency);
+    free(cache_positions); free(vertex_scores); free(triangle_scores); free(emitted);
+    return TRUE;
+}
+
+int optimize_vertex_cache(Model* model)
+{
+    unsigned int* indices;
+    int success = TRUE;
+    int i;
+
+    if (model->n_indices == 0) {
+        return TRUE;
+    }
+    indices = copy_indices_32(model);
+    if (indices == NULL) {
+        return FALSE;
+    }
+    // Each submesh of each level of detail is drawn on its own, so each is optimized on its own.
+    for (i = 0; i < model->n_submeshes && success; ++i) {
+        success = optimize_triangle_order(indices + model->submeshes[i].first_index,
+                                          model->submeshes[i].n_indices, model->n_mesh_vertices);
+    }
+    if (model->n_submeshes == 0) {
+        success = optimize_triangle_order(indices, model->n_indices, model->n_mesh_vertices);
+    }
+    if (success) {
+        store_indices_32(model, indices);
+    }
+    free(indices);
+    return success;
+}
+
+int optimize_vertex_fetch(Model* model)
+{
+    unsigned int* indices;
+    int* remap;
+    MeshVertex* vertices;
+    int n_used = 0;
+    int i;
+
+    if (model->n_indices == 0) {
+        return TRUE;
+    }
+    indices = copy_indices_32(model);
+    remap = (int*)malloc((size_t)model->n_mesh_vertices * sizeof(int));
+    vertices = (MeshVertex*)malloc((size_t)model->n_mesh_vertices * sizeof(MeshVertex));
+    if (indices == NULL || remap == NULL || vertices == NULL) {
+        free(indices);
+        free(remap);
+        free(vertices);
+        return FALSE;
+    }
+    for (i = 0; i < model->n_mesh_vertices; ++i) {
+        remap[i] = -1;
+    }
+    for (i = 0; i < model->n_indices; ++i) {
+        const unsigned int v = indices[i];
+        if (remap[v] < 0) {
+            remap[v] = n_used;
+            vertices[n_used] = model->mesh_vertices[v];
+            ++n_used;
+        }
+        indices[i] = (unsigned int)remap[v];
+    }
+    memcpy(model->mesh_vertices, vertices, (size_t)n_used * sizeof(MeshVertex));
+    model->n_mesh_vertices = n_used;
+    store_indices_32(model, indices);
+
+    free(indices);
+    free(remap);
+    free(vertices);
+    return TRUE;
+}
+
+int optimize_model(Model* model)
+{
+    const VertexCacheStats before = analyze_vertex_cache(model, REPORT_CACHE_SIZE);
+    VertexCacheStats after;
+
+    if (optimize_vertex_cache(model) == FALSE || optimize_vertex_fetch(model) == FALSE) {
+        printf("Unable to optimize the model!\n");
+        return FALSE;
+    }
+    after = analyze_vertex_cache(model, REPORT_CACHE_SIZE);
+    printf("Vertex cache (FIFO %d): ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", REPORT_CACHE_SIZE,
+           before.acmr, after.acmr, before.atvr, after.atvr);
+    return TRUE;
+}
@@ -0,0 +1,175 @@
+#include "parse.h"
+
+#include <limits.h> /* INT_MAX */
+#include <stdlib.h> /* strtod, malloc */
+#include <string.h> /* memchr, memcpy */
+
+#define MAX_EXACT_EXPONENT 22
+#define MAX_EXACT_MANTISSA 9007199254740992ULL /* 2^53 */
+#define MAX_NUMBER_LENGTH 64
+/* Larger exponents always overflow or underflow: strtod handles them */
+#define MAX_FAST_EXPONENT_VALUE 100000
+
+static const double exact_powers_of_ten[MAX_EXACT_EXPONENT + 1] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static int is_digit(char c)
+{
+    return (unsigned)(c - '0') < 10u;
+}
+
+const char* skip_spaces(const char* p, const char* end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) {
+        ++p;
+    }
+    return p;
+}
+
+const char* skip_line(const char* p, const char* end)
+{
+    const char* newline;
+
+    if (p >= end) {
+        return end;
+    }
+    newline = (const char*)memchr(p, '\n', (size_t)(end - p));
+    return (newline != NULL) ? newline + 1 : end;
+}
+
+const char* parse_int(const char* p, const char* end, int* value)
+{
+    int negative = 0;
+    int result = 0;
+    const char* digits;
+
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        ++p;
+    }
+    digits = p;
+    while (p < end && is_digit(*p)) {
+        const int digit = *p - '0';
+        if (result > (INT_MAX - digit) / 10) {
+            return NULL;
+        }
+        result = result * 10 + digit;
+        ++p;
+    }
+    if (p == digits) {
+        return NULL;
+    }
+    *value = negative ? -result : result;
+    return p;
+}
+
+static int parse_double_slow(const char* start, const char* stop, double* value)
+{
+    // Rare cases (very long mantissas, huge exponents) go through strtod on a
+    // NUL-terminated copy, on the heap when it is long (a cut copy would lose the
+    // exponent). OBJ numbers always use '.' as decimal separator.
+    char buffer[MAX_NUMBER_LENGTH];
+    const size_t length = (size_t)(stop - start);
+    char* number = buffer;
+
+    if (length >= sizeof(buffer)) {
+        number = (char*)malloc(length + 1);
+        if (number == NULL) {
+            return 0;
+        }
+    }
+    memcpy(number, start, length);
+    number[length] = 0;
+    *value = strtod(number, NULL);
+    if (number != buffer) {
+        free(number);
+    }
+    return 1;
+}
+
+const char* parse_double(const char* p, const char* end, double* value)
+{
+    const char* start = p;
+    int negative = 0;
+    unsigned long long mantissa = 0;
+    int n_digits = 0;
+    int exponent = 0;
+    int is_slow = 0;
+    const char* digits;
+    double result;
+
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        ++p;
+    }
+    digits = p;
+    while (p < end && is_digit(*p)) {
+        if (n_digits < 19) {
+            mantissa = mantissa * 10 + (unsigned)(*p - '0');
+            n_digits += (mantissa != 0);
+        } else {
+            ++exponent;
+            ++n_digits;
+        }
+        ++p;
+    }
+    if (p < end && *p == '.') {
+        ++p;
+        if (p == digits + 1 && (p >= end || !is_digit(*p))) {
+            return NULL;
+        }
+        while (p < end && is_digit(*p)) {
+            if (n_digits < 19) {
+                mantissa = mantissa * 10 + (unsigned)(*p - '0');
+                n_digits += (mantissa != 0);
+                --exponent;
+            } else {
+                ++n_digits;
+            }
+            ++p;
+        }
+    }
+    if (p == digits) {
+        return NULL;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char* sign = p + 1;
+        const char* after;
+        int exponent_value = 0;
+
+        if (sign < end && (*sign == '-' || *sign == '+')) {
+            ++sign;
+        }
+        after = sign;
+        while (after < end && is_digit(*after)) {
+            ++after;
+        }
+        if (after != sign) {
+            // An exponent too large for an int is still part of the number.
+            if (parse_int(p + 1, end, &exponent_value) == NULL
+                || exponent_value > MAX_FAST_EXPONENT_VALUE || exponent_value < -MAX_FAST_EXPONENT_VALUE) {
+                is_slow = 1;
+            } else {
+                exponent += exponent_value;
+            }
+            p = after;
+        }
+    }
+
+    if (is_slow || n_digits > 19 || mantissa > MAX_EXACT_MANTISSA
+        || exponent < -MAX_EXACT_EXPONENT || exponent > MAX_EXACT_EXPONENT) {
+        return parse_double_slow(start, p, value) ? p : NULL;
+    }
+
+    // Clinger's fast path: both operands are exact doubles, so one rounding.
+    result = (double)mantissa;
+    if (exponent < 0) {
+        result /= exact_powers_of_ten[-exponent];
+    } else {
+        result *= exact_powers_of_ten[exponent];
+    }
+    *value = negative ? -result : result;
+    return p;
+}
@@ -0,0 +1,127 @@
+#include "platform.h"
+
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+typedef struct TaskSlot
+{
+    ParallelTask task;
+    void* context;
+    int task_index;
+} TaskSlot;
+
+#ifdef _WIN32
+
+static DWORD WINAPI run_task_slot(LPVOID parameter)
+{
+    TaskSlot* slot = (TaskSlot*)parameter;
+    slot->task(slot->context, slot->task_index);
+    return 0;
+}
+
+int get_cpu_count(void)
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (info.dwNumberOfProcessors > 0) ? (int)info.dwNumberOfProcessors : 1;
+}
+
+void run_parallel(ParallelTask task, void* context, int n_tasks)
+{
+    TaskSlot slots[MAX_PARALLEL_TASKS];
+    HANDLE threads[MAX_PARALLEL_TASKS];
+    int i;
+
+    if (n_tasks > MAX_PARALLEL_TASKS) {
+        n_tasks = MAX_PARALLEL_TASKS;
+    }
+    for (i = 1; i < n_tasks; ++i) {
+        slots[i].task = task;
+        slots[i].context = context;
+        slots[i].task_index = i;
+        threads[i] = CreateThread(NULL, 0, run_task_slot, &slots[i], 0, NULL);
+        if (threads[i] == NULL) {
+            // Couldn't start a thread: run the task here instead.
+            task(context, i);
+        }
+    }
+    if (n_tasks > 0) {
+        task(context, 0);
+    }
+    for (i = 1; i < n_tasks; ++i) {
+        if (threads[i] != NULL) {
+            WaitForSingleObject(threads[i], INFINITE);
+            CloseHandle(threads[i]);
+        }
+    }
+}
+
+double get_time_seconds(void)
+{
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+}
+
+#else
+
+static void* run_task_slot(void* parameter)
+{
+    TaskSlot* slot = (TaskSlot*)parameter;
+    slot->task(slot->context, slot->task_index);
+    return NULL;
+}
+
+int get_cpu_count(void)
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return (count > 0) ? (int)count : 1;
+}
+
+void run_parallel(ParallelTask task, void* context, int n_tasks)
+{
+    TaskSlot slots[MAX_PARALLEL_TASKS];
+    pthread_t threads[MAX_PARALLEL_TASKS];
+    int started[MAX_PARALLEL_TASKS];
+    int i;
+
+    if (n_tasks > MAX_PARALLEL_TASKS) {
+        n_tasks = MAX_PARALLEL_TASKS;
+    }
+    for (i = 1; i < n_tasks; ++i) {
+        slots[i].task = task;
+        slots[i].context = context;
+        slots[i].task_index = i;
+        started[i] = (pthread_create(&threads[i], NULL, run_task_slot, &slots[i]) == 0);
+        if (!started[i]) {
+            // Couldn't start a thread: run the task here instead.
+            task(context, i);
+        }
+    }
+    if (n_tasks > 0) {
+        task(context, 0);
+    }
+    for (i = 1; i < n_tasks; ++i) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+}
+
+double get_time_seconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
+
+#endif
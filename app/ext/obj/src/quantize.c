@@ -0,0 +1,251 @@
+#include "quantize.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+/* Largest value of the 16 bit signed normalized components */
+#define SNORM16_MAX 32767.0f
+#define SNORM8_MAX 127.0f
+
+/* Smallest half extent, so flat models still have an invertible transformation */
+#define MIN_HALF_EXTENT 1e-6f
+
+static short quantize_snorm16(float value)
+{
+    if (value > 1.0f) {
+        value = 1.0f;
+    }
+    else if (value < -1.0f) {
+        value = -1.0f;
+    }
+    return (short)lrintf(value * SNORM16_MAX);
+}
+
+static signed char quantize_snorm8(float value)
+{
+    if (value > 1.0f) {
+        value = 1.0f;
+    }
+    else if (value < -1.0f) {
+        value = -1.0f;
+    }
+    return (signed char)lrintf(value * SNORM8_MAX);
+}
+
+static float sign_not_zero(float value)
+{
+    return (value >= 0.0f) ? 1.0f : -1.0f;
+}
+
+/**
+ * Project the normal onto the octahedron and unfold the lower half.
+ */
+static void encode_octahedral_normal(const float normal[3], float* x, float* y)
+{
+    const float length = fabsf(normal[0]) + fabsf(normal[1]) + fabsf(normal[2]);
+    float px, py;
+
+    if (length == 0.0f) {
+        *x = 0.0f;
+        *y = 0.0f;
+        return;
+    }
+    px = normal[0] / length;
+    py = normal[1] / length;
+    if (normal[2] < 0.0f) {
+        const float fx = (1.0f - fabsf(py)) * sign_not_zero(px);
+        const float fy = (1.0f - fabsf(px)) * sign_not_zero(py);
+        px = fx;
+        py = fy;
+    }
+    *x = px;
+    *y = py;
+}
+
+void decode_octahedral_normal(float x, float y, float normal[3])
+{
+    const float z = 1.0f - fabsf(x) - fabsf(y);
+    const float t = (z < 0.0f) ? -z : 0.0f;
+    float length;
+
+    x += (x >= 0.0f) ? -t : t;
+    y += (y >= 0.0f) ? -t : t;
+    length = sqrtf(x * x + y * y + z * z);
+    normal[0] = x / length;
+    normal[1] = y / length;
+    normal[2] = z / length;
+}
+
+/**
+ * Offset and scale mapping the [min, max] range of each component to [-1, 1] * max_value.
+ */
+static void calc_range_mapping(const float* min, const float* max, int n_components,
+                               float* offset, float* scale)
+{
+    int k;
+
+    for (k = 0; k < n_components; ++k) {
+        float half_extent = 0.5f * (max[k] - min[k]);
+        if (half_extent < MIN_HALF_EXTENT) {
+            half_extent = MIN_HALF_EXTENT;
+        }
+        offset[k] = 0.5f * (min[k] + max[k]);
+        scale[k] = half_extent / SNORM16_MAX;
+    }
+}
+
+static void calc_quantization(const Model* model, VertexQuantization* quantization)
+{
+    const MeshVertex* vertices = model->mesh_vertices;
+    float min_position[3], max_position[3];
+    float min_uv[2], max_uv[2];
+    int i, k;
+
+    for (k = 0; k < 3; ++k) {
+        min_position[k] = vertices[0].position[k];
+        max_position[k] = vertices[0].position[k];
+    }
+    for (k = 0; k < 2; ++k) {
+        min_uv[k] = vertices[0].uv[k];
+        max_uv[k] = vertices[0].uv[k];
+    }
+    for (i = 1; i < model->n_mesh_vertices; ++i) {
+        for (k = 0; k < 3; ++k) {
+            min_position[k] = fminf(min_position[k], vertices[i].position[k]);
+            max_position[k] = fmaxf(max_position[k], vertices[i].position[k]);
+        }
+        for (k = 0; k < 2; ++k) {
+            min_uv[k] = fminf(min_uv[k], vertices[i].uv[k]);
+            max_uv[k] = fmaxf(max_uv[k], vertices[i].uv[k]);
+        }
+    }
+    calc_range_mapping(min_position, max_position, 3,
+                       quantization->position_offset, quantization->position_scale);
+    calc_range_mapping(min_uv, max_uv, 2, quantization->uv_offset, quantization->uv_scale);
+}
+
+static void quantize_position_and_uv(const MeshVertex* vertex, const VertexQuantization* quantization,
+                                     short position[3], short uv[2])
+{
+    const float* offset = quantization->position_offset;
+    const float* scale = quantization->position_scale;
+    int k;
+
+    for (k = 0; k < 3; ++k) {
+        position[k] = quantize_snorm16((vertex->position[k] - offset[k]) / (scale[k] * SNORM16_MAX));
+    }
+    for (k = 0; k < 2; ++k) {
+        uv[k] = quantize_snorm16((vertex->uv[k] - quantization->uv_offset[k])
+                                 / (quantization->uv_scale[k] * SNORM16_MAX));
+    }
+}
+
+int quantize_model(Model* model, int normal_bits)
+{
+    VertexQuantization quantization;
+    void* quantized;
+    float x, y;
+    int i;
+
+    if (normal_bits != 8 && normal_bits != 16) {
+        return FALSE;
+    }
+    if (model->n_mesh_vertices == 0) {
+        return TRUE;
+    }
+    calc_quantization(model, &quantization);
+    quantization.normal_bits = normal_bits;
+
+    if (normal_bits == 8) {
+        QuantizedVertex8* vertices =
+            (QuantizedVertex8*)malloc((size_t)model->n_mesh_vertices * sizeof(QuantizedVertex8));
+        if (vertices == NULL) {
+            return FALSE;
+        }
+        for (i = 0; i < model->n_mesh_vertices; ++i) {
+            quantize_position_and_uv(&model->mesh_vertices[i], &quantization,
+                                     vertices[i].position, vertices[i].uv);
+            encode_octahedral_normal(model->mesh_vertices[i].normal, &x, &y);
+            vertices[i].normal[0] = quantize_snorm8(x);
+            vertices[i].normal[1] = quantize_snorm8(y);
+        }
+        quantized = vertices;
+    }
+    else {
+        QuantizedVertex16* vertices =
+            (QuantizedVertex16*)malloc((size_t)model->n_mesh_vertices * sizeof(QuantizedVertex16));
+        if (vertices == NULL) {
+            return FALSE;
+        }
+        for (i = 0; i < model->n_mesh_vertices; ++i) {
+            quantize_position_and_uv(&model->mesh_vertices[i], &quantization,
+                                     vertices[i].position, vertices[i].uv);
+            encode_octahedral_normal(model->mesh_vertices[i].normal, &x, &y);
+            vertices[i].normal[0] = quantize_snorm16(x);
+            vertices[i].normal[1] = quantize_snorm16(y);
+            vertices[i].reserved = 0;
+        }
+        quantized = vertices;
+    }
+
+    free_quantized_vertices(model);
+    model->quantized_vertices = quantized;
+    model->quantization = quantization;
+    return TRUE;
+}
+
+void free_quantized_vertices(Model* model)
+{
+    if (model->quantized_vertices != NULL) {
+        free(model->quantized_vertices);
+    }
+    model->quantized_vertices = NULL;
+    model->quantization.normal_bits = 0;
+}
+
+size_t get_vertex_data_size(const Model* model)
+{
+    size_t vertex_size = sizeof(MeshVertex);
+
+    if (model->quantized_vertices != NULL) {
+        vertex_size = (model->quantization.normal_bits == 8)
+            ? sizeof(QuantizedVertex8) : sizeof(QuantizedVertex16);
+    }
+    return (size_t)model->n_mesh_vertices * vertex_size;
+}
+
+void get_dequantization_matrix(const Model* model, float matrix[16])
+{
+    const VertexQuantization* quantization = &model->quantization;
+    int i;
+
+    for (i = 0; i < 16; ++i) {
+        matrix[i] = 0.0f;
+    }
+    matrix[15] = 1.0f;
+    if (model->quantized_vertices == NULL) {
+        matrix[0] = matrix[5] = matrix[10] = 1.0f;
+        return;
+    }
+    for (i = 0; i < 3; ++i) {
+        matrix[i * 5] = quantization->position_scale[i];
+        matrix[12 + i] = quantization->position_offset[i];
+    }
+}
+
+void remove_dequantization(const Model* model, float modelview[16])
+{
+    const VertexQuantization* quantization = &model->quantization;
+    int i, k;
+
+    if (model->quantized_vertices == NULL) {
+        return;
+    }
+    // M * D^-1 where D^-1 scales by 1 / scale after translating by -offset.
+    for (k = 0; k < 4; ++k) {
+        for (i = 0; i < 3; ++i) {
+            modelview[i * 4 + k] /= quantization->position_scale[i];
+            modelview[12 + k] -= modelview[i * 4 + k] * quantization->position_offset[i];
+        }
+    }
+}
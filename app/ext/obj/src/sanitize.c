@@ -0,0 +1,78 @@
+#include "sanitize.h"
+
+#include <string.h>
+
+static int is_valid_index(int index, int count)
+{
+    return index > 0 && index <= count;
+}
+
+static int has_zero_area(const Model* model, const Triangle* triangle)
+{
+    const Vertex* a = &model->vertices[triangle->points[0].vertex_index];
+    const Vertex* b = &model->vertices[triangle->points[1].vertex_index];
+    const Vertex* c = &model->vertices[triangle->points[2].vertex_index];
+    const double e1[3] = { b->x - a->x, b->y - a->y, b->z - a->z };
+    const double e2[3] = { c->x - a->x, c->y - a->y, c->z - a->z };
+    const double nx = e1[1] * e2[2] - e1[2] * e2[1];
+    const double ny = e1[2] * e2[0] - e1[0] * e2[2];
+    const double nz = e1[0] * e2[1] - e1[1] * e2[0];
+
+    return nx == 0.0 && ny == 0.0 && nz == 0.0;
+}
+
+int sanitize_model(Model* model, SanitizeStats* stats)
+{
+    int has_textures = FALSE;
+    int has_normals = FALSE;
+    int n_kept = 0;
+    int i, k;
+
+    memset(stats, 0, sizeof(*stats));
+    for (i = 0; i < model->n_triangles; ++i) {
+        Triangle triangle = model->triangles[i];
+        const FacePoint* points = triangle.points;
+
+        if (is_valid_index(points[0].vertex_index, model->n_vertices) == FALSE
+            || is_valid_index(points[1].vertex_index, model->n_vertices) == FALSE
+            || is_valid_index(points[2].vertex_index, model->n_vertices) == FALSE) {
+            ++stats->n_out_of_range;
+            continue;
+        }
+        if (points[0].vertex_index == points[1].vertex_index
+            || points[1].vertex_index == points[2].vertex_index
+            || points[2].vertex_index == points[0].vertex_index
+            || has_zero_area(model, &triangle)) {
+            ++stats->n_degenerate;
+            continue;
+        }
+        for (k = 0; k < 3; ++k) {
+            FacePoint* point = &triangle.points[k];
+            if (is_valid_index(point->texture_index, model->n_texture_vertices)) {
+                has_textures = TRUE;
+            }
+            else {
+                point->texture_index = 0;
+                ++stats->n_missing_textures;
+            }
+            if (is_valid_index(point->normal_index, model->n_normals)) {
+                has_normals = TRUE;
+            }
+            else {
+                point->normal_index = 0;
+                ++stats->n_missing_normals;
+            }
+        }
+        model->triangles[n_kept++] = triangle;
+    }
+    model->n_triangles = n_kept;
+
+    model->vertex_attributes = 0;
+    if (has_normals) {
+        model->vertex_attributes |= MESH_HAS_NORMALS;
+    }
+    if (has_textures) {
+        model->vertex_attributes |= MESH_HAS_UVS;
+    }
+    return n_kept > 0 || stats->n_out_of_range + stats->n_degenerate == 0;
+}
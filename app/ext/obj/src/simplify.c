@@ -0,0 +1,574 @@
+#include "simplify.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Models below this triangle count get no further levels */
+#define MIN_LOD_TRIANGLES 512
+/* A level is only kept if it has at most this fraction of the previous triangles */
+#define LOD_MIN_REDUCTION 0.8f
+/* Maximal geometric error of a level relative to the model radius */
+#define LOD_MAX_RELATIVE_ERROR 0.05f
+#define MAX_SIMPLIFY_PASSES 64
+
+static int lod_generation_state = -1;
+
+/**
+ * Symmetric 4x4 quadric error matrix with the accumulated area weight
+ */
+typedef struct Quadric
+{
+    double a00, a01, a02, a03;
+    double a11, a12, a13;
+    double a22, a23;
+    double a33;
+    double weight;
+} Quadric;
+
+/**
+ * Candidate half edge collapse: the vertex "from" moves onto the vertex "to"
+ */
+typedef struct Collapse
+{
+    float cost;
+    unsigned int from;
+    unsigned int to;
+} Collapse;
+
+void set_lod_generation_enabled(int enabled)
+{
+    lod_generation_state = enabled ? TRUE : FALSE;
+}
+
+int is_lod_generation_enabled(void)
+{
+    if (lod_generation_state < 0) {
+        const char* env = getenv("OBJ_LODS");
+        lod_generation_state = (env != NULL && strcmp(env, "0") == 0) ? FALSE : TRUE;
+    }
+    return lod_generation_state;
+}
+
+static void add_plane_quadric(Quadric* q, double a, double b, double c, double d, double weight)
+{
+    q->a00 += weight * a * a;
+    q->a01 += weight * a * b;
+    q->a02 += weight * a * c;
+    q->a03 += weight * a * d;
+    q->a11 += weight * b * b;
+    q->a12 += weight * b * c;
+    q->a13 += weight * b * d;
+    q->a22 += weight * c * c;
+    q->a23 += weight * c * d;
+    q->a33 += weight * d * d;
+    q->weight += weight;
+}
+
+static void add_quadric(Quadric* q, const Quadric* other)
+{
+    q->a00 += other->a00;
+    q->a01 += other->a01;
+    q->a02 += other->a02;
+    q->a03 += other->a03;
+    q->a11 += other->a11;
+    q->a12 += other->a12;
+    q->a13 += other->a13;
+    q->a22 += other->a22;
+    q->a23 += other->a23;
+    q->a33 += other->a33;
+    q->weight += other->weight;
+}
+
+/**
+ * Area weighted mean squared distance of the point from the planes of the quadric.
+ */
+static double quadric_error(const Quadric* q, const float* p)
+{
+    const double x = p[0];
+    const double y = p[1];
+    const double z = p[2];
+    double error;
+
+    if (q->weight <= 0.0) {
+        return 0.0;
+    }
+    error = q->a00 * x * x + q->a11 * y * y + q->a22 * z * z
+        + 2.0 * (q->a01 * x * y + q->a02 * x * z + q->a12 * y * z)
+        + 2.0 * (q->a03 * x + q->a13 * y + q->a23 * z)
+        + q->a33;
+    return (error > 0.0) ? error / q->weight : 0.0;
+}
+
+static void triangle_normal(const float* p0, const float* p1, const float* p2, double* n)
+{
+    const double e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+    const double e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+
+    n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+static unsigned int hash_position(const float* p)
+{
+    // Adding zero turns -0 into +0, so equal positions hash equally.
+    const float position[3] = { p[0] + 0.0f, p[1] + 0.0f, p[2] + 0.0f };
+    uint32_t bits[3];
+
+    memcpy(bits, position, sizeof(bits));
+    return (bits[0] * 73856093U) ^ (bits[1] * 19349663U) ^ (bits[2] * 83492791U);
+}
+
+static uint64_t hash_edge_key(uint64_t key)
+{
+    key ^= key >> 33;
+    key *= 0xFF51AFD7ED558CCDULL;
+    key ^= key >> 33;
+    return key;
+}
+
+/**
+ * Lock the vertices that can't move without tearing the surface: the ones
+ * on borders and non-manifold edges, and the ones sharing the position with
+ * another vertex (normal and texture seams of the welded mesh).
+ */
+static int find_locked_vertices(char* locked, const unsigned int* indices, int n_indices,
+                                const MeshVertex* vertices, int n_vertices)
+{
+    int table_size = 16;
+    unsigned int mask;
+    int* position_table;
+    int* wedge_counts;
+    uint64_t* edge_keys;
+    int* edge_counts;
+    int i;
+
+    while (table_size < n_vertices * 2 || table_size < n_indices * 2) {
+        table_size *= 2;
+    }
+    mask = (unsigned int)table_size - 1;
+    position_table = (int*)malloc((size_t)table_size * sizeof(int));
+    wedge_counts = (int*)calloc((size_t)n_vertices, sizeof(int));
+    edge_keys = (uint64_t*)malloc((size_t)table_size * sizeof(uint64_t));
+    edge_counts = (int*)calloc((size_t)table_size, sizeof(int));
+    if (position_table == NULL || wedge_counts == NULL || edge_keys == NULL || edge_counts == NULL) {
+        free(position_table);
+        free(wedge_counts);
+        free(edge_keys);
+        free(edge_counts);
+        return FALSE;
+    }
+
+    // Vertices per position (the first vertex of the position counts them).
+    memset(position_table, -1, (size_t)table_size * sizeof(int));
+    for (i = 0; i < n_vertices; ++i) {
+        const float* p = vertices[i].position;
+        unsigned int slot = hash_position(p) & mask;
+        while (position_table[slot] >= 0) {
+            const float* q = vertices[position_table[slot]].position;
+            if (p[0] == q[0] && p[1] == q[1] && p[2] == q[2]) {
+                break;
+            }
+            slot = (slot + 1) & mask;
+        }
+        if (position_table[slot] < 0) {
+            position_table[slot] = i;
+        }
+        ++wedge_counts[position_table[slot]];
+    }
+    for (i = 0; i < n_vertices; ++i) {
+        const float* p = vertices[i].position;
+        unsigned int slot = hash_position(p) & mask;
+        while (1) {
+            const float* q = vertices[position_table[slot]].position;
+            if (p[0] == q[0] && p[1] == q[1] && p[2] == q[2]) {
+                break;
+            }
+            slot = (slot + 1) & mask;
+        }
+        locked[i] = (wedge_counts[position_table[slot]] > 1) ? TRUE : FALSE;
+    }
+
+    // Directed edge use counts: an interior edge is used once in each direction.
+    for (i = 0; i < n_indices; ++i) {
+        const uint64_t a = indices[i];
+        const uint64_t b = indices[(i % 3 == 2) ? i - 2 : i + 1];
+        const uint64_t key = (a << 32) | b;
+        unsigned int slot = (unsigned int)hash_edge_key(key) & mask;
+        while (edge_counts[slot] != 0 && edge_keys[slot] != key) {
+            slot = (slot + 1) & mask;
+        }
+        edge_keys[slot] = key;
+        ++edge_counts[slot];
+    }
+    for (i = 0; i < n_indices; ++i) {
+        const unsigned int a = indices[i];
+        const unsigned int b = indices[(i % 3 == 2) ? i - 2 : i + 1];
+        const uint64_t key = ((uint64_t)a << 32) | b;
+        const uint64_t opposite = ((uint64_t)b << 32) | a;
+        unsigned int slot = (unsigned int)hash_edge_key(key) & mask;
+        int count;
+        int opposite_count = 0;
+
+        while (edge_counts[slot] == 0 || edge_keys[slot] != key) {
+            slot = (slot + 1) & mask;
+        }
+        count = edge_counts[slot];
+        slot = (unsigned int)hash_edge_key(opposite) & mask;
+        while (edge_counts[slot] != 0) {
+            if (edge_keys[slot] == opposite) {
+                opposite_count = edge_counts[slot];
+                break;
+            }
+            slot = (slot + 1) & mask;
+        }
+        if (count != 1 || opposite_count != 1) {
+            locked[a] = TRUE;
+            locked[b] = TRUE;
+        }
+    }
+
+    free(position_table);
+    free(wedge_counts);
+    free(edge_keys);
+    free(edge_counts);
+    return TRUE;
+}
+
+static int compare_collapses(const void* a, const void* b)
+{
+    const float ca = ((const Collapse*)a)->cost;
+    const float cb = ((const Collapse*)b)->cost;
+    return (ca > cb) - (ca < cb);
+}
+
+/**
+ * Check whether moving the vertex flips any of its triangles.
+ */
+static int collapse_flips(const unsigned int* indices, const int* triangles, int n_triangles,
+                          unsigned int from, unsigned int to, const MeshVertex* vertices)
+{
+    int i, k;
+
+    for (i = 0; i < n_triangles; ++i) {
+        const unsigned int* tri = &indices[triangles[i] * 3];
+        const float* before[3];
+        const float* after[3];
+        double n0[3], n1[3];
+
+        if (tri[0] == to || tri[1] == to || tri[2] == to) {
+            // Degenerates and gets removed.
+            continue;
+        }
+        for (k = 0; k < 3; ++k) {
+            before[k] = vertices[tri[k]].position;
+            after[k] = (tri[k] == from) ? vertices[to].position : before[k];
+        }
+        triangle_normal(before[0], before[1], before[2], n0);
+        triangle_normal(after[0], after[1], after[2], n1);
+        if (n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2] <= 0.0) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+int simplify_indices(unsigned int* output, const unsigned int* indices, int n_indices,
+                     const MeshVertex* vertices, int n_vertices,
+                     int target_index_count, float max_error, float* result_error)
+{
+    const double max_error_squared = (double)max_error * (double)max_error;
+    char* locked = (char*)malloc((size_t)n_vertices);
+    char* touched = (char*)malloc((size_t)n_vertices);
+    Quadric* quadrics = (Quadric*)calloc((size_t)n_vertices, sizeof(Quadric));
+    unsigned int* remap = (unsigned int*)malloc((size_t)n_vertices * sizeof(unsigned int));
+    int* offsets = (int*)malloc(((size_t)n_vertices + 1) * sizeof(int));
+    int* counts = (int*)malloc((size_t)n_vertices * sizeof(int));
+    int* adjacency = (int*)malloc(((size_t)n_indices + 1) * sizeof(int));
+    Collapse* collapses = (Collapse*)malloc(((size_t)n_indices * 2 + 1) * sizeof(Collapse));
+    double worst_error = 0.0;
+    int n = n_indices;
+    int pass;
+    int i, t;
+
+    *result_error = 0.0f;
+    if (locked == NULL || touched == NULL || quadrics == NULL || remap == NULL || offsets == NULL
+        || counts == NULL || adjacency == NULL || collapses == NULL
+        || find_locked_vertices(locked, indices, n_indices, vertices, n_vertices) == FALSE) {
+        free(locked); free(touched); free(quadrics); free(remap);
+        free(offsets); free(counts); free(adjacency); free(collapses);
+        return 0;
+    }
+    memcpy(output, indices, (size_t)n_indices * sizeof(unsigned int));
+
+    for (t = 0; t < n_indices / 3; ++t) {
+        const float* p0 = vertices[output[t * 3]].position;
+        const float* p1 = vertices[output[t * 3 + 1]].position;
+        const float* p2 = vertices[output[t * 3 + 2]].position;
+        double normal[3];
+        double length;
+
+        triangle_normal(p0, p1, p2, normal);
+        length = sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        if (length > 0.0) {
+            const double a = normal[0] / length;
+            const double b = normal[1] / length;
+            const double c = normal[2] / length;
+            const double d = -(a * p0[0] + b * p0[1] + c * p0[2]);
+            for (i = 0; i < 3; ++i) {
+                add_plane_quadric(&quadrics[output[t * 3 + i]], a, b, c, d, length * 0.5);
+            }
+        }
+    }
+    for (i = 0; i < n_vertices; ++i) {
+        remap[i] = (unsigned int)i;
+    }
+
+    // Each pass collapses an independent set of the cheapest edges.
+    for (pass = 0; pass < MAX_SIMPLIFY_PASSES && n > target_index_count; ++pass) {
+        const int n_triangles = n / 3;
+        int budget = (n_triangles - target_index_count / 3) / 2 + 1;
+        int n_collapses = 0;
+        int n_candidates = 0;
+        int out;
+
+        // Vertex -> triangle adjacency of the current mesh.
+        memset(counts, 0, (size_t)n_vertices * sizeof(int));
+        for (i = 0; i < n; ++i) {
+            ++counts[output[i]];
+        }
+        offsets[0] = 0;
+        for (i = 0; i < n_vertices; ++i) {
+            offsets[i + 1] = offsets[i] + counts[i];
+            counts[i] = 0;
+        }
+        for (i = 0; i < n; ++i) {
+            const unsigned int v = output[i];
+            adjacency[offsets[v] + counts[v]++] = i / 3;
+        }
+
+        for (i = 0; i < n; ++i) {
+            const unsigned int a = output[i];
+            const unsigned int b = output[(i % 3 == 2) ? i - 2 : i + 1];
+            Quadric q;
+            if (locked[a] == FALSE) {
+                q = quadrics[a];
+                add_quadric(&q, &quadrics[b]);
+                collapses[n_candidates].cost = (float)quadric_error(&q, vertices[b].position);
+                collapses[n_candidates].from = a;
+                collapses[n_candidates].to = b;
+                ++n_candidates;
+            }
+            if (locked[b] == FALSE) {
+                q = quadrics[b];
+                add_quadric(&q, &quadrics[a]);
+                collapses[n_candidates].cost = (float)quadric_error(&q, vertices[a].position);
+                collapses[n_candidates].from = b;
+                collapses[n_candidates].to = a;
+                ++n_candidates;
+            }
+        }
+        qsort(collapses, (size_t)n_candidates, sizeof(Collapse), compare_collapses);
+
+        memset(touched, 0, (size_t)n_vertices);
+        for (i = 0; i < n_candidates && n_collapses < budget; ++i) {
+            const Collapse* c = &collapses[i];
+            const int* triangles = &adjacency[offsets[c->from]];
+            const int n_around = offsets[c->from + 1] - offsets[c->from];
+            int j;
+
+            if (c->cost > max_error_squared) {
+                break;
+            }
+            if (touched[c->from] || touched[c->to]
+                || collapse_flips(output, triangles, n_around, c->from, c->to, vertices)) {
+                continue;
+            }
+            remap[c->from] = c->to;
+            add_quadric(&quadrics[c->to], &quadrics[c->from]);
+            if (c->cost > worst_error) {
+                worst_error = c->cost;
+            }
+            // The triangles around the vertex change: keep their vertices for this pass.
+            for (j = 0; j < n_around; ++j) {
+                touched[output[triangles[j] * 3]] = TRUE;
+                touched[output[triangles[j] * 3 + 1]] = TRUE;
+                touched[output[triangles[j] * 3 + 2]] = TRUE;
+            }
+            ++n_collapses;
+        }
+        if (n_collapses == 0) {
+            break;
+        }
+
+        out = 0;
+        for (t = 0; t < n_triangles; ++t) {
+            const unsigned int a = remap[output[t * 3]];
+            const unsigned int b = remap[output[t * 3 + 1]];
+            const unsigned int c = remap[output[t * 3 + 2]];
+            if (a == b || b == c || a == c) {
+                continue;
+            }
+            output[out++] = a;
+            output[out++] = b;
+            output[out++] = c;
+        }
+        n = out;
+    }
+
+    *result_error = (float)sqrt(worst_error);
+    free(locked); free(touched); free(quadrics); free(remap);
+    free(offsets); free(counts); free(adjacency); free(collapses);
+    return n;
+}
+
+static float calc_model_radius(const Model* model)
+{
+    float min[3], max[3];
+    int i, k;
+
+    if (model->n_mesh_vertices == 0) {
+        return 0.0f;
+    }
+    for (k = 0; k < 3; ++k) {
+        min[k] = model->mesh_vertices[0].position[k];
+        max[k] = min[k];
+    }
+    for (i = 1; i < model->n_mesh_vertices; ++i) {
+        for (k = 0; k < 3; ++k) {
+            const float value = model->mesh_vertices[i].position[k];
+            if (value < min[k]) {
+                min[k] = value;
+            }
+            else if (value > max[k]) {
+                max[k] = value;
+            }
+        }
+    }
+    return 0.5f * sqrtf((max[0] - min[0]) * (max[0] - min[0])
+        + (max[1] - min[1]) * (max[1] - min[1])
+        + (max[2] - min[2]) * (max[2] - min[2]));
+}
+
+int generate_model_lods(Model* model)
+{
+    const float max_error = LOD_MAX_RELATIVE_ERROR * calc_model_radius(model);
+    unsigned int* indices;
+    Submesh* submeshes;
+    void* stored;
+    int n_submeshes;
+    int total;
+    int level;
+    int i;
+
+    if (model->n_lods != 1 || model->lods[0].n_indices / 3 < MIN_LOD_TRIANGLES) {
+        return TRUE;
+    }
+    // Every level fits into the size of the previous one.
+    indices = (unsigned int*)malloc((size_t)model->n_indices * MAX_MODEL_LODS * sizeof(unsigned int));
+    submeshes = (Submesh*)malloc((size_t)model->n_submeshes * MAX_MODEL_LODS * sizeof(Submesh));
+    if (indices == NULL || submeshes == NULL) {
+        free(indices);
+        free(submeshes);
+        return FALSE;
+    }
+    for (i = 0; i < model->n_indices; ++i) {
+        indices[i] = get_model_index(model, i);
+    }
+    memcpy(submeshes, model->submeshes, (size_t)model->n_submeshes * sizeof(Submesh));
+    total = model->n_indices;
+    n_submeshes = model->n_submeshes;
+
+    for (level = 1; level < MAX_MODEL_LODS; ++level) {
+        const ModelLod* previous = &model->lods[level - 1];
+        const int first_submesh = n_submeshes;
+        float level_error = 0.0f;
+        int first_index = total;
+        int k;
+
+        if (previous->n_indices / 3 < MIN_LOD_TRIANGLES) {
+            break;
+        }
+        // The materials are simplified one by one; their borders stay in place,
+        // so the submeshes don't open cracks between each other.
+        for (k = 0; k < previous->n_submeshes; ++k) {
+            const Submesh* source = &submeshes[previous->first_submesh + k];
+            Submesh* target = &submeshes[n_submeshes];
+            float error = 0.0f;
+            int n = 0;
+
+            if (source->n_indices / 3 >= MIN_LOD_TRIANGLES) {
+                n = simplify_indices(indices + first_index, indices + source->first_index, source->n_indices,
+                                     model->mesh_vertices, model->n_mesh_vertices,
+                                     (source->n_indices / 6) * 3, max_error, &error);
+            }
+            if (n == 0) {
+                // Small or unsimplifiable parts are kept as they are.
+                memcpy(indices + first_index, indices + source->first_index,
+                       (size_t)source->n_indices * sizeof(unsigned int));
+                n = source->n_indices;
+            }
+            *target = *source;
+            target->first_index = first_index;
+            target->n_indices = n;
+            if (error > level_error) {
+                level_error = error;
+            }
+            first_index += n;
+            ++n_submeshes;
+        }
+        if ((float)(first_index - total) > (float)previous->n_indices * LOD_MIN_REDUCTION) {
+            n_submeshes = first_submesh;
+            break;
+        }
+        model->lods[level].first_index = total;
+        model->lods[level].n_indices = first_index - total;
+        model->lods[level].error = level_error;
+        model->lods[level].first_meshlet = 0;
+        model->lods[level].n_meshlets = 0;
+        model->lods[level].first_submesh = first_submesh;
+        model->lods[level].n_submeshes = n_submeshes - first_submesh;
+        model->n_lods = level + 1;
+        total = first_index;
+    }
+
+    if (model->n_lods > 1) {
+        // Indices in a mapped file can't grow in place.
+        stored = is_model_array_mapped(model, model->indices)
+            ? malloc(((size_t)total + 1) * (size_t)model->index_size)
+            : realloc(model->indices, ((size_t)total + 1) * (size_t)model->index_size);
+        if (stored == NULL) {
+            free(indices);
+            free(submeshes);
+            model->n_lods = 1;
+            return FALSE;
+        }
+        model->indices = stored;
+        model->n_indices = total;
+        for (i = 0; i < total; ++i) {
+            if (model->index_size == 2) {
+                ((unsigned short*)stored)[i] = (unsigned short)indices[i];
+            }
+            else {
+                ((unsigned int*)stored)[i] = indices[i];
+            }
+        }
+        if (is_model_array_mapped(model, model->submeshes) == FALSE) {
+            free(model->submeshes);
+        }
+        model->submeshes = submeshes;
+        model->n_submeshes = n_submeshes;
+        submeshes = NULL;
+        printf("Levels of detail:");
+        for (level = 0; level < model->n_lods; ++level) {
+            printf(" %d", model->lods[level].n_indices / 3);
+        }
+        printf(" triangles\n");
+    }
+    free(indices);
+    free(submeshes);
+    return TRUE;
+}
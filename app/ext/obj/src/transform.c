@@ -1,12 +1,46 @@
 #include "transform.h"
+#include "draw.h"
+#include "gpu_mesh.h"
+#include "meshlet.h"
+
+#include <stddef.h>
 
 void scale_model(Model* model, double sx, double sy, double sz)
 {
+    const float fx = (float)sx;
+    const float fy = (float)sy;
+    const float fz = (float)sz;
     int i;
 
-    for (i = 0; i < model->n_vertices; ++i) {
-        model->vertices[i].x *= sx;
-        model->vertices[i].y *= sy;
-        model->vertices[i].z *= sz;
+    for (i = 0; i < model->n_mesh_vertices; ++i) {
+        model->mesh_vertices[i].position[0] *= fx;
+        model->mesh_vertices[i].position[1] *= fy;
+        model->mesh_vertices[i].position[2] *= fz;
+    }
+    // The quantized copy only needs a new dequantization.
+    if (model->quantized_vertices != NULL) {
+        model->quantization.position_offset[0] *= fx;
+        model->quantization.position_offset[1] *= fy;
+        model->quantization.position_offset[2] *= fz;
+        model->quantization.position_scale[0] *= fx;
+        model->quantization.position_scale[1] *= fy;
+        model->quantization.position_scale[2] *= fz;
+    }
+    // The optional high precision copy is kept consistent.
+    if (model->vertices != NULL) {
+        for (i = 0; i <= model->n_vertices; ++i) {
+            model->vertices[i].x *= sx;
+            model->vertices[i].y *= sy;
+            model->vertices[i].z *= sz;
+        }
+    }
+    // The bounds and the cones (not only scaled by a non-uniform scale) are
+    // rebuilt from the new positions, and the buffers and lists re-recorded.
+    update_meshlet_bounds(model);
+    if (model->gpu.vertex_buffer != 0 && upload_model_buffers(model) == FALSE) {
+        release_model_buffers(model);
+    }
+    if (model->gpu.display_lists != 0) {
+        compile_model_lists(model);
     }
 }
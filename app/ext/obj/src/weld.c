@@ -0,0 +1,217 @@
+#include "weld.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define EMPTY_SLOT (-1)
+#define MAX_16BIT_VERTICES 65536
+
+static unsigned int hash_face_point(const FacePoint* point)
+{
+    unsigned int hash = (unsigned int)point->vertex_index * 73856093u;
+    hash ^= (unsigned int)point->texture_index * 19349663u;
+    hash ^= (unsigned int)point->normal_index * 83492791u;
+    hash ^= hash >> 16;
+    hash *= 0x7feb352du;
+    hash ^= hash >> 15;
+    return hash;
+}
+
+static int is_same_face_point(const FacePoint* a, const FacePoint* b)
+{
+    return a->vertex_index == b->vertex_index
+        && a->texture_index == b->texture_index
+        && a->normal_index == b->normal_index;
+}
+
+static int build_index_buffer(Model* model, const unsigned int* remap, int n_indices)
+{
+    int i;
+
+    if (model->n_mesh_vertices <= MAX_16BIT_VERTICES) {
+        unsigned short* indices = (unsigned short*)malloc(((size_t)n_indices + 1) * sizeof(unsigned short));
+        if (indices == NULL) {
+            return FALSE;
+        }
+        for (i = 0; i < n_indices; ++i) {
+            indices[i] = (unsigned short)remap[i];
+        }
+        model->indices = indices;
+        model->index_size = 2;
+    }
+    else {
+        unsigned int* indices = (unsigned int*)malloc(((size_t)n_indices + 1) * sizeof(unsigned int));
+        if (indices == NULL) {
+            return FALSE;
+        }
+        for (i = 0; i < n_indices; ++i) {
+            indices[i] = remap[i];
+        }
+        model->indices = indices;
+        model->index_size = 4;
+    }
+    model->n_indices = n_indices;
+    model->n_lods = 1;
+    model->lods[0].first_index = 0;
+    model->lods[0].n_indices = n_indices;
+    model->lods[0].error = 0.0f;
+    model->lods[0].first_meshlet = 0;
+    model->lods[0].n_meshlets = 0;
+    return TRUE;
+}
+
+/**
+ * Stable counting sort of the triangles by material (NO_MATERIAL first).
+ */
+static int group_triangles_by_material(Model* model)
+{
+    const int n_buckets = model->n_materials + 1;
+    Triangle* sorted;
+    int* offsets;
+    int i;
+
+    if (model->n_materials == 0 || model->n_triangles == 0) {
+        return TRUE;
+    }
+    sorted = (Triangle*)malloc((size_t)model->n_triangles * sizeof(Triangle));
+    offsets = (int*)calloc((size_t)n_buckets + 1, sizeof(int));
+    if (sorted == NULL || offsets == NULL) {
+        free(sorted);
+        free(offsets);
+        return FALSE;
+    }
+    for (i = 0; i < model->n_triangles; ++i) {
+        ++offsets[model->triangles[i].material + 2];
+    }
+    for (i = 1; i <= n_buckets; ++i) {
+        offsets[i] += offsets[i - 1];
+    }
+    for (i = 0; i < model->n_triangles; ++i) {
+        sorted[offsets[model->triangles[i].material + 1]++] = model->triangles[i];
+    }
+    memcpy(model->triangles, sorted, (size_t)model->n_triangles * sizeof(Triangle));
+    free(sorted);
+    free(offsets);
+    return TRUE;
+}
+
+/**
+ * One submesh per run of triangles with the same material (the full detail level).
+ */
+static int build_submeshes(Model* model)
+{
+    int n_submeshes = 0;
+    int i;
+
+    model->submeshes = (Submesh*)malloc(((size_t)model->n_materials + 1) * sizeof(Submesh));
+    if (model->submeshes == NULL) {
+        return FALSE;
+    }
+    for (i = 0; i < model->n_triangles; ++i) {
+        const int material = model->triangles[i].material;
+        if (i == 0 || material != model->triangles[i - 1].material) {
+            Submesh* submesh = &model->submeshes[n_submeshes++];
+            submesh->material = material;
+            submesh->first_index = i * 3;
+            submesh->n_indices = 0;
+            submesh->first_meshlet = 0;
+            submesh->n_meshlets = 0;
+        }
+        model->submeshes[n_submeshes - 1].n_indices += 3;
+    }
+    model->n_submeshes = n_submeshes;
+    model->lods[0].first_submesh = 0;
+    model->lods[0].n_submeshes = n_submeshes;
+    return TRUE;
+}
+
+int weld_model(Model* model, int keep_elements)
+{
+    const int n_corners = model->n_triangles * 3;
+    FacePoint* unique_points;
+    unsigned int* remap;
+    int* table;
+    unsigned int table_mask;
+    int table_size;
+    int n_unique;
+    int i;
+
+    if (group_triangles_by_material(model) == FALSE) {
+        printf("ERROR: Out of memory while welding the model!\n");
+        return FALSE;
+    }
+
+    // Open addressing hash table with at least 2x headroom.
+    table_size = 16;
+    while (table_size < n_corners * 2) {
+        table_size *= 2;
+    }
+    table_mask = (unsigned int)table_size - 1;
+
+    table = (int*)malloc((size_t)table_size * sizeof(int));
+    unique_points = (FacePoint*)malloc(((size_t)n_corners + 1) * sizeof(FacePoint));
+    remap = (unsigned int*)malloc(((size_t)n_corners + 1) * sizeof(unsigned int));
+    if (table == NULL || unique_points == NULL || remap == NULL) {
+        printf("ERROR: Out of memory while welding the model!\n");
+        free(table);
+        free(unique_points);
+        free(remap);
+        return FALSE;
+    }
+    for (i = 0; i < table_size; ++i) {
+        table[i] = EMPTY_SLOT;
+    }
+
+    n_unique = 0;
+    for (i = 0; i < n_corners; ++i) {
+        // The indices are valid: sanitize_model() ran before welding.
+        const FacePoint key = model->triangles[i / 3].points[i % 3];
+        unsigned int slot;
+
+        slot = hash_face_point(&key) & table_mask;
+        while (table[slot] != EMPTY_SLOT && !is_same_face_point(&unique_points[table[slot]], &key)) {
+            slot = (slot + 1) & table_mask;
+        }
+        if (table[slot] == EMPTY_SLOT) {
+            table[slot] = n_unique;
+            unique_points[n_unique++] = key;
+        }
+        remap[i] = (unsigned int)table[slot];
+    }
+    free(table);
+
+    model->mesh_vertices = (MeshVertex*)malloc(((size_t)n_unique + 1) * sizeof(MeshVertex));
+    if (model->mesh_vertices == NULL) {
+        free(unique_points);
+        free(remap);
+        return FALSE;
+    }
+    for (i = 0; i < n_unique; ++i) {
+        MeshVertex* vertex = &model->mesh_vertices[i];
+        const Vertex* position = &model->vertices[unique_points[i].vertex_index];
+        const Vertex* normal = &model->normals[unique_points[i].normal_index];
+        const TextureVertex* uv = &model->texture_vertices[unique_points[i].texture_index];
+        vertex->position[0] = (float)position->x;
+        vertex->position[1] = (float)position->y;
+        vertex->position[2] = (float)position->z;
+        vertex->normal[0] = (float)normal->x;
+        vertex->normal[1] = (float)normal->y;
+        vertex->normal[2] = (float)normal->z;
+        vertex->uv[0] = (float)uv->u;
+        vertex->uv[1] = 1.0f - (float)uv->v;
+    }
+    model->n_mesh_vertices = n_unique;
+    free(unique_points);
+
+    if (build_index_buffer(model, remap, n_corners) == FALSE || build_submeshes(model) == FALSE) {
+        free(remap);
+        return FALSE;
+    }
+    free(remap);
+
+    if (keep_elements == FALSE) {
+        free_model_elements(model);
+    }
+    return TRUE;
+}
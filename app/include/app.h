@@ -28,6 +28,10 @@ typedef struct App
 
     int window_w;
     int window_h;
+
+    /* Frame times since the last vertex format or mipmap switch (for the before/after report). */
+    double frame_time_sum;
+    int frame_count;
 } App;
 
 /**
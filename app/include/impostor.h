@@ -0,0 +1,62 @@
+#ifndef IMPOSTOR_H
+#define IMPOSTOR_H
+
+#include <SDL2/SDL_opengl.h>
+
+/* Number of view directions around the vertical (Z) axis */
+#define IMPOSTOR_VIEWS 16
+/* Size of one view in the atlas (pixels) */
+#define IMPOSTOR_TILE_SIZE 128
+
+/**
+ * Pre-rendered views of an object, drawn as a camera-facing card from far away
+ */
+typedef struct Impostor
+{
+    /* Atlas of IMPOSTOR_VIEWS square tiles side by side (0 when there is no impostor). */
+    GLuint texture;
+    /* Half size of the card: the radius of the bounding sphere in world units. */
+    float radius;
+    /* Z rotation (spin) of the object when the views were captured, in degrees. */
+    float captured_rz;
+    /* Light intensity of the scene when the views were captured. */
+    float captured_light;
+} Impostor;
+
+/**
+ * Draws the object in world space; the capture view is already on the modelview stack.
+ */
+typedef void (*ImpostorDrawFunc)(void* context);
+
+/**
+ * Render the object from IMPOSTOR_VIEWS directions around the world Z axis into
+ * the atlas of the impostor (orthographic views of the bounding sphere).
+ * The views are drawn into the back buffer and copied with glCopyTexSubImage2D,
+ * so it needs a destination alpha channel (SDL_GL_ALPHA_SIZE).
+ * Returns 0 if the impostor could not be created.
+ */
+int capture_impostor(Impostor* impostor, const float center[3], float radius,
+                     ImpostorDrawFunc draw, void* context);
+
+/**
+ * Draw the card (rotating around the world Z axis to face the camera) with the
+ * view closest to the camera direction.
+ * spin_deg: rotation of the object around Z since the capture.
+ * view: the camera (modelview) matrix.
+ */
+void draw_impostor(const Impostor* impostor, const float center[3], float spin_deg,
+                   const double view[16], float brightness);
+
+/**
+ * Screen-door crossfade between the mesh and the card: a dither pattern with the
+ * given coverage (0..1) for the mesh, or its complement for the card, so the two
+ * never cover the same pixel. Disable with glDisable(GL_POLYGON_STIPPLE).
+ */
+void enable_impostor_crossfade(float mesh_coverage, int is_card);
+
+/**
+ * Release the atlas texture.
+ */
+void destroy_impostor(Impostor* impostor);
+
+#endif /* IMPOSTOR_H */
@@ -0,0 +1,59 @@
+#ifndef MODEL_REGISTRY_H
+#define MODEL_REGISTRY_H
+
+#include "utils.h"
+
+#include <obj/model.h>
+
+/* At most one distinct model per entity */
+#define MAX_SHARED_MODELS 64
+#define MAX_MODEL_PATH 256
+
+/**
+ * Model loaded once and shared by every entity that uses the same asset path
+ */
+typedef struct SharedModel
+{
+    char path[MAX_MODEL_PATH];
+    int ref_count;
+    Model model;
+
+    /* Unique number of the model in its registry (groups its entities in the render queue) */
+    int id;
+
+    /* Local-space bounding sphere (for picking, LOD and impostors) */
+    vec3 bounds_center;
+    float bounds_radius;
+
+    /* Local-space AABB min Z (for auto-grounding statues) */
+    float bounds_min_z;
+} SharedModel;
+
+/**
+ * Loaded models by asset path
+ */
+typedef struct ModelRegistry
+{
+    SharedModel* models[MAX_SHARED_MODELS];
+    int model_count;
+    int next_id;
+} ModelRegistry;
+
+/**
+ * Initialize an empty registry.
+ */
+void init_model_registry(ModelRegistry* registry);
+
+/**
+ * Get the model of the asset path with a new reference, loading it on first use
+ * (OBJ or GLB by the extension). A model that fails to load is kept empty, so it
+ * isn't retried. Returns NULL only when the registry is full or out of memory.
+ */
+SharedModel* acquire_model(ModelRegistry* registry, const char* path);
+
+/**
+ * Drop a reference; the model is freed with its last reference.
+ */
+void release_model(ModelRegistry* registry, SharedModel* shared);
+
+#endif /* MODEL_REGISTRY_H */
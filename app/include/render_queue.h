@@ -0,0 +1,124 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <GL/gl.h>
+
+#include <stdint.h>
+
+/* Draw items of a frame (one per entity, see MAX_ENTITIES) */
+#define MAX_RENDER_ITEMS 128
+
+/*
+ * Draw items of a frame sorted by a packed 64 bit state key:
+ *
+ *   63..62  pass (RENDER_PASS_OPAQUE before RENDER_PASS_TRANSPARENT)
+ *   opaque:       61..52 mesh, 51..49 level of detail, 48 two-sided,
+ *                 47..32 texture, 31..8 view depth (front to back)
+ *   transparent:  61..38 inverted view depth (back to front)
+ *
+ * The opaque draws are grouped by mesh and level of detail (the instances of
+ * an instanced draw), then by cull mode and texture, and go front to back inside a group.
+ * The bind and enable calls go through the queue, which skips the ones that
+ * don't change the state and counts the others.
+ */
+
+/* Mesh number of the draws without a mesh (impostor cards), after all meshes */
+#define RENDER_NO_MESH 0x3FF
+
+typedef enum RenderPass {
+    RENDER_PASS_OPAQUE,
+    RENDER_PASS_TRANSPARENT
+} RenderPass;
+
+/**
+ * Entry of the queue: the sort key and the index of the drawn object
+ */
+typedef struct RenderItem
+{
+    uint64_t key;
+    int index;
+} RenderItem;
+
+/**
+ * State changes of the last frame
+ */
+typedef struct RenderQueueStats
+{
+    int n_items;
+    int n_texture_binds;
+    /* Enable / disable calls (cull mode) */
+    int n_state_changes;
+    /* Binds and state changes skipped because the state was already set */
+    int n_skipped;
+    /* glDrawElementsInstanced calls and the entities they drew */
+    int n_instanced_draws;
+    int n_instanced;
+} RenderQueueStats;
+
+typedef struct RenderQueue
+{
+    RenderItem items[MAX_RENDER_ITEMS];
+    /* Ping-pong buffer of the radix sort */
+    RenderItem scratch[MAX_RENDER_ITEMS];
+    int count;
+
+    /* Tracked state: the bound texture (when is_texture_known) and GL_CULL_FACE (-1 = unknown) */
+    GLuint texture;
+    int is_texture_known;
+    int cull_face;
+
+    RenderQueueStats stats;
+} RenderQueue;
+
+/**
+ * Empty the queue and forget the tracked state (start of a frame).
+ */
+void reset_render_queue(RenderQueue* queue);
+
+/**
+ * Sort key of an opaque draw. mesh is folded below RENDER_NO_MESH, depth is the
+ * view space distance (negative is clamped to 0).
+ */
+uint64_t make_opaque_sort_key(int mesh, int level, GLuint texture, int two_sided, float depth);
+
+/**
+ * Sort key of a transparent draw (farther draws first).
+ */
+uint64_t make_transparent_sort_key(float depth);
+
+/**
+ * Get the pass of a sort key.
+ */
+RenderPass get_sort_key_pass(uint64_t key);
+
+/**
+ * Add a draw item. Returns 0 when the queue is full.
+ */
+int push_render_item(RenderQueue* queue, uint64_t key, int index);
+
+/**
+ * Sort the items by their keys (stable radix sort).
+ */
+void sort_render_queue(RenderQueue* queue);
+
+/**
+ * Bind the 2D texture unless it is already bound.
+ */
+void bind_queue_texture(RenderQueue* queue, GLuint texture);
+
+/**
+ * Record a texture bound outside the queue.
+ */
+void set_queue_texture(RenderQueue* queue, GLuint texture);
+
+/**
+ * Enable or disable GL_CULL_FACE unless it is already in that state.
+ */
+void set_queue_cull_face(RenderQueue* queue, int enabled);
+
+/**
+ * Forget the tracked state (after drawing code that changes it directly).
+ */
+void invalidate_queue_state(RenderQueue* queue);
+
+#endif /* RENDER_QUEUE_H */
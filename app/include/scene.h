@@ -2,9 +2,15 @@
 #define SCENE_H
 
 #include "camera.h"
+#include "impostor.h"
+#include "model_registry.h"
+#include "render_queue.h"
+#include "static_batch.h"
 #include "texture.h"
+#include "texture_cache.h"
 #include "utils.h"
 
+#include <obj/meshlet.h>
 #include <obj/model.h>
 #include <SDL2/SDL_opengl.h>
 
@@ -14,7 +20,8 @@ typedef struct Entity
 {
     char type[32];
 
-    Model model;
+    /* Shared with the other entities of the same model file (read-only). */
+    SharedModel* mesh;
     GLuint texture_id;
 
     float px, py, pz;
@@ -27,15 +34,17 @@ typedef struct Entity
     // ugyanonnan folytassa, és ne ugorjon "időből számolt" szögre.
     float anim_angle_deg;
 
-    /* Local-space bounding sphere for picking */
-    vec3 bounds_center_local;
-    float bounds_radius_local;
-
-    /* Local-space AABB min Z (for auto-grounding statues) */
-    float bounds_min_z_local;
-
     /* Extra world-space Z offset to place model base onto a surface (pedestal top). */
     float ground_offset_z;
+
+    /* Level of detail drawn this frame (chosen from the projected bounds size). */
+    int lod_level;
+
+    /* Projected bounding sphere diameter in pixels (updated every frame). */
+    float screen_size_px;
+
+    /* Pre-rendered views for drawing from far away (statues and ducks). */
+    Impostor impostor;
 } Entity;
 
 typedef struct Scene
@@ -43,6 +52,12 @@ typedef struct Scene
     Entity entities[MAX_ENTITIES];
     int entity_count;
 
+    /* Models of the entities, loaded once per file. */
+    ModelRegistry models;
+
+    /* Textures of the room and the entities, loaded once per image. */
+    TextureCache textures;
+
     Material material;
 
     float light_intensity;
@@ -64,6 +79,31 @@ typedef struct Scene
     /* Simple projected shadows */
     int shadows_enabled;
 
+    /* Impostors: entities smaller than impostor_pixels on screen are drawn as cards. */
+    int impostors_enabled;
+    float impostor_pixels;
+
+    /* Cluster level frustum and backface culling of the opaque meshes. */
+    int meshlet_culling_enabled;
+    /* Culling counters of the last rendered frame. */
+    MeshletStats meshlet_stats;
+
+    /* Trilinear filtering of the textures (through their mip levels). */
+    int mipmaps_enabled;
+
+    /* 0 = float vertices, 8 or 16 = quantized vertices with 2x8 or 2x16 bit normals. */
+    int vertex_normal_bits;
+
+    /* Entities that never move, merged in world space at load (see static_batch.h);
+       the entity index is the instance index. */
+    StaticGeometry static_geometry;
+
+    /* Draw items of the last frame, sorted by state (see render_queue.h). */
+    RenderQueue render_queue;
+
+    /* Display list of the room quads (replayed on the display list path). */
+    GLuint room_list;
+
 } Scene;
 
 void init_scene(Scene* scene);
@@ -74,7 +114,8 @@ void load_museum_scene(Scene* scene, const char* scene_csv_path);
 void change_light(Scene* scene, float delta);
 
 void update_scene(Scene* scene, double elapsed_time);
-void render_scene(const Scene* scene);
+/* Also picks the level of detail of the entities from the current view. */
+void render_scene(Scene* scene);
 
 // Egyszerű animáció kapcsoló (pl. statue forgás)
 void toggle_animation(Scene* scene);
@@ -82,6 +123,26 @@ void toggle_animation(Scene* scene);
 /* Toggle simple projected shadows (planar). */
 void toggle_shadows(Scene* scene);
 
+/* Toggle the impostor cards of distant statues. */
+void toggle_impostors(Scene* scene);
+
+/* Toggle the meshlet (cluster) culling of the opaque meshes. */
+void toggle_meshlet_culling(Scene* scene);
+
+/* Switch float -> quantized (2x8 bit normals) -> quantized (2x16 bit) -> float vertices
+   and print the vertex memory before and after. */
+void cycle_vertex_quantization(Scene* scene);
+
+/* Switch immediate mode -> vertex buffer objects -> display lists -> immediate mode
+   (see set_draw_path()). */
+void cycle_draw_path(Scene* scene);
+
+/* Toggle trilinear mipmapping of all textures (off = the full images, bilinear). */
+void toggle_mipmaps(Scene* scene);
+
+/* Screen size (projected diameter in pixels) below which impostors replace the mesh. */
+void set_impostor_threshold(Scene* scene, float pixels);
+
 /* Returns picked entity index, or -1 if none. Also sets scene->selected_entity. */
 int pick_entity(Scene* scene, const Camera* camera,
                 int mouse_x, int mouse_y,
@@ -0,0 +1,104 @@
+#ifndef STATIC_BATCH_H
+#define STATIC_BATCH_H
+
+#include "render_queue.h"
+
+#include <obj/model.h>
+
+#include <GL/gl.h>
+
+/* Placed models merged at most (one per entity) */
+#define MAX_STATIC_INSTANCES 64
+/* Distinct (texture, material) groups */
+#define MAX_STATIC_BATCHES 32
+
+/*
+ * Static batching: models that never move are transformed into world space
+ * once and merged into one mesh, one range (batch) per texture and material.
+ * A batch is one draw per frame instead of one per object; the range of each
+ * instance inside its batch is kept, so a single instance can be left out
+ * (the selected entity is drawn on its own for the outline).
+ *
+ * The transparent instances go into batches without texture or material: the
+ * glass pass sets them.
+ */
+
+/**
+ * Model placed in the world (input of build_static_geometry())
+ */
+typedef struct StaticInstance
+{
+    /* NULL for an instance that is not merged */
+    const Model* model;
+    /* Column major model matrix (float vertices, no dequantization) */
+    float transform[16];
+    GLuint texture;
+    int is_transparent;
+} StaticInstance;
+
+/**
+ * Range of the merged index buffer drawn with one state
+ */
+typedef struct StaticBatch
+{
+    GLuint texture;
+    int is_transparent;
+    /* Source of the material (NULL model or NO_MATERIAL when it has none) */
+    const Model* source;
+    int material;
+    /* Submesh of the merged model (its index range and its material) */
+    int submesh;
+    /* Display list of the range (0 when it has none) */
+    GLuint list;
+} StaticBatch;
+
+/**
+ * Triangles of one instance in one batch
+ */
+typedef struct StaticRange
+{
+    int instance;
+    int batch;
+    int first_index;
+    int n_indices;
+} StaticRange;
+
+typedef struct StaticGeometry
+{
+    /* World space mesh: level 0 has one submesh per batch */
+    Model model;
+    StaticBatch batches[MAX_STATIC_BATCHES];
+    int n_batches;
+    /* Ranges ordered by batch, then by instance */
+    StaticRange ranges[MAX_STATIC_INSTANCES * 4];
+    int n_ranges;
+    /* Whether the instance was merged (the others are drawn on their own) */
+    int is_merged[MAX_STATIC_INSTANCES];
+    int n_merged;
+} StaticGeometry;
+
+/**
+ * Initialize empty static geometry.
+ */
+void init_static_geometry(StaticGeometry* geometry);
+
+/**
+ * Merge the instances (call on the GL thread: it uploads the buffers and compiles
+ * the lists). An instance that doesn't fit into the batches is not merged.
+ * Returns 0 if out of memory (nothing is merged then).
+ */
+int build_static_geometry(StaticGeometry* geometry, const StaticInstance* instances, int n_instances);
+
+/**
+ * Draw the opaque or the transparent batches without the given instance (-1 = all).
+ * The textures of the opaque batches are bound through the queue.
+ */
+void draw_static_batches(const StaticGeometry* geometry, RenderQueue* queue, int is_transparent,
+                         int skipped_instance);
+
+/**
+ * Release the merged mesh, its buffers and its lists.
+ */
+void destroy_static_geometry(StaticGeometry* geometry);
+
+#endif /* STATIC_BATCH_H */
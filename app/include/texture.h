@@ -3,8 +3,71 @@
 
 #include <GL/gl.h>
 
+#include <stddef.h>
+#include <stdint.h>
+
 typedef GLubyte Pixel[3];
 
+/**
+ * Decoded RGB or RGBA image
+ */
+typedef struct TextureImage
+{
+    int width;
+    int height;
+    /* 3 (RGB, images without alpha) or 4 (RGBA) */
+    int channels;
+    /* width * height pixels, tightly packed rows */
+    unsigned char* pixels;
+    /* Decoder storage of the pixels, NULL when they are in their own allocation. */
+    void* surface;
+    /* Number of mip levels including the full image (1 until build_texture_mipmaps). */
+    int n_levels;
+    /* Levels 1..n_levels-1 back to back, each half the size of the previous one. */
+    unsigned char* mipmaps;
+} TextureImage;
+
+/**
+ * Decode an image file to RGB (no alpha in the file) or RGBA, halved until neither
+ * side is larger than max_size (0 = full size). Returns 0 on error.
+ */
+int load_texture_image(const char* filename, int max_size, TextureImage* image);
+
+/**
+ * Release the pixels and the mip chain of the image.
+ */
+void free_texture_image(TextureImage* image);
+
+/**
+ * Downsample the image into a full mip chain (down to 1x1) with a 2x2 box filter,
+ * using SSE2 when the compiler targets it. Returns 0 if out of memory.
+ */
+int build_texture_mipmaps(TextureImage* image);
+
+/**
+ * Pixels and size of a level of the image (0 = the full image, 1.. = the mip chain).
+ */
+const unsigned char* get_texture_level(const TextureImage* image, int level, int* width, int* height);
+
+/**
+ * FNV-1a hash of the pixels of the full image.
+ */
+uint64_t hash_texture_image(const TextureImage* image);
+
+/**
+ * Repeat wrapping and trilinear (bilinear with one level) filtering of the bound texture.
+ */
+void set_texture_sampling(int n_levels);
+
+/**
+ * Create a trilinear filtered, mipmapped texture from the image and return its
+ * name (0 on error). The mip chain is built here if the image has none yet.
+ * The largest levels are left out while the texture is over max_bytes.
+ * gpu_bytes receives the size of the texture in video memory and n_levels its
+ * number of uploaded levels (1 without mipmaps; both can be NULL).
+ */
+GLuint upload_texture(const TextureImage* image, size_t max_bytes, size_t* gpu_bytes, int* n_levels);
+
 /**
  * Load texture from file and returns with the texture name.
  */
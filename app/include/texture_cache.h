@@ -0,0 +1,112 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <GL/gl.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MAX_CACHED_TEXTURES 64
+#define MAX_TEXTURE_PATH 256
+
+/**
+ * Texture in video memory shared by all of its users
+ */
+typedef struct CachedTexture
+{
+    /* GL name (0 = free slot) */
+    GLuint id;
+    int ref_count;
+    int width;
+    int height;
+    /* All mip levels */
+    size_t gpu_bytes;
+    /* Uploaded levels: 1 when the mip chain couldn't be built (no mipmap filter then) */
+    int n_levels;
+    /* FNV-1a hash of the decoded pixels (files with the same image share the texture) */
+    uint64_t content_hash;
+} CachedTexture;
+
+/**
+ * File path of a cached texture (several paths can name the same texture)
+ */
+typedef struct TexturePath
+{
+    char path[MAX_TEXTURE_PATH];
+    /* Slot in the textures array, -1 when the file could not be loaded */
+    int texture;
+} TexturePath;
+
+/**
+ * What a texture is used for; each class has its own size cap
+ */
+typedef enum TextureClass
+{
+    TEXTURE_PAINTING,
+    /* Floor, walls and ceiling */
+    TEXTURE_ROOM,
+    TEXTURE_MODEL,
+    N_TEXTURE_CLASSES
+} TextureClass;
+
+/**
+ * Reference counted textures, deduplicated by path and by content
+ */
+typedef struct TextureCache
+{
+    CachedTexture textures[MAX_CACHED_TEXTURES];
+    TexturePath paths[MAX_CACHED_TEXTURES];
+    int path_count;
+    size_t resident_bytes;
+    /* Trilinear minification (otherwise the full image is sampled bilinearly) */
+    int mipmapping;
+    /* Largest side of the decoded images per class (0 = full size) */
+    int max_size[N_TEXTURE_CLASSES];
+    /* Video memory budget: textures over it leave out their largest mip levels */
+    size_t budget_bytes;
+} TextureCache;
+
+/**
+ * Initialize an empty cache. The size caps and the budget come from the
+ * TEXTURE_MAX_PAINTING, TEXTURE_MAX_ROOM, TEXTURE_MAX_MODEL (pixels) and
+ * TEXTURE_BUDGET_MB environment variables when they are set.
+ */
+void init_texture_cache(TextureCache* cache);
+
+/**
+ * Get the texture of the file with a new reference, decoding and uploading it on
+ * first use with the size cap of the class (a file keeps the cap of its first use).
+ * Returns 0 if the file can't be loaded (the failure is remembered).
+ */
+GLuint acquire_texture(TextureCache* cache, const char* path, TextureClass texture_class);
+
+/**
+ * Acquire the textures of several files (ids[i] for paths[i] of classes[i]). The new
+ * images are decoded on worker threads; the GL thread (the caller) uploads them one
+ * by one as they are finished.
+ */
+void acquire_textures(TextureCache* cache, const char* const* paths, const TextureClass* classes,
+                      int count, GLuint* ids);
+
+/**
+ * Sample the mip levels of all textures (trilinear) or only their full images
+ * (bilinear). The mip levels stay resident either way.
+ */
+void set_texture_mipmapping(TextureCache* cache, int enabled);
+
+/**
+ * Drop a reference; the GL texture is deleted with its last reference.
+ */
+void release_texture(TextureCache* cache, GLuint id);
+
+/**
+ * Total video memory of the live textures in bytes.
+ */
+size_t get_resident_texture_bytes(const TextureCache* cache);
+
+/**
+ * Number of live textures.
+ */
+int get_resident_texture_count(const TextureCache* cache);
+
+#endif /* TEXTURE_CACHE_H */
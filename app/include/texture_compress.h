@@ -0,0 +1,79 @@
+#ifndef TEXTURE_COMPRESS_H
+#define TEXTURE_COMPRESS_H
+
+#include "texture.h"
+
+#include <obj/mapfile.h>
+
+#include <GL/gl.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * S3TC (BC1 / BC3) textures with an on-disk transcode cache.
+ *
+ * The first load of an image encodes its mip chain on the CPU and writes the
+ * blocks to <image>.btex, keyed by the size and the hash of the image file
+ * (and the size cap of the decode).
+ * Later loads map the cache file and upload the blocks straight from the
+ * mapping, without decoding the image.
+ */
+
+/**
+ * Block compressed mip chain
+ */
+typedef struct CompressedTexture
+{
+    /* GL_COMPRESSED_RGB_S3TC_DXT1_EXT (opaque) or GL_COMPRESSED_RGBA_S3TC_DXT5_EXT */
+    GLenum format;
+    int width;
+    int height;
+    int n_levels;
+    /* Hash of the decoded pixels (the same as hash_texture_image()) */
+    uint64_t content_hash;
+    /* The blocks of all levels back to back, in the mapping or in heap memory */
+    const unsigned char* blocks;
+    size_t size;
+    MappedFile file;
+    int is_mapped;
+} CompressedTexture;
+
+/**
+ * Check for S3TC support of the current GL context (call on the GL thread).
+ * The TEXTURE_COMPRESSION environment variable set to 0 disables compression.
+ */
+int is_texture_compression_supported(void);
+
+/**
+ * Map the up to date transcode cache of the image file decoded with the size cap
+ * of load_texture_image(). Returns 0 on a miss.
+ */
+int load_texture_transcode(const char* filename, int max_size, CompressedTexture* texture);
+
+/**
+ * Encode the image and its mip chain (built if missing) to BC1, or to BC3 if
+ * it has transparent pixels. Returns 0 if out of memory.
+ */
+int compress_texture_image(TextureImage* image, uint64_t content_hash, CompressedTexture* texture);
+
+/**
+ * Write the transcode cache of the image file.
+ */
+int save_texture_transcode(const char* filename, int max_size, const CompressedTexture* texture);
+
+/**
+ * Create a trilinear filtered texture from the blocks (0 on error), leaving out
+ * the largest levels while it is over max_bytes.
+ * gpu_bytes receives the size of the texture in video memory and n_levels its
+ * number of uploaded levels (both can be NULL).
+ */
+GLuint upload_compressed_texture(const CompressedTexture* texture, size_t max_bytes, size_t* gpu_bytes,
+                                 int* n_levels);
+
+/**
+ * Release the blocks (or the mapping).
+ */
+void free_compressed_texture(CompressedTexture* texture);
+
+#endif /* TEXTURE_COMPRESS_H */
@@ -1,5 +1,8 @@
 #include "app.h"
 #include "help.h"
+
+#include <obj/gpu_mesh.h>
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -23,6 +26,8 @@ void init_app(App* app, int width, int height)
 
     /* Request a stencil buffer for stencil-outline highlighting. */
     SDL_GL_SetAttribute(SDL_GL_STENCIL_SIZE, 8);
+    /* Destination alpha: the impostor views are cut out by the alpha channel. */
+    SDL_GL_SetAttribute(SDL_GL_ALPHA_SIZE, 8);
 
     app->window = SDL_CreateWindow(
         "Virtual Gallery – Interactive Museum Room",
@@ -62,6 +67,8 @@ void init_app(App* app, int width, int height)
     load_museum_scene(&(app->scene), "assets/config/scene.csv");
 
     app->uptime = (double)SDL_GetTicks() / 1000.0;
+    app->frame_time_sum = 0.0;
+    app->frame_count = 0;
 
     app->is_running = true;
 }
@@ -103,6 +110,8 @@ void init_opengl()
 
     glEnable(GL_COLOR_MATERIAL);
     glColorMaterial(GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE);
+
+    init_gpu_buffers(SDL_GL_GetProcAddress);
 }
 
 static void reshape(App* app, GLsizei width, GLsizei height)
@@ -144,6 +153,17 @@ static void reshape(App* app, GLsizei width, GLsizei height)
     }
 }
 
+/* Print the average frame time since the last report and start a new one. */
+static void report_frame_time(App* app)
+{
+    if (app->frame_count > 0) {
+        printf("Frame time: %.2f ms (average of %d frames)\n",
+               app->frame_time_sum * 1000.0 / app->frame_count, app->frame_count);
+    }
+    app->frame_time_sum = 0.0;
+    app->frame_count = 0;
+}
+
 void handle_app_events(App* app)
 {
     SDL_Event event;
@@ -198,6 +218,29 @@ void handle_app_events(App* app)
                 // Shadows on/off
                 toggle_shadows(&(app->scene));
                 break;
+            case SDL_SCANCODE_I:
+                // Impostor cards for distant statues on/off
+                toggle_impostors(&(app->scene));
+                break;
+            case SDL_SCANCODE_C:
+                // Meshlet (cluster) culling on/off
+                toggle_meshlet_culling(&(app->scene));
+                break;
+            case SDL_SCANCODE_V:
+                // Float / quantized vertices, with the frame time of the previous format
+                report_frame_time(app);
+                cycle_vertex_quantization(&(app->scene));
+                break;
+            case SDL_SCANCODE_M:
+                // Trilinear mipmaps / full size textures, with the frame time of the previous mode
+                report_frame_time(app);
+                toggle_mipmaps(&(app->scene));
+                break;
+            case SDL_SCANCODE_L:
+                // Immediate mode / buffer objects / display lists, with the frame time of the previous path
+                report_frame_time(app);
+                cycle_draw_path(&(app->scene));
+                break;
             case SDL_SCANCODE_B:
                 // Walking head-bob (járás érzet)
                 toggle_walk_bob(&(app->camera));
@@ -302,6 +345,8 @@ void update_app(App* app)
     current_time = (double)SDL_GetTicks() / 1000;
     elapsed_time = current_time - app->uptime;
     app->uptime = current_time;
+    app->frame_time_sum += elapsed_time;
+    app->frame_count++;
 
     update_camera(&(app->camera), elapsed_time);
     update_scene(&(app->scene), elapsed_time);
@@ -336,20 +381,40 @@ void render_app(App* app)
         SDL_GetWindowSize(app->window, &ww, &hh);
 
         const int panel_x = 12;
-        const int panel_y = hh - 72;   // top-left style
-        const int panel_w = 340;
-        const int panel_h = 58;
+        const int panel_y = hh - 142;  // top-left style
+        const int panel_w = 460;
+        const int panel_h = 128;
 
         draw_filled_rect_2d(ww, hh, panel_x, panel_y, panel_w, panel_h, 0.f, 0.f, 0.f, 0.45f);
 
+        // Meshlet culling counters of this frame.
+        const MeshletStats* stats = &app->scene.meshlet_stats;
+        char culled[192];
+        if (app->scene.meshlet_culling_enabled) {
+            // The panel font has no '/' or ',' glyphs.
+            snprintf(culled, sizeof(culled), "Culled clusters: %d of %d (%d back)\nCulled tris: %d of %d",
+                     stats->n_frustum_culled + stats->n_backface_culled, stats->n_meshlets,
+                     stats->n_backface_culled, stats->n_triangles_culled, stats->n_triangles);
+        } else {
+            snprintf(culled, sizeof(culled), "Meshlet culling: off\nC to turn on");
+        }
+        // State changes of the render queue (the skipped ones were already set).
+        const RenderQueueStats* queue_stats = &app->scene.render_queue.stats;
+        const size_t length = strlen(culled);
+        snprintf(culled + length, sizeof(culled) - length, "\nBinds: %d tex %d state (%d saved)\nInstanced: %d in %d draws",
+                 queue_stats->n_texture_binds, queue_stats->n_state_changes, queue_stats->n_skipped,
+                 queue_stats->n_instanced, queue_stats->n_instanced_draws);
+
         if (app->scene.selected_entity >= 0 && app->scene.selected_entity < app->scene.entity_count) {
             const Entity* e = &app->scene.entities[app->scene.selected_entity];
             char buf[256];
-            snprintf(buf, sizeof(buf), "Selected: %s (#%d)\nLMB pick | T anim (statue)",
-                     e->type, app->scene.selected_entity);
+            snprintf(buf, sizeof(buf), "Selected: %s (#%d)\nLMB pick | T anim (statue)\n%s",
+                     e->type, app->scene.selected_entity, culled);
             draw_text_2d(ww, hh, panel_x + 10, panel_y + 10, buf);
         } else {
-            draw_text_2d(ww, hh, panel_x + 10, panel_y + 10, "Click to pick\nObjects will highlight");
+            char buf[256];
+            snprintf(buf, sizeof(buf), "Click to pick\nObjects will highlight\n%s", culled);
+            draw_text_2d(ww, hh, panel_x + 10, panel_y + 10, buf);
         }
     }
 
@@ -359,6 +424,9 @@ void render_app(App* app)
 void destroy_app(App* app)
 {
     if (app->gl_context != NULL) {
+        // The textures have to be deleted while the context is alive.
+        destroy_scene(&(app->scene));
+        release_gpu_instancing();
         SDL_GL_DeleteContext(app->gl_context);
     }
 
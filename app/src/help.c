@@ -15,6 +15,11 @@ void toggle_help(void) {
         printf("B: human mode (walk + eye height)\n");
         printf("+ / - : light intensity (top row or numpad)\n");
         printf("H: shadows on/off\n");
+        printf("I: impostors (distant statues as cards) on/off\n");
+        printf("C: meshlet (cluster) culling on/off\n");
+        printf("V: float / quantized vertices (prints memory and frame time)\n");
+        printf("M: mipmaps on/off (prints frame time)\n");
+        printf("L: immediate / buffer objects / display lists (prints frame time)\n");
         printf("F1: help\n");
         printf("ESC: quit\n");
         printf("===================================\n\n");
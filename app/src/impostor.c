@@ -0,0 +1,158 @@
+#include "impostor.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// 4x4 ordered dither thresholds (Bayer matrix)
+static const int bayer4[4][4] = {
+    {  0,  8,  2, 10 },
+    { 12,  4, 14,  6 },
+    {  3, 11,  1,  9 },
+    { 15,  7, 13,  5 }
+};
+
+int capture_impostor(Impostor* impostor, const float center[3], float radius,
+                     ImpostorDrawFunc draw, void* context)
+{
+    GLint alpha_bits = 0;
+    const int width = IMPOSTOR_TILE_SIZE * IMPOSTOR_VIEWS;
+
+    memset(impostor, 0, sizeof(*impostor));
+
+    // The card's shape comes from the alpha channel of the back buffer.
+    glGetIntegerv(GL_ALPHA_BITS, &alpha_bits);
+    if (alpha_bits == 0 || radius <= 0.0f) {
+        printf("[WARN] Impostor capture needs an alpha buffer; impostors disabled.\n");
+        return 0;
+    }
+
+    glGenTextures(1, &impostor->texture);
+    glBindTexture(GL_TEXTURE_2D, impostor->texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, IMPOSTOR_TILE_SIZE, 0,
+                 GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    glPushAttrib(GL_VIEWPORT_BIT | GL_COLOR_BUFFER_BIT | GL_ENABLE_BIT | GL_LIGHTING_BIT
+                 | GL_CURRENT_BIT | GL_TEXTURE_BIT | GL_STENCIL_BUFFER_BIT);
+    glDisable(GL_STENCIL_TEST);
+    glEnable(GL_DEPTH_TEST);
+    glViewport(0, 0, IMPOSTOR_TILE_SIZE, IMPOSTOR_TILE_SIZE);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    glOrtho(-radius, radius, -radius, radius, -radius, radius);
+
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+
+    for (int k = 0; k < IMPOSTOR_VIEWS; k++) {
+        // Camera on the horizontal circle at azimuth a, looking at the center (Z up),
+        // built the same way as set_view().
+        const float a = 360.0f * (float)k / (float)IMPOSTOR_VIEWS;
+
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glLoadIdentity();
+        glRotatef(-90.0f, 1.0f, 0.0f, 0.0f);
+        glRotatef(-90.0f - a, 0.0f, 0.0f, 1.0f);
+        glTranslatef(-center[0], -center[1], -center[2]);
+
+        draw(context);
+
+        glBindTexture(GL_TEXTURE_2D, impostor->texture);
+        glCopyTexSubImage2D(GL_TEXTURE_2D, 0, k * IMPOSTOR_TILE_SIZE, 0,
+                            0, 0, IMPOSTOR_TILE_SIZE, IMPOSTOR_TILE_SIZE);
+    }
+
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+    glPopAttrib();
+
+    // Don't leave the views in the back buffer for the first frame.
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+    impostor->radius = radius;
+    return 1;
+}
+
+void draw_impostor(const Impostor* impostor, const float center[3], float spin_deg,
+                   const double view[16], float brightness)
+{
+    // Camera position from the view matrix: -R^T * t
+    const double cam_x = -(view[0] * view[12] + view[1] * view[13] + view[2] * view[14]);
+    const double cam_y = -(view[4] * view[12] + view[5] * view[13] + view[6] * view[14]);
+
+    const double azimuth = atan2(cam_y - center[1], cam_x - center[0]);
+    const double step = 2.0 * M_PI / IMPOSTOR_VIEWS;
+    const double relative = azimuth - (double)spin_deg * M_PI / 180.0;
+    int k = (int)floor(relative / step + 0.5) % IMPOSTOR_VIEWS;
+    if (k < 0) k += IMPOSTOR_VIEWS;
+
+    const float r = impostor->radius;
+    const float right_x = (float)-sin(azimuth) * r;
+    const float right_y = (float)cos(azimuth) * r;
+    const float u0 = (float)k / (float)IMPOSTOR_VIEWS;
+    const float u1 = (float)(k + 1) / (float)IMPOSTOR_VIEWS;
+    const float cx = center[0], cy = center[1], cz = center[2];
+
+    glPushAttrib(GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT | GL_CURRENT_BIT);
+
+    // The views already contain the lighting of the scene.
+    glDisable(GL_LIGHTING);
+    glDisable(GL_CULL_FACE);
+    glEnable(GL_TEXTURE_2D);
+    glEnable(GL_ALPHA_TEST);
+    glAlphaFunc(GL_GREATER, 0.5f);
+
+    glBindTexture(GL_TEXTURE_2D, impostor->texture);
+    glColor3f(brightness, brightness, brightness);
+
+    glBegin(GL_QUADS);
+    glTexCoord2f(u0, 0.0f); glVertex3f(cx - right_x, cy - right_y, cz - r);
+    glTexCoord2f(u1, 0.0f); glVertex3f(cx + right_x, cy + right_y, cz - r);
+    glTexCoord2f(u1, 1.0f); glVertex3f(cx + right_x, cy + right_y, cz + r);
+    glTexCoord2f(u0, 1.0f); glVertex3f(cx - right_x, cy - right_y, cz + r);
+    glEnd();
+
+    glPopAttrib();
+}
+
+void enable_impostor_crossfade(float mesh_coverage, int is_card)
+{
+    GLubyte pattern[128];
+    int level = (int)(mesh_coverage * 16.0f + 0.5f);
+    if (level < 0) level = 0;
+    if (level > 16) level = 16;
+
+    // 32x32 bit pattern, 4 bytes per row, most significant bit first.
+    memset(pattern, 0, sizeof(pattern));
+    for (int y = 0; y < 32; y++) {
+        for (int x = 0; x < 32; x++) {
+            const int in_mesh = bayer4[y & 3][x & 3] < level;
+            if (in_mesh != is_card) {
+                pattern[y * 4 + x / 8] |= (GLubyte)(0x80 >> (x % 8));
+            }
+        }
+    }
+    glPolygonStipple(pattern);
+    glEnable(GL_POLYGON_STIPPLE);
+}
+
+void destroy_impostor(Impostor* impostor)
+{
+    if (impostor->texture != 0) {
+        glDeleteTextures(1, &impostor->texture);
+    }
+    memset(impostor, 0, sizeof(*impostor));
+}
@@ -0,0 +1,123 @@
+#include "model_registry.h"
+
+#include <obj/draw.h>
+#include <obj/glb.h>
+#include <obj/gpu_mesh.h>
+#include <obj/load.h>
+
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void compute_model_bounds(SharedModel* shared)
+{
+    const Model* m = &shared->model;
+
+    if (!m->mesh_vertices || m->n_mesh_vertices <= 0) {
+        shared->bounds_center.x = shared->bounds_center.y = shared->bounds_center.z = 0.0f;
+        shared->bounds_radius = 1.0f;
+        shared->bounds_min_z = 0.0f;
+        return;
+    }
+
+    float minx = m->mesh_vertices[0].position[0], maxx = m->mesh_vertices[0].position[0];
+    float miny = m->mesh_vertices[0].position[1], maxy = m->mesh_vertices[0].position[1];
+    float minz = m->mesh_vertices[0].position[2], maxz = m->mesh_vertices[0].position[2];
+
+    for (int i = 1; i < m->n_mesh_vertices; i++) {
+        const float x = m->mesh_vertices[i].position[0];
+        const float y = m->mesh_vertices[i].position[1];
+        const float z = m->mesh_vertices[i].position[2];
+        if (x < minx) { minx = x; }
+        if (x > maxx) { maxx = x; }
+
+        if (y < miny) { miny = y; }
+        if (y > maxy) { maxy = y; }
+
+        if (z < minz) { minz = z; }
+        if (z > maxz) { maxz = z; }
+    }
+
+    shared->bounds_center.x = (minx + maxx) * 0.5f;
+    shared->bounds_center.y = (miny + maxy) * 0.5f;
+    shared->bounds_center.z = (minz + maxz) * 0.5f;
+
+    const float dx = (maxx - minx);
+    const float dy = (maxy - miny);
+    const float dz = (maxz - minz);
+    shared->bounds_radius = 0.5f * sqrtf(dx*dx + dy*dy + dz*dz);
+    if (shared->bounds_radius < 0.001f) shared->bounds_radius = 0.001f;
+    shared->bounds_min_z = minz;
+}
+
+// The loader is chosen by the extension of the model path (.glb, otherwise OBJ).
+static int load_model_file(Model* model, const char* path)
+{
+    const char* ext = strrchr(path, '.');
+    if (ext != NULL && tolower((unsigned char)ext[1]) == 'g' && tolower((unsigned char)ext[2]) == 'l'
+        && tolower((unsigned char)ext[3]) == 'b' && ext[4] == 0) {
+        return load_glb_model(model, path);
+    }
+    return load_model(model, path);
+}
+
+void init_model_registry(ModelRegistry* registry)
+{
+    memset(registry, 0, sizeof(*registry));
+}
+
+SharedModel* acquire_model(ModelRegistry* registry, const char* path)
+{
+    for (int i = 0; i < registry->model_count; i++) {
+        SharedModel* shared = registry->models[i];
+        if (strcmp(shared->path, path) == 0) {
+            shared->ref_count++;
+            return shared;
+        }
+    }
+    if (registry->model_count >= MAX_SHARED_MODELS) {
+        printf("[ERROR] Too many distinct models (max %d): %s\n", MAX_SHARED_MODELS, path);
+        return NULL;
+    }
+
+    SharedModel* shared = (SharedModel*)calloc(1, sizeof(SharedModel));
+    if (!shared) {
+        return NULL;
+    }
+    strncpy(shared->path, path, sizeof(shared->path) - 1);
+    shared->ref_count = 1;
+    shared->id = registry->next_id++;
+    init_model(&shared->model);
+    if (!load_model_file(&shared->model, path)) {
+        printf("[WARN] Model '%s' could not be loaded, it stays empty\n", path);
+    } else {
+        if (is_gpu_buffers_enabled() && !upload_model_buffers(&shared->model)) {
+            printf("[WARN] Model '%s' is drawn in immediate mode (no buffer objects)\n", path);
+        }
+        if (!compile_model_lists(&shared->model)) {
+            printf("[WARN] Model '%s' has no display lists\n", path);
+        }
+    }
+    compute_model_bounds(shared);
+    registry->models[registry->model_count++] = shared;
+    return shared;
+}
+
+void release_model(ModelRegistry* registry, SharedModel* shared)
+{
+    if (!shared || --shared->ref_count > 0) {
+        return;
+    }
+    for (int i = 0; i < registry->model_count; i++) {
+        if (registry->models[i] == shared) {
+            registry->models[i] = registry->models[--registry->model_count];
+            break;
+        }
+    }
+    release_model_buffers(&shared->model);
+    release_model_lists(&shared->model);
+    free_model(&shared->model);
+    free(shared);
+}
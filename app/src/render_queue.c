@@ -0,0 +1,146 @@
+#include "render_queue.h"
+
+#include <string.h>
+
+#define PASS_SHIFT 62
+#define MESH_SHIFT 52
+#define LEVEL_SHIFT 49
+#define TWO_SIDED_SHIFT 48
+#define TEXTURE_SHIFT 32
+#define OPAQUE_DEPTH_SHIFT 8
+#define TRANSPARENT_DEPTH_SHIFT 38
+#define DEPTH_MASK 0xFFFFFFu
+#define TEXTURE_MASK 0xFFFFu
+#define LEVEL_MASK 0x7u
+
+void reset_render_queue(RenderQueue* queue)
+{
+    queue->count = 0;
+    memset(&queue->stats, 0, sizeof(queue->stats));
+    invalidate_queue_state(queue);
+}
+
+/**
+ * Depth as 24 bits that keep the order: the bits of a non-negative float grow
+ * with its value, the top 24 of them are the exponent and 16 mantissa bits.
+ */
+static uint64_t quantize_depth(float depth)
+{
+    uint32_t bits;
+
+    if (!(depth > 0.0f)) {
+        depth = 0.0f;
+    }
+    memcpy(&bits, &depth, sizeof(bits));
+    return (uint64_t)((bits >> 7) & DEPTH_MASK);
+}
+
+uint64_t make_opaque_sort_key(int mesh, int level, GLuint texture, int two_sided, float depth)
+{
+    // The mesh numbers wrap: a collision only interleaves two groups, the batches compare the meshes.
+    const uint64_t mesh_bits = (mesh == RENDER_NO_MESH) ? RENDER_NO_MESH : (unsigned)mesh % RENDER_NO_MESH;
+    const uint64_t texture_bits = (texture < TEXTURE_MASK) ? texture : TEXTURE_MASK;
+
+    return ((uint64_t)RENDER_PASS_OPAQUE << PASS_SHIFT)
+           | (mesh_bits << MESH_SHIFT)
+           | ((uint64_t)((unsigned)level & LEVEL_MASK) << LEVEL_SHIFT)
+           | (texture_bits << TEXTURE_SHIFT)
+           | ((uint64_t)(two_sided ? 1 : 0) << TWO_SIDED_SHIFT)
+           | (quantize_depth(depth) << OPAQUE_DEPTH_SHIFT);
+}
+
+uint64_t make_transparent_sort_key(float depth)
+{
+    return ((uint64_t)RENDER_PASS_TRANSPARENT << PASS_SHIFT)
+           | ((DEPTH_MASK - quantize_depth(depth)) << TRANSPARENT_DEPTH_SHIFT);
+}
+
+RenderPass get_sort_key_pass(uint64_t key)
+{
+    return (RenderPass)(key >> PASS_SHIFT);
+}
+
+int push_render_item(RenderQueue* queue, uint64_t key, int index)
+{
+    if (queue->count >= MAX_RENDER_ITEMS) {
+        return 0;
+    }
+    queue->items[queue->count].key = key;
+    queue->items[queue->count].index = index;
+    queue->count++;
+    queue->stats.n_items = queue->count;
+    return 1;
+}
+
+void sort_render_queue(RenderQueue* queue)
+{
+    RenderItem* source = queue->items;
+    RenderItem* target = queue->scratch;
+    const int n = queue->count;
+
+    // LSD radix sort on 8 bit digits; a digit that is the same in all keys
+    // (most of them: the key has unused and constant fields) is skipped.
+    for (int shift = 0; shift < 64; shift += 8) {
+        int offsets[256] = {0};
+        for (int i = 0; i < n; i++) {
+            offsets[(source[i].key >> shift) & 0xFF]++;
+        }
+        if (n == 0 || offsets[(source[0].key >> shift) & 0xFF] == n) {
+            continue;
+        }
+        int sum = 0;
+        for (int d = 0; d < 256; d++) {
+            const int count = offsets[d];
+            offsets[d] = sum;
+            sum += count;
+        }
+        for (int i = 0; i < n; i++) {
+            target[offsets[(source[i].key >> shift) & 0xFF]++] = source[i];
+        }
+        RenderItem* swap = source;
+        source = target;
+        target = swap;
+    }
+    if (source != queue->items) {
+        memcpy(queue->items, source, (size_t)n * sizeof(RenderItem));
+    }
+}
+
+void bind_queue_texture(RenderQueue* queue, GLuint texture)
+{
+    if (queue->is_texture_known && queue->texture == texture) {
+        queue->stats.n_skipped++;
+        return;
+    }
+    glBindTexture(GL_TEXTURE_2D, texture);
+    set_queue_texture(queue, texture);
+    queue->stats.n_texture_binds++;
+}
+
+void set_queue_texture(RenderQueue* queue, GLuint texture)
+{
+    queue->texture = texture;
+    queue->is_texture_known = 1;
+}
+
+void set_queue_cull_face(RenderQueue* queue, int enabled)
+{
+    enabled = enabled ? 1 : 0;
+    if (queue->cull_face == enabled) {
+        queue->stats.n_skipped++;
+        return;
+    }
+    if (enabled) {
+        glEnable(GL_CULL_FACE);
+    } else {
+        glDisable(GL_CULL_FACE);
+    }
+    queue->cull_face = enabled;
+    queue->stats.n_state_changes++;
+}
+
+void invalidate_queue_state(RenderQueue* queue)
+{
+    queue->is_texture_known = 0;
+    queue->cull_face = -1;
+}
@@ -1,8 +1,9 @@
 #include "scene.h"
 #include "csv.h"
 
-#include <obj/load.h>
 #include <obj/draw.h>
+#include <obj/gpu_mesh.h>
+#include <obj/quantize.h>
 
 #include <string.h>
 #include <stdio.h>
@@ -14,56 +15,6 @@
 #define M_PI 3.14159265358979323846
 #endif
 
-static void compute_model_bounds_sphere(const Model* m, vec3* out_center, float* out_radius)
-{
-    if (!m || !m->vertices || m->n_vertices <= 0) {
-        out_center->x = out_center->y = out_center->z = 0.0f;
-        *out_radius = 1.0f;
-        return;
-    }
-
-    float minx = m->vertices[0].x, maxx = m->vertices[0].x;
-    float miny = m->vertices[0].y, maxy = m->vertices[0].y;
-    float minz = m->vertices[0].z, maxz = m->vertices[0].z;
-
-    for (int i = 1; i < m->n_vertices; i++) {
-        const float x = m->vertices[i].x;
-        const float y = m->vertices[i].y;
-        const float z = m->vertices[i].z;
-        if (x < minx) { minx = x; }
-        if (x > maxx) { maxx = x; }
-
-        if (y < miny) { miny = y; }
-        if (y > maxy) { maxy = y; }
-
-        if (z < minz) { minz = z; }
-        if (z > maxz) { maxz = z; }
-    }
-
-    out_center->x = (minx + maxx) * 0.5f;
-    out_center->y = (miny + maxy) * 0.5f;
-    out_center->z = (minz + maxz) * 0.5f;
-
-    const float dx = (maxx - minx);
-    const float dy = (maxy - miny);
-    const float dz = (maxz - minz);
-    *out_radius = 0.5f * sqrtf(dx*dx + dy*dy + dz*dz);
-    if (*out_radius < 0.001f) *out_radius = 0.001f;
-}
-
-static float compute_model_min_z(const Model* m)
-{
-    if (!m || !m->vertices || m->n_vertices <= 0) {
-        return 0.0f;
-    }
-    float minz = m->vertices[0].z;
-    for (int i = 1; i < m->n_vertices; i++) {
-        const float z = m->vertices[i].z;
-        if (z < minz) minz = z;
-    }
-    return minz;
-}
-
 // Z-up világ: X=bal/jobb, Y=előre/hátra, Z=felfelé (összhangban camera.c-vel)
 // A korábbi verzió falait forgatásokkal rajzoltuk. Az gyakorlatban néha "lyukas szobát"
 // eredményezett (egyes falak a kamera szögétől függően eltűntek / belógtak).
@@ -81,7 +32,25 @@ static void draw_room_world_quads(GLuint floor_tex, GLuint wall_tex, GLuint ceil
 static void draw_debug_axes_and_marker(void);
 #endif
 
-static void apply_transform(const Entity* e)
+/* Level of detail: below this projected bounding sphere diameter (pixels) the
+   first reduced level is used; every further level halves the size. */
+#define LOD_SWITCH_PIXELS 480.0f
+/* Relative margin around the switch sizes, so levels don't flicker at the boundary. */
+#define LOD_HYSTERESIS 0.15f
+/* Levels of at most this many meshlets are drawn instanced even with meshlet culling on */
+#define INSTANCING_MAX_MESHLETS 4
+
+/* Default impostor switch size (projected diameter, pixels) and the relative
+   width of the crossfade band around it. */
+#define IMPOSTOR_DEFAULT_PIXELS 64.0f
+#define IMPOSTOR_FADE_BAND 0.25f
+
+static void rotate_point_xyz_deg(double p[3], float rx, float ry, float rz);
+static void mult_mat4_mat4(const double a[16], const double b[16], double out[16]);
+
+// Placement of the entity in float model space (bounds, proxies), without the
+// dequantization of apply_transform().
+static void apply_entity_transform(const Entity* e)
 {
     // If the entity has auto-grounding enabled (e.g., imported statues),
     // we add a per-entity Z offset so the model's local min-Z sits on the
@@ -95,15 +64,96 @@ static void apply_transform(const Entity* e)
     glScalef(e->sx, e->sy, e->sz);
 }
 
+// Quantized vertices: their dequantization is part of the model transform.
+static void apply_dequantization(const Entity* e)
+{
+    if (e->mesh->model.quantized_vertices != NULL) {
+        float dequantization[16];
+        get_dequantization_matrix(&e->mesh->model, dequantization);
+        glMultMatrixf(dequantization);
+    }
+}
+
+// Transform of the vertices of the entity mesh.
+static void apply_transform(const Entity* e)
+{
+    apply_entity_transform(e);
+    apply_dequantization(e);
+}
+
+// The matrix of apply_transform() built on the CPU (column major), for the instanced
+// draws, or without the dequantization for the float vertices (static batches).
+static void build_entity_transform(const Entity* e, int dequantize, float out[16])
+{
+    const double angles[3] = {
+        degree_to_radian(e->rx), degree_to_radian(e->ry), degree_to_radian(e->rz)
+    };
+    double m[16] = {
+        1.0, 0.0, 0.0, 0.0,
+        0.0, 1.0, 0.0, 0.0,
+        0.0, 0.0, 1.0, 0.0,
+        e->px, e->py, e->pz + e->ground_offset_z, 1.0
+    };
+    double r[16], product[16];
+
+    // glRotatef around X, then Y, then Z: a rotation in the plane of the two other axes.
+    for (int axis = 0; axis < 3; axis++) {
+        const int u = (axis + 1) % 3, v = (axis + 2) % 3;
+        const double c = cos(angles[axis]), s = sin(angles[axis]);
+        memset(r, 0, sizeof(r));
+        r[0] = r[5] = r[10] = r[15] = 1.0;
+        r[u*4 + u] = c;
+        r[v*4 + u] = -s;
+        r[u*4 + v] = s;
+        r[v*4 + v] = c;
+        mult_mat4_mat4(m, r, product);
+        memcpy(m, product, sizeof(m));
+    }
+    const double scale[3] = { e->sx, e->sy, e->sz };
+    for (int col = 0; col < 3; col++) {
+        for (int row = 0; row < 4; row++) {
+            m[col*4 + row] *= scale[col];
+        }
+    }
+
+    // Quantized vertices: their dequantization is part of the model transform.
+    if (dequantize && e->mesh->model.quantized_vertices != NULL) {
+        float dequantization[16];
+        get_dequantization_matrix(&e->mesh->model, dequantization);
+        for (int k = 0; k < 16; k++) {
+            r[k] = dequantization[k];
+        }
+        mult_mat4_mat4(m, r, product);
+        memcpy(m, product, sizeof(m));
+    }
+    for (int k = 0; k < 16; k++) {
+        out[k] = (float)m[k];
+    }
+}
+
+// World-space bounding sphere of the entity.
+static void entity_world_sphere(const Entity* e, double c[3], double* r)
+{
+    // world center = T + R * (S * local_center), as in pick_entity()
+    c[0] = e->mesh->bounds_center.x * e->sx;
+    c[1] = e->mesh->bounds_center.y * e->sy;
+    c[2] = e->mesh->bounds_center.z * e->sz;
+    rotate_point_xyz_deg(c, e->rx, e->ry, e->rz);
+    c[0] += e->px; c[1] += e->py; c[2] += e->pz + e->ground_offset_z;
+
+    const double smax = fmax(fmax(fabs(e->sx), fabs(e->sy)), fabs(e->sz));
+    *r = (double)e->mesh->bounds_radius * smax;
+}
+
 static void draw_shadow_proxy_circle(const Entity* e)
 {
     // Fast shadow proxy (triangle fan) to avoid drawing high-poly models
     // multiple times in the shadow pass.
     const int SEG = 24;
-    const float r = e->bounds_radius_local;
-    const float cx = e->bounds_center_local.x;
-    const float cy = e->bounds_center_local.y;
-    const float z  = e->bounds_min_z_local + 0.002f;
+    const float r = e->mesh->bounds_radius;
+    const float cx = e->mesh->bounds_center.x;
+    const float cy = e->mesh->bounds_center.y;
+    const float z  = e->mesh->bounds_min_z + 0.002f;
 
     glBegin(GL_TRIANGLE_FAN);
     glVertex3f(cx, cy, z);
@@ -232,12 +282,19 @@ static void set_material(const Material* material)
 void init_scene(Scene* scene)
 {
     memset(scene, 0, sizeof(*scene));
+    init_model_registry(&scene->models);
+    init_texture_cache(&scene->textures);
+    init_static_geometry(&scene->static_geometry);
     scene->entity_count = 0;
     scene->light_intensity = 1.0f;
     scene->time_sec = 0.0;
     scene->animation_enabled = 1;
     scene->selected_entity = -1;
     scene->shadows_enabled = 1;
+    scene->impostors_enabled = 1;
+    scene->impostor_pixels = IMPOSTOR_DEFAULT_PIXELS;
+    scene->meshlet_culling_enabled = 1;
+    scene->mipmaps_enabled = 1;
 
     // anyag (maradhat MVP-ben közös mindenkire)
     scene->material.ambient.red = 0.0f;
@@ -254,10 +311,24 @@ void init_scene(Scene* scene)
 
     scene->material.shininess = 100.0;
 
-    scene->floor_tex = load_texture("assets/textures/floor.jpg");
     // Use JPG textures to avoid libpng DLL issues on some MinGW/SDL2_image setups.
-    scene->wall_tex  = load_texture("assets/textures/wall.jpg");
-    scene->ceiling_tex = load_texture("assets/textures/ceiling.jpg");
+    const char* room_textures[3] = {
+        "assets/textures/floor.jpg", "assets/textures/wall.jpg", "assets/textures/ceiling.jpg"
+    };
+    const TextureClass room_classes[3] = { TEXTURE_ROOM, TEXTURE_ROOM, TEXTURE_ROOM };
+    GLuint room_ids[3];
+    acquire_textures(&scene->textures, room_textures, room_classes, 3, room_ids);
+    scene->floor_tex = room_ids[0];
+    scene->wall_tex = room_ids[1];
+    scene->ceiling_tex = room_ids[2];
+
+    // The room never changes: its quads are replayed from one list on the display list path.
+    scene->room_list = glGenLists(1);
+    if (scene->room_list != 0) {
+        glNewList(scene->room_list, GL_COMPILE);
+        draw_room_world_quads(scene->floor_tex, scene->wall_tex, scene->ceiling_tex);
+        glEndList();
+    }
     // Festmények már a scene.csv-ből jönnek (plane.obj + painting*.jpg)
 }
 
@@ -267,6 +338,109 @@ void toggle_shadows(Scene* scene)
     printf("Shadows: %s\n", scene->shadows_enabled ? "ON" : "OFF");
 }
 
+void toggle_impostors(Scene* scene)
+{
+    scene->impostors_enabled = !scene->impostors_enabled;
+    printf("Impostors: %s\n", scene->impostors_enabled ? "ON" : "OFF");
+}
+
+void toggle_meshlet_culling(Scene* scene)
+{
+    scene->meshlet_culling_enabled = !scene->meshlet_culling_enabled;
+    printf("Meshlet culling: %s\n", scene->meshlet_culling_enabled ? "ON" : "OFF");
+}
+
+void toggle_mipmaps(Scene* scene)
+{
+    scene->mipmaps_enabled = !scene->mipmaps_enabled;
+    set_texture_mipmapping(&scene->textures, scene->mipmaps_enabled);
+    printf("Mipmaps: %s\n", scene->mipmaps_enabled ? "ON" : "OFF");
+}
+
+void cycle_draw_path(Scene* scene)
+{
+    static const char* names[] = { "immediate mode", "vertex buffer objects", "display lists" };
+    DrawPath path = get_draw_path();
+
+    (void)scene;
+    // immediate -> buffers (when available) -> display lists -> immediate
+    if (path == DRAW_PATH_IMMEDIATE) {
+        path = is_gpu_buffers_enabled() ? DRAW_PATH_BUFFERS : DRAW_PATH_DISPLAY_LISTS;
+    } else if (path == DRAW_PATH_BUFFERS) {
+        path = DRAW_PATH_DISPLAY_LISTS;
+    } else {
+        path = DRAW_PATH_IMMEDIATE;
+    }
+    set_draw_path(path);
+    printf("Render path: %s\n", names[path]);
+}
+
+/**
+ * Vertex memory of the shared models: the arrays on the CPU side (the float
+ * vertices stay next to the quantized copy) and the uploaded vertex buffers.
+ */
+static void get_scene_vertex_sizes(const Scene* scene, size_t* cpu_size, size_t* gpu_size)
+{
+    *cpu_size = 0;
+    *gpu_size = 0;
+    for (int i = 0; i < scene->models.model_count; i++) {
+        const Model* model = &scene->models.models[i]->model;
+        *cpu_size += (size_t)model->n_mesh_vertices * sizeof(MeshVertex);
+        if (model->quantized_vertices != NULL) {
+            *cpu_size += get_vertex_data_size(model);
+        }
+        *gpu_size += get_model_vertex_buffer_size(model);
+    }
+}
+
+void cycle_vertex_quantization(Scene* scene)
+{
+    size_t cpu_before;
+    size_t gpu_before;
+    get_scene_vertex_sizes(scene, &cpu_before, &gpu_before);
+
+    // float -> 2x8 bit normals -> 2x16 bit normals -> float
+    if (scene->vertex_normal_bits == 0) {
+        scene->vertex_normal_bits = 8;
+    } else if (scene->vertex_normal_bits == 8) {
+        scene->vertex_normal_bits = 16;
+    } else {
+        scene->vertex_normal_bits = 0;
+    }
+    // Once per shared model: the entities of the same file switch together.
+    for (int i = 0; i < scene->models.model_count; i++) {
+        SharedModel* shared = scene->models.models[i];
+        if (scene->vertex_normal_bits == 0) {
+            free_quantized_vertices(&shared->model);
+        } else if (!quantize_model(&shared->model, scene->vertex_normal_bits)) {
+            printf("[WARN] Unable to quantize the vertices of '%s'\n", shared->path);
+        }
+        // The buffers and the lists hold the previous vertex format until they are rebuilt.
+        if (is_gpu_buffers_enabled()) {
+            upload_model_buffers(&shared->model);
+        }
+        compile_model_lists(&shared->model);
+    }
+
+    if (scene->vertex_normal_bits == 0) {
+        printf("Vertices: float\n");
+    } else {
+        printf("Vertices: quantized (2x%d bit normals)\n", scene->vertex_normal_bits);
+    }
+    size_t cpu_after;
+    size_t gpu_after;
+    get_scene_vertex_sizes(scene, &cpu_after, &gpu_after);
+    if (gpu_before > 0 || gpu_after > 0) {
+        printf("Vertex buffers (GPU): %.1f KB -> %.1f KB\n", gpu_before / 1024.0, gpu_after / 1024.0);
+    }
+    printf("Vertex arrays (CPU, float + quantized): %.1f KB -> %.1f KB\n", cpu_before / 1024.0, cpu_after / 1024.0);
+}
+
+void set_impostor_threshold(Scene* scene, float pixels)
+{
+    scene->impostor_pixels = (pixels > 0.0f) ? pixels : 0.0f;
+}
+
 static void build_shadow_matrix(float out[16], const float plane[4], const float light[4])
 {
     // Classic planar shadow projection matrix.
@@ -316,31 +490,72 @@ static int entity_is_transparent(const Entity* e)
     return (strcmp(e->type, "case_glass") == 0);
 }
 
-static void draw_entity_opaque(const Entity* e)
+// Meshlets outside the frustum are skipped. Back facing meshlets are only
+// skipped for closed meshes with a uniform scale: statues are drawn two-sided.
+static void draw_entity_meshlets(const Entity* e, MeshletStats* stats)
+{
+    float modelview[16], projection[16];
+    MeshletCuller culler;
+
+    glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+    glGetFloatv(GL_PROJECTION_MATRIX, projection);
+    // The meshlet bounds are in the float model space.
+    remove_dequantization(&e->mesh->model, modelview);
+    const int cone_culling = strcmp(e->type, "statue") != 0
+                             && e->sx == e->sy && e->sy == e->sz;
+    init_meshlet_culler(&culler, modelview, projection, cone_culling);
+    draw_model_culled(&e->mesh->model, e->lod_level, &culler, stats);
+}
+
+// Statues are drawn two-sided: some imported OBJ models have inconsistent
+// winding / normals, which looks like "holes" (missing triangles) with
+// backface culling enabled.
+static int entity_is_two_sided(const Entity* e)
+{
+    return strcmp(e->type, "statue") == 0;
+}
+
+// Mesh of an opaque entity: the texture, the cull mode, blending and the
+// white color are set by the caller.
+// stats: meshlet culling counters, NULL draws the whole model (impostor capture).
+static void draw_entity_mesh(const Entity* e, MeshletStats* stats)
+{
+    glPushMatrix();
+    apply_transform(e);
+
+    // The materials of the model change the color and the specular terms.
+    const int has_materials = (e->mesh->model.n_materials > 0);
+    if (has_materials) {
+        glPushAttrib(GL_LIGHTING_BIT | GL_CURRENT_BIT);
+    }
+    if (stats != NULL) {
+        draw_entity_meshlets(e, stats);
+    } else {
+        draw_model_materials(&e->mesh->model, e->lod_level);
+    }
+    if (has_materials) {
+        glPopAttrib();
+    }
+    glPopMatrix();
+}
+
+// Single opaque entity with all of its state (outside of the render queue).
+static void draw_entity_opaque(const Entity* e, MeshletStats* stats)
 {
     // Safety: glass/blending pass must not leak state into opaque rendering.
     glDisable(GL_BLEND);
     glDepthMask(GL_TRUE);
     glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
-
-    glPushMatrix();
-    apply_transform(e);
     glBindTexture(GL_TEXTURE_2D, e->texture_id);
-    glColor3f(1.0f, 1.0f, 1.0f);
 
-    // Some imported OBJ models have inconsistent winding / normals.
-    // With backface culling enabled this can look like "holes" (missing triangles).
-    // For statues we draw two-sided to avoid that artifact.
-    GLboolean cull_was_enabled = glIsEnabled(GL_CULL_FACE);
-    if (strcmp(e->type, "statue") == 0) {
+    if (entity_is_two_sided(e)) {
+        glPushAttrib(GL_ENABLE_BIT);
         glDisable(GL_CULL_FACE);
     }
-    draw_model((Model*)&e->model);
-
-    if (strcmp(e->type, "statue") == 0 && cull_was_enabled) {
-        glEnable(GL_CULL_FACE);
+    draw_entity_mesh(e, stats);
+    if (entity_is_two_sided(e)) {
+        glPopAttrib();
     }
-    glPopMatrix();
 }
 
 static int find_nearest_pedestal(const Scene* scene, const Entity* statue)
@@ -361,7 +576,7 @@ static int find_nearest_pedestal(const Scene* scene, const Entity* statue)
     return best;
 }
 
-static void draw_entity_glass(const Entity* e)
+static void begin_glass_pass(void)
 {
     // Transparent "vitrine" glass.
     // Key points (fixed pipeline):
@@ -395,12 +610,19 @@ static void draw_entity_glass(const Entity* e)
     glMaterialf(GL_FRONT_AND_BACK, GL_SHININESS, 96.0f);
 
     glColor4f(1.0f, 1.0f, 1.0f, a);
+}
 
+// Glass entity inside begin_glass_pass() / end_glass_pass().
+static void draw_glass_mesh(const Entity* e)
+{
     glPushMatrix();
     apply_transform(e);
-    draw_model((Model*)&e->model);
+    draw_model_lod(&e->mesh->model, e->lod_level);
     glPopMatrix();
+}
 
+static void end_glass_pass(void)
+{
     // Reset emission so it doesn't "stick" to later materials.
     {
         float emi0[] = {0.0f, 0.0f, 0.0f, 1.0f};
@@ -411,6 +633,13 @@ static void draw_entity_glass(const Entity* e)
     glPopAttrib();
 }
 
+static void draw_entity_glass(const Entity* e)
+{
+    begin_glass_pass();
+    draw_glass_mesh(e);
+    end_glass_pass();
+}
+
 static void render_planar_shadows(const Scene* scene)
 {
     // Collect up to 3 lamps from scene.csv.
@@ -500,13 +729,16 @@ static void render_planar_shadows(const Scene* scene)
             glPushMatrix();
             glMultMatrixf(m);
             glTranslatef(0.0f, 0.0f, 0.0030f);
-            apply_transform(e);
+            apply_entity_transform(e);
             // Use full projected geometry for most objects.
-            // Only fall back to a cheap circular proxy for extremely high-poly meshes.
-            if (e->model.n_vertices > 50000) {
+            // Only fall back to a cheap circular proxy for extremely high-poly meshes
+            // (its circle is in float model space, without the dequantization).
+            // The flat shadow hides detail: it uses one level coarser than the model.
+            if (e->mesh->model.n_mesh_vertices > 50000) {
                 draw_shadow_proxy_circle(e);
             } else {
-                draw_model((Model*)&e->model);
+                apply_dequantization(e);
+                draw_model_lod(&e->mesh->model, e->lod_level + 1);
             }
             glPopMatrix();
         }
@@ -526,10 +758,24 @@ void toggle_animation(Scene* scene)
 void destroy_scene(Scene* scene)
 {
     for (int i = 0; i < scene->entity_count; i++) {
-        free_model(&scene->entities[i].model);
-        // ha van texture delete függvényed: glDeleteTextures(1, &scene->entities[i].texture_id);
+        release_model(&scene->models, scene->entities[i].mesh);
+        scene->entities[i].mesh = NULL;
+        destroy_impostor(&scene->entities[i].impostor);
+        release_texture(&scene->textures, scene->entities[i].texture_id);
+        scene->entities[i].texture_id = 0;
     }
     scene->entity_count = 0;
+    destroy_static_geometry(&scene->static_geometry);
+
+    // The room textures are acquired by init_scene().
+    release_texture(&scene->textures, scene->floor_tex);
+    release_texture(&scene->textures, scene->wall_tex);
+    release_texture(&scene->textures, scene->ceiling_tex);
+    scene->floor_tex = scene->wall_tex = scene->ceiling_tex = 0;
+    if (scene->room_list != 0) {
+        glDeleteLists(scene->room_list, 1);
+        scene->room_list = 0;
+    }
 }
 
 void change_light(Scene* scene, float delta)
@@ -541,6 +787,73 @@ void change_light(Scene* scene, float delta)
     printf("Light intensity: %.2f\n", scene->light_intensity);
 }
 
+static int entity_has_impostor(const Entity* e)
+{
+    return strcmp(e->type, "statue") == 0 || strcmp(e->type, "duck") == 0;
+}
+
+typedef struct ImpostorCapture
+{
+    const Scene* scene;
+    const Entity* entity;
+} ImpostorCapture;
+
+static void draw_impostor_view(void* context)
+{
+    const ImpostorCapture* capture = (const ImpostorCapture*)context;
+
+    // Lights are placed with the capture view, the same way as in render_scene().
+    set_material(&capture->scene->material);
+    set_lighting_with_intensity(capture->scene);
+    glEnable(GL_LIGHTING);
+    glEnable(GL_TEXTURE_2D);
+    draw_entity_opaque(capture->entity, NULL);
+}
+
+// Render the impostor views of the statues (needs the final positions).
+// The views are taken around the world Z axis, which is the spin axis of the
+// statues as long as they are not tilted (rx = ry = 0).
+static void build_impostors(Scene* scene)
+{
+    for (int i = 0; i < scene->entity_count; i++) {
+        Entity* e = &scene->entities[i];
+        if (!entity_has_impostor(e) || e->mesh->model.n_mesh_vertices == 0) continue;
+
+        double c[3], r;
+        entity_world_sphere(e, c, &r);
+        const float center[3] = { (float)c[0], (float)c[1], (float)c[2] };
+
+        ImpostorCapture capture = { scene, e };
+        if (!capture_impostor(&e->impostor, center, (float)r, draw_impostor_view, &capture)) {
+            break;
+        }
+        e->impostor.captured_rz = e->rz;
+        e->impostor.captured_light = scene->light_intensity;
+    }
+}
+
+// Merge the entities that never move into world space batches (needs the final positions).
+// The animated statues and the entities with impostors (their level of detail and
+// their card change every frame) stay on the per-entity path.
+static void build_static_batches(Scene* scene)
+{
+    StaticInstance instances[MAX_ENTITIES];
+
+    for (int i = 0; i < scene->entity_count; i++) {
+        const Entity* e = &scene->entities[i];
+        memset(&instances[i], 0, sizeof(instances[i]));
+        if (e->animated || entity_has_impostor(e)) continue;
+        instances[i].model = &e->mesh->model;
+        build_entity_transform(e, 0, instances[i].transform);
+        instances[i].texture = e->texture_id;
+        instances[i].is_transparent = entity_is_transparent(e);
+    }
+    if (build_static_geometry(&scene->static_geometry, instances, scene->entity_count)) {
+        printf("Static batches: %d draws for %d entities (%d triangles)\n", scene->static_geometry.n_batches,
+               scene->static_geometry.n_merged, scene->static_geometry.model.n_triangles);
+    }
+}
+
 void load_museum_scene(Scene* scene, const char* scene_csv_path)
 {
 
@@ -554,6 +867,9 @@ void load_museum_scene(Scene* scene, const char* scene_csv_path)
     }
 
     SceneRow rows[MAX_ENTITIES];
+    const char* texture_paths[MAX_ENTITIES];
+    TextureClass texture_classes[MAX_ENTITIES];
+    GLuint texture_ids[MAX_ENTITIES];
     size_t count = 0;
 
     if (!load_scene_csv(scene_csv_path, rows, MAX_ENTITIES, &count)) {
@@ -566,9 +882,15 @@ void load_museum_scene(Scene* scene, const char* scene_csv_path)
     for (size_t i = 0; i < count; i++) {
         if (scene->entity_count >= MAX_ENTITIES) break;
 
-        Entity* e = &scene->entities[scene->entity_count++];
+        Entity* e = &scene->entities[scene->entity_count];
         memset(e, 0, sizeof(*e));
 
+        e->mesh = acquire_model(&scene->models, rows[i].model);
+        if (!e->mesh) {
+            continue;
+        }
+        scene->entity_count++;
+
         strncpy(e->type, rows[i].type, sizeof(e->type) - 1);
 
         e->px = rows[i].px; e->py = rows[i].py; e->pz = rows[i].pz;
@@ -579,8 +901,6 @@ void load_museum_scene(Scene* scene, const char* scene_csv_path)
         // Z-up world: we spin statues around Z (yaw), so seed animation from rz.
         e->anim_angle_deg = e->rz;
 
-        load_model(&e->model, rows[i].model);
-
         // Small "extra" for presentation: keep certain pieces static.
         // (e.g., the angel/fairy and the trophy look better as fixed exhibits.)
         if (e->animated) {
@@ -590,25 +910,34 @@ void load_museum_scene(Scene* scene, const char* scene_csv_path)
             }
         }
 
-        compute_model_bounds_sphere(&e->model, &e->bounds_center_local, &e->bounds_radius_local);
-        e->bounds_min_z_local = compute_model_min_z(&e->model);
-
         // Auto-grounding for statues:
         // We compute a local min-Z and store an offset so the model's base can sit on a surface.
         // The actual target surface height (pedestal top) is assigned AFTER all entities are loaded
         // (so we can find the nearest pedestal).
         if (strcmp(e->type, "statue") == 0) {
-            e->ground_offset_z = (-e->bounds_min_z_local) * e->sz;
+            e->ground_offset_z = (-e->mesh->bounds_min_z) * e->sz;
         } else {
             e->ground_offset_z = 0.0f;
         }
 
-        // textura
-        e->texture_id = load_texture((char*)rows[i].texture);
+        // textura: decoded in one batch after the loop
+        texture_paths[scene->entity_count - 1] = rows[i].texture;
+        texture_classes[scene->entity_count - 1] = (strcmp(e->type, "painting") == 0) ? TEXTURE_PAINTING
+                                                                                      : TEXTURE_MODEL;
 
         printf("Loaded entity: %s | model=%s | tex=%s\n", e->type, rows[i].model, rows[i].texture);
     }
 
+    acquire_textures(&scene->textures, texture_paths, texture_classes, scene->entity_count, texture_ids);
+    for (int i = 0; i < scene->entity_count; i++) {
+        scene->entities[i].texture_id = texture_ids[i];
+    }
+
+    printf("Loaded %d entities from %d model files\n", scene->entity_count, scene->models.model_count);
+    printf("Textures: %d resident (%.1f MB of the %.0f MB budget)\n", get_resident_texture_count(&scene->textures),
+           get_resident_texture_bytes(&scene->textures) / (1024.0 * 1024.0),
+           scene->textures.budget_bytes / (1024.0 * 1024.0));
+
     // Post-process: snap each statue onto the nearest pedestal.
     // This removes the "floating" artifacts when models have different local origins.
     for (int i = 0; i < scene->entity_count; i++) {
@@ -627,6 +956,9 @@ void load_museum_scene(Scene* scene, const char* scene_csv_path)
         // Since ground_offset_z == -minZ*scaleZ, we can simply set e->pz = pedestal_top_z.
         e->pz = pedestal_top_z;
     }
+
+    build_impostors(scene);
+    build_static_batches(scene);
 }
 
 void update_scene(Scene* scene, double elapsed_time)
@@ -650,8 +982,273 @@ void update_scene(Scene* scene, double elapsed_time)
     }
 }
 
-void render_scene(const Scene* scene)
+// Projected diameter of the entity's bounding sphere in pixels.
+static float entity_screen_size(const Entity* e, const double view[16], const double projection[16],
+                                int viewport_h)
+{
+    double c[3], r;
+    entity_world_sphere(e, c, &r);
+
+    const double distance = -(view[2] * c[0] + view[6] * c[1] + view[10] * c[2] + view[14]);
+    if (distance <= r) {
+        return 1e30f; // camera inside (or just in front of) the sphere
+    }
+    return (float)(2.0 * r * projection[5] * 0.5 * viewport_h / distance);
+}
+
+static int select_lod_level(int n_lods, int current, float size_px)
+{
+    int level = current;
+    if (level >= n_lods) level = n_lods - 1;
+    if (level < 0) level = 0;
+
+    // Level k is used below LOD_SWITCH_PIXELS / 2^(k-1). Switching needs the size
+    // to cross the boundary by the hysteresis margin.
+    while (level + 1 < n_lods
+           && size_px < LOD_SWITCH_PIXELS / (float)(1 << level) * (1.0f - LOD_HYSTERESIS)) {
+        level++;
+    }
+    while (level > 0
+           && size_px > LOD_SWITCH_PIXELS / (float)(1 << (level - 1)) * (1.0f + LOD_HYSTERESIS)) {
+        level--;
+    }
+    return level;
+}
+
+// Pick the level of detail of every entity for this frame.
+// view: the camera matrix (render_scene is called after set_view).
+static void update_entity_lods(Scene* scene, const double view[16])
+{
+    double projection[16];
+    GLint viewport[4];
+
+    glGetDoublev(GL_PROJECTION_MATRIX, projection);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    for (int i = 0; i < scene->entity_count; i++) {
+        Entity* e = &scene->entities[i];
+        e->screen_size_px = entity_screen_size(e, view, projection, viewport[3]);
+        if (e->mesh->model.n_lods <= 1) {
+            e->lod_level = 0;
+            continue;
+        }
+        e->lod_level = select_lod_level(e->mesh->model.n_lods, e->lod_level, e->screen_size_px);
+    }
+}
+
+// 0 = draw the mesh, 1 = draw the impostor card, in between = crossfade.
+static float impostor_blend(const Scene* scene, const Entity* e)
+{
+    if (!scene->impostors_enabled || e->impostor.texture == 0) return 0.0f;
+
+    const float upper = scene->impostor_pixels * (1.0f + IMPOSTOR_FADE_BAND);
+    const float lower = scene->impostor_pixels * (1.0f - IMPOSTOR_FADE_BAND);
+    if (e->screen_size_px >= upper) return 0.0f;
+    if (e->screen_size_px <= lower) return 1.0f;
+    return (upper - e->screen_size_px) / (upper - lower);
+}
+
+static void draw_entity_impostor(const Scene* scene, const Entity* e, const double view[16])
+{
+    double c[3], r;
+    entity_world_sphere(e, c, &r);
+    const float center[3] = { (float)c[0], (float)c[1], (float)c[2] };
+
+    // The views were lit at capture time: follow the light slider downwards at least.
+    float brightness = 1.0f;
+    if (e->impostor.captured_light > 0.0f) {
+        brightness = scene->light_intensity / e->impostor.captured_light;
+        if (brightness > 1.0f) brightness = 1.0f;
+    }
+    draw_impostor(&e->impostor, center, e->rz - e->impostor.captured_rz, view, brightness);
+}
+
+// View space depth of the entity's bounding sphere center.
+static float entity_view_depth(const Entity* e, const double view[16])
+{
+    double c[3], r;
+    entity_world_sphere(e, c, &r);
+    return (float)-(view[2] * c[0] + view[6] * c[1] + view[10] * c[2] + view[14]);
+}
+
+// Collect the entities (but the selected one) into the render queue and sort it.
+static void queue_entities(Scene* scene, const double view[16])
+{
+    RenderQueue* queue = &scene->render_queue;
+
+    reset_render_queue(queue);
+    for (int i = 0; i < scene->entity_count; i++) {
+        if (i == scene->selected_entity || scene->static_geometry.is_merged[i]) continue;
+        const Entity* e = &scene->entities[i];
+        const float depth = entity_view_depth(e, view);
+        uint64_t key;
+        if (entity_is_transparent(e)) {
+            key = make_transparent_sort_key(depth);
+        } else if (impostor_blend(scene, e) >= 1.0f) {
+            // The card binds the atlas and sets its own cull mode.
+            key = make_opaque_sort_key(RENDER_NO_MESH, 0, e->impostor.texture, 0, depth);
+        } else {
+            key = make_opaque_sort_key(e->mesh->id, e->lod_level, e->texture_id, entity_is_two_sided(e), depth);
+        }
+        push_render_item(queue, key, i);
+    }
+    sort_render_queue(queue);
+}
+
+// Opaque entity: mesh up close, impostor card far away, screen-door crossfade in between.
+// cull_face: the GL_CULL_FACE state of the one-sided meshes.
+static void draw_queued_opaque(Scene* scene, const Entity* e, const double view[16], int cull_face)
+{
+    RenderQueue* queue = &scene->render_queue;
+    MeshletStats* stats = scene->meshlet_culling_enabled ? &scene->meshlet_stats : NULL;
+    const float blend = impostor_blend(scene, e);
+
+    if (blend < 1.0f) {
+        bind_queue_texture(queue, e->texture_id);
+        set_queue_cull_face(queue, cull_face && !entity_is_two_sided(e));
+    }
+    if (blend <= 0.0f) {
+        draw_entity_mesh(e, stats);
+        return;
+    }
+    if (blend < 1.0f) {
+        enable_impostor_crossfade(1.0f - blend, 0);
+        draw_entity_mesh(e, stats);
+        enable_impostor_crossfade(1.0f - blend, 1);
+    }
+    // The card restores the enables but leaves its atlas bound.
+    draw_entity_impostor(scene, e, view);
+    set_queue_texture(queue, e->impostor.texture);
+    if (blend < 1.0f) {
+        glDisable(GL_POLYGON_STIPPLE);
+    }
+}
+
+// Number of the opaque items from first on that draw the same mesh (the same
+// level, cull mode and drawn as a mesh, not as a card), the instances of an
+// instanced draw; at least 1.
+static int count_queue_batch(const Scene* scene, int first)
+{
+    const RenderQueue* queue = &scene->render_queue;
+    const Entity* e = &scene->entities[queue->items[first].index];
+    int n = 1;
+
+    if (impostor_blend(scene, e) > 0.0f) {
+        return 1;
+    }
+    while (first + n < queue->count) {
+        const RenderItem* item = &queue->items[first + n];
+        const Entity* other = &scene->entities[item->index];
+        if (get_sort_key_pass(item->key) != RENDER_PASS_OPAQUE
+            || other->mesh != e->mesh || other->lod_level != e->lod_level
+            || entity_is_two_sided(other) != entity_is_two_sided(e)
+            || impostor_blend(scene, other) > 0.0f) {
+            break;
+        }
+        n++;
+    }
+    return n;
+}
+
+// Meshlets of the level of an entity (0 when the model has none).
+static int count_level_meshlets(const Entity* e)
 {
+    const Model* model = &e->mesh->model;
+    if (model->n_lods == 0) {
+        return 0;
+    }
+    const int level = (e->lod_level < model->n_lods) ? e->lod_level : model->n_lods - 1;
+    return model->lods[(level > 0) ? level : 0].n_meshlets;
+}
+
+// Entities of a mesh, sorted by texture by the queue: one instanced draw per
+// texture and submesh. With meshlet culling on, a level of more meshlets keeps
+// its per-entity culling (the culled triangles of a high-poly exhibit save more
+// than the draw calls), and without instancing they are drawn one by one.
+static void draw_queued_batch(Scene* scene, int first, int count, int cull_face)
+{
+    RenderQueue* queue = &scene->render_queue;
+    const Entity* e = &scene->entities[queue->items[first].index];
+    MeshletStats* stats = scene->meshlet_culling_enabled ? &scene->meshlet_stats : NULL;
+
+    set_queue_cull_face(queue, cull_face && !entity_is_two_sided(e));
+    if (stats == NULL || count_level_meshlets(e) <= INSTANCING_MAX_MESHLETS) {
+        ModelPlacement placements[MAX_RENDER_ITEMS];
+        for (int k = 0; k < count; k++) {
+            const Entity* other = &scene->entities[queue->items[first + k].index];
+            build_entity_transform(other, 1, placements[k].transform);
+            placements[k].texture = other->texture_id;
+        }
+
+        // The materials of the model change the color and the specular terms.
+        const int has_materials = (e->mesh->model.n_materials > 0);
+        if (has_materials) {
+            glPushAttrib(GL_LIGHTING_BIT | GL_CURRENT_BIT);
+        }
+        int n_binds = 0;
+        const int n_draws = draw_model_instanced(&e->mesh->model, e->lod_level, placements, count, &n_binds);
+        if (has_materials) {
+            glPopAttrib();
+        }
+        if (n_draws > 0) {
+            set_queue_texture(queue, placements[count - 1].texture);
+            queue->stats.n_texture_binds += n_binds;
+            queue->stats.n_skipped += count - n_binds;
+            queue->stats.n_instanced_draws += n_draws;
+            queue->stats.n_instanced += count;
+            return;
+        }
+    }
+    for (int k = 0; k < count; k++) {
+        const Entity* other = &scene->entities[queue->items[first + k].index];
+        bind_queue_texture(queue, other->texture_id);
+        draw_entity_mesh(other, stats);
+    }
+}
+
+// Draw the sorted queue: the opaque items, then the glass with its state set once.
+static void draw_render_queue(Scene* scene, const double view[16])
+{
+    RenderQueue* queue = &scene->render_queue;
+    const int cull_face = glIsEnabled(GL_CULL_FACE);
+    int i = 0;
+
+    // Safety: glass/blending pass must not leak state into opaque rendering.
+    glDisable(GL_BLEND);
+    glDepthMask(GL_TRUE);
+    glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
+    queue->cull_face = cull_face;
+
+    // The static batches first (but the selected entity, drawn with the outline).
+    draw_static_batches(&scene->static_geometry, queue, 0, scene->selected_entity);
+    while (i < queue->count && get_sort_key_pass(queue->items[i].key) == RENDER_PASS_OPAQUE) {
+        const int n = count_queue_batch(scene, i);
+        if (n > 1) {
+            draw_queued_batch(scene, i, n, cull_face);
+        } else {
+            draw_queued_opaque(scene, &scene->entities[queue->items[i].index], view, cull_face);
+        }
+        i += n;
+    }
+    set_queue_cull_face(queue, cull_face);
+
+    // Transparent pass (e.g., glass display cases): the static glass, then the
+    // queued glass back to front.
+    begin_glass_pass();
+    draw_static_batches(&scene->static_geometry, queue, 1, scene->selected_entity);
+    for (; i < queue->count; i++) {
+        draw_glass_mesh(&scene->entities[queue->items[i].index]);
+    }
+    end_glass_pass();
+}
+
+void render_scene(Scene* scene)
+{
+    double view[16];
+    glGetDoublev(GL_MODELVIEW_MATRIX, view);
+    update_entity_lods(scene, view);
+    reset_meshlet_stats(&scene->meshlet_stats);
+
     set_material(&scene->material);
     set_lighting_with_intensity(scene);
 
@@ -670,29 +1267,20 @@ void render_scene(const Scene* scene)
     glStencilFunc(GL_ALWAYS, 0, 0xFF);
     glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
 
-    draw_room_world_quads(scene->floor_tex, scene->wall_tex, scene->ceiling_tex);
+    if (get_draw_path() == DRAW_PATH_DISPLAY_LISTS && scene->room_list != 0) {
+        glCallList(scene->room_list);
+    } else {
+        draw_room_world_quads(scene->floor_tex, scene->wall_tex, scene->ceiling_tex);
+    }
 
     if (scene->shadows_enabled) {
         render_planar_shadows(scene);
     }
 
     // Festmények és tárgyak mind Entity-ként érkeznek a scene.csv-ből.
-
-    // entity-k
-    for (int i = 0; i < scene->entity_count; i++) {
-        if (i == scene->selected_entity) continue;
-        const Entity* e = &scene->entities[i];
-        if (entity_is_transparent(e)) continue;
-        draw_entity_opaque(e);
-    }
-
-    // Transparent pass (e.g., glass display cases).
-    for (int i = 0; i < scene->entity_count; i++) {
-        if (i == scene->selected_entity) continue;
-        const Entity* e = &scene->entities[i];
-        if (!entity_is_transparent(e)) continue;
-        draw_entity_glass(e);
-    }
+    // Sorted by pass, mesh, cull mode, texture and depth.
+    queue_entities(scene, view);
+    draw_render_queue(scene, view);
 
     /* Draw selected normally + write stencil = 1 */
     if (scene->selected_entity >= 0 && scene->selected_entity < scene->entity_count) {
@@ -705,7 +1293,7 @@ void render_scene(const Scene* scene)
         if (entity_is_transparent(e)) {
             draw_entity_glass(e);
         } else {
-            draw_entity_opaque(e);
+            draw_entity_opaque(e, scene->meshlet_culling_enabled ? &scene->meshlet_stats : NULL);
         }
 
         /* Outline pass: slightly scaled copy where stencil != 1 */
@@ -719,10 +1307,12 @@ void render_scene(const Scene* scene)
         // Outline for transparent objects isn't very readable; keep it for opaque only.
         if (!entity_is_transparent(e)) {
             glPushMatrix();
-            apply_transform(e);
+            // Grown around the model origin, not the origin of the quantized positions.
+            apply_entity_transform(e);
             glScalef(1.05f, 1.05f, 1.05f);
+            apply_dequantization(e);
             glColor3f(1.0f, 0.85f, 0.20f);
-            draw_model((Model*)&e->model);
+            draw_model_lod(&e->mesh->model, e->lod_level);
             glPopMatrix();
         }
 
@@ -1031,13 +1621,13 @@ int pick_entity(Scene* scene, const Camera* camera,
         const Entity* e = &scene->entities[i];
 
         // world center = T + R * (S * local_center)
-        double c_local[3] = { e->bounds_center_local.x, e->bounds_center_local.y, e->bounds_center_local.z };
+        double c_local[3] = { e->mesh->bounds_center.x, e->mesh->bounds_center.y, e->mesh->bounds_center.z };
         c_local[0] *= e->sx; c_local[1] *= e->sy; c_local[2] *= e->sz;
         rotate_point_xyz_deg(c_local, e->rx, e->ry, e->rz);
         const double c_world[3] = { c_local[0] + e->px, c_local[1] + e->py, c_local[2] + e->pz };
 
         const double smax = fmax(fmax(fabs(e->sx), fabs(e->sy)), fabs(e->sz));
-        const double r_world = (double)e->bounds_radius_local * smax;
+        const double r_world = (double)e->mesh->bounds_radius * smax;
 
         double t_hit;
         if (ray_sphere_intersect(ro, rd, c_world, r_world, &t_hit)) {
@@ -0,0 +1,361 @@
+#include "static_batch.h"
+
+#include <obj/draw.h>
+#include <obj/gpu_mesh.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Submeshes of a model merged at most */
+#define MAX_INSTANCE_PARTS 16
+
+/**
+ * Range of the full detail level of a model with one material
+ */
+typedef struct ModelPart
+{
+    int first_index;
+    int n_indices;
+    int material;
+} ModelPart;
+
+void init_static_geometry(StaticGeometry* geometry)
+{
+    memset(geometry, 0, sizeof(*geometry));
+    init_model(&geometry->model);
+}
+
+// The full detail level of the model by material (the whole level when it has no submeshes).
+static int get_model_parts(const Model* model, ModelPart parts[MAX_INSTANCE_PARTS])
+{
+    if (model->n_lods == 0 || model->lods[0].n_submeshes == 0) {
+        parts[0].first_index = 0;
+        parts[0].n_indices = (model->n_lods > 0) ? model->lods[0].n_indices : model->n_triangles * 3;
+        parts[0].material = NO_MATERIAL;
+        return (parts[0].n_indices > 0) ? 1 : 0;
+    }
+    const ModelLod* lod = &model->lods[0];
+    if (lod->n_submeshes > MAX_INSTANCE_PARTS) {
+        return -1;
+    }
+    for (int i = 0; i < lod->n_submeshes; i++) {
+        const Submesh* submesh = &model->submeshes[lod->first_submesh + i];
+        parts[i].first_index = submesh->first_index;
+        parts[i].n_indices = submesh->n_indices;
+        parts[i].material = submesh->material;
+    }
+    return lod->n_submeshes;
+}
+
+// State of a part of the instance as a batch (without its ranges).
+static StaticBatch get_batch_state(const StaticInstance* instance, int material)
+{
+    StaticBatch state;
+
+    // The glass pass sets its own state: all transparent triangles share one batch.
+    memset(&state, 0, sizeof(state));
+    state.is_transparent = instance->is_transparent;
+    state.texture = instance->is_transparent ? 0 : instance->texture;
+    state.source = (instance->is_transparent || material == NO_MATERIAL) ? NULL : instance->model;
+    state.material = (state.source != NULL) ? material : NO_MATERIAL;
+    return state;
+}
+
+// Batch of a part of the instance, or -1.
+static int lookup_batch(const StaticGeometry* geometry, const StaticInstance* instance, int material)
+{
+    const StaticBatch state = get_batch_state(instance, material);
+
+    for (int b = 0; b < geometry->n_batches; b++) {
+        const StaticBatch* batch = &geometry->batches[b];
+        if (batch->texture == state.texture && batch->is_transparent == state.is_transparent
+            && batch->source == state.source && batch->material == state.material) {
+            return b;
+        }
+    }
+    return -1;
+}
+
+// Batch of a part of the instance, created if it is new. Returns -1 when all batches are taken.
+static int find_batch(StaticGeometry* geometry, const StaticInstance* instance, int material)
+{
+    const int b = lookup_batch(geometry, instance, material);
+
+    if (b >= 0) {
+        return b;
+    }
+    if (geometry->n_batches >= MAX_STATIC_BATCHES) {
+        return -1;
+    }
+    geometry->batches[geometry->n_batches] = get_batch_state(instance, material);
+    return geometry->n_batches++;
+}
+
+// World space vertex: the normal goes through the cofactor matrix of the upper
+// 3x3 part (det * inverse transpose, one row per c), times the sign of the
+// determinant so mirrored placements keep their normals outside, then it is normalized.
+static void transform_vertex(const float m[16], const MeshVertex* in, MeshVertex* out)
+{
+    const float* p = in->position;
+    const float* n = in->normal;
+
+    for (int k = 0; k < 3; k++) {
+        out->position[k] = m[k] * p[0] + m[4 + k] * p[1] + m[8 + k] * p[2] + m[12 + k];
+    }
+    const float c0[3] = { m[5] * m[10] - m[9] * m[6], m[9] * m[2] - m[1] * m[10], m[1] * m[6] - m[5] * m[2] };
+    const float c1[3] = { m[8] * m[6] - m[4] * m[10], m[0] * m[10] - m[8] * m[2], m[4] * m[2] - m[0] * m[6] };
+    const float c2[3] = { m[4] * m[9] - m[8] * m[5], m[8] * m[1] - m[0] * m[9], m[0] * m[5] - m[4] * m[1] };
+    const float normal[3] = {
+        c0[0] * n[0] + c0[1] * n[1] + c0[2] * n[2],
+        c1[0] * n[0] + c1[1] * n[1] + c1[2] * n[2],
+        c2[0] * n[0] + c2[1] * n[1] + c2[2] * n[2]
+    };
+    const float det = m[0] * c0[0] + m[4] * c0[1] + m[8] * c0[2];
+    const float length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+    const float scale = (length > 0.0f) ? ((det < 0.0f) ? -1.0f : 1.0f) / length : 0.0f;
+    for (int k = 0; k < 3; k++) {
+        out->normal[k] = normal[k] * scale;
+    }
+    out->uv[0] = in->uv[0];
+    out->uv[1] = in->uv[1];
+}
+
+// Find the batches of the instances and count their indices (counts[instance * MAX_STATIC_BATCHES + batch]).
+static void plan_batches(StaticGeometry* geometry, const StaticInstance* instances, int n_instances, int* counts)
+{
+    ModelPart parts[MAX_INSTANCE_PARTS];
+
+    for (int i = 0; i < n_instances; i++) {
+        const Model* model = instances[i].model;
+        const int n_parts = (model != NULL && model->mesh_vertices != NULL) ? get_model_parts(model, parts) : 0;
+        const int n_batches = geometry->n_batches;
+        int* row = &counts[i * MAX_STATIC_BATCHES];
+        int n_ranges = 0;
+        int fits = (n_parts > 0);
+
+        for (int p = 0; fits && p < n_parts; p++) {
+            const int b = find_batch(geometry, &instances[i], parts[p].material);
+            if (b < 0) {
+                fits = 0;
+                break;
+            }
+            n_ranges += (row[b] == 0);
+            row[b] += parts[p].n_indices;
+        }
+        if (!fits || geometry->n_ranges + n_ranges > MAX_STATIC_INSTANCES * 4) {
+            // Left out: forget its new batches and its counts.
+            geometry->n_batches = n_batches;
+            memset(row, 0, MAX_STATIC_BATCHES * sizeof(int));
+            continue;
+        }
+        geometry->is_merged[i] = 1;
+        geometry->n_merged++;
+        geometry->n_ranges += n_ranges;
+    }
+}
+
+static void write_index(Model* model, int i, unsigned int value)
+{
+    if (model->index_size == 2) {
+        ((unsigned short*)model->indices)[i] = (unsigned short)value;
+    } else {
+        ((unsigned int*)model->indices)[i] = value;
+    }
+}
+
+// Copy the triangles of the instance in the batch to the index buffer position.
+static void copy_batch_indices(Model* merged, const StaticGeometry* geometry, const StaticInstance* instance,
+                               int batch, unsigned int base_vertex, int position)
+{
+    ModelPart parts[MAX_INSTANCE_PARTS];
+    const int n_parts = get_model_parts(instance->model, parts);
+
+    for (int p = 0; p < n_parts; p++) {
+        if (lookup_batch(geometry, instance, parts[p].material) != batch) continue;
+        for (int k = 0; k < parts[p].n_indices; k++) {
+            write_index(merged, position++, base_vertex + get_model_index(instance->model, parts[p].first_index + k));
+        }
+    }
+}
+
+// Display list of each batch for the display list draw path.
+static void compile_batch_lists(StaticGeometry* geometry)
+{
+    const DrawPath path = get_draw_path();
+
+    // The lists record the vertices themselves: compile from the immediate path.
+    set_draw_path(DRAW_PATH_IMMEDIATE);
+    for (int b = 0; b < geometry->n_batches; b++) {
+        StaticBatch* batch = &geometry->batches[b];
+        const Submesh* submesh = &geometry->model.submeshes[batch->submesh];
+        batch->list = glGenLists(1);
+        if (batch->list == 0) {
+            break;
+        }
+        glNewList(batch->list, GL_COMPILE);
+        draw_index_range(&geometry->model, submesh->first_index, submesh->n_indices);
+        glEndList();
+    }
+    set_draw_path(path);
+}
+
+int build_static_geometry(StaticGeometry* geometry, const StaticInstance* instances, int n_instances)
+{
+    Model* merged = &geometry->model;
+
+    destroy_static_geometry(geometry);
+    if (n_instances > MAX_STATIC_INSTANCES) {
+        n_instances = MAX_STATIC_INSTANCES;
+    }
+    int* counts = (int*)calloc((size_t)MAX_STATIC_INSTANCES * MAX_STATIC_BATCHES, sizeof(int));
+    if (counts == NULL) {
+        return 0;
+    }
+    plan_batches(geometry, instances, n_instances, counts);
+
+    // Ranges by batch, then by instance: a batch is contiguous in the index buffer.
+    int n_indices = 0;
+    int n_ranges = 0;
+    for (int b = 0; b < geometry->n_batches; b++) {
+        for (int i = 0; i < n_instances; i++) {
+            const int count = counts[i * MAX_STATIC_BATCHES + b];
+            if (count == 0) continue;
+            StaticRange* range = &geometry->ranges[n_ranges++];
+            range->instance = i;
+            range->batch = b;
+            range->first_index = n_indices;
+            range->n_indices = count;
+            n_indices += count;
+        }
+    }
+    free(counts);
+
+    int n_vertices = 0;
+    int n_materials = 0;
+    for (int i = 0; i < n_instances; i++) {
+        if (geometry->is_merged[i]) {
+            n_vertices += instances[i].model->n_mesh_vertices;
+        }
+    }
+    for (int b = 0; b < geometry->n_batches; b++) {
+        n_materials += (geometry->batches[b].material != NO_MATERIAL);
+    }
+    merged->index_size = (n_vertices <= 65536) ? 2 : 4;
+    merged->mesh_vertices = (MeshVertex*)malloc((size_t)n_vertices * sizeof(MeshVertex) + 1);
+    merged->indices = malloc((size_t)n_indices * (size_t)merged->index_size + 1);
+    merged->submeshes = (Submesh*)calloc((size_t)geometry->n_batches + 1, sizeof(Submesh));
+    merged->materials = (ObjMaterial*)calloc((size_t)n_materials + 1, sizeof(ObjMaterial));
+    if (merged->mesh_vertices == NULL || merged->indices == NULL || merged->submeshes == NULL
+        || merged->materials == NULL) {
+        printf("[ERROR] Out of memory for the static batches\n");
+        destroy_static_geometry(geometry);
+        return 0;
+    }
+
+    // World space vertices, instance after instance.
+    unsigned int base_vertices[MAX_STATIC_INSTANCES];
+    for (int i = 0; i < n_instances; i++) {
+        base_vertices[i] = (unsigned int)merged->n_mesh_vertices;
+        if (!geometry->is_merged[i]) continue;
+        const Model* model = instances[i].model;
+        for (int v = 0; v < model->n_mesh_vertices; v++) {
+            transform_vertex(instances[i].transform, &model->mesh_vertices[v],
+                             &merged->mesh_vertices[merged->n_mesh_vertices + v]);
+        }
+        merged->n_mesh_vertices += model->n_mesh_vertices;
+    }
+    for (int r = 0; r < n_ranges; r++) {
+        const StaticRange* range = &geometry->ranges[r];
+        copy_batch_indices(merged, geometry, &instances[range->instance], range->batch,
+                           base_vertices[range->instance], range->first_index);
+    }
+
+    // One submesh per batch, with a copy of its material.
+    for (int b = 0, r = 0; b < geometry->n_batches; b++) {
+        StaticBatch* batch = &geometry->batches[b];
+        Submesh* submesh = &merged->submeshes[b];
+        submesh->first_index = (r < n_ranges) ? geometry->ranges[r].first_index : n_indices;
+        for (; r < n_ranges && geometry->ranges[r].batch == b; r++) {
+            submesh->n_indices += geometry->ranges[r].n_indices;
+        }
+        submesh->material = NO_MATERIAL;
+        if (batch->material != NO_MATERIAL) {
+            merged->materials[merged->n_materials] = batch->source->materials[batch->material];
+            submesh->material = merged->n_materials++;
+        }
+        batch->submesh = b;
+    }
+    geometry->n_ranges = n_ranges;
+    merged->n_indices = n_indices;
+    merged->n_triangles = n_indices / 3;
+    merged->n_submeshes = geometry->n_batches;
+    merged->vertex_attributes = MESH_HAS_NORMALS | MESH_HAS_UVS;
+    merged->n_lods = 1;
+    memset(&merged->lods[0], 0, sizeof(merged->lods[0]));
+    merged->lods[0].n_indices = n_indices;
+    merged->lods[0].n_submeshes = geometry->n_batches;
+
+    if (is_gpu_buffers_enabled() && !upload_model_buffers(merged)) {
+        printf("[WARN] The static batches are drawn in immediate mode (no buffer objects)\n");
+    }
+    compile_batch_lists(geometry);
+    return 1;
+}
+
+// The batch, leaving out the range of the skipped instance.
+static void draw_batch(const StaticGeometry* geometry, int b, int skipped_instance)
+{
+    const StaticBatch* batch = &geometry->batches[b];
+    const Submesh* submesh = &geometry->model.submeshes[batch->submesh];
+
+    for (int r = 0; r < geometry->n_ranges; r++) {
+        const StaticRange* range = &geometry->ranges[r];
+        if (range->batch == b && range->instance == skipped_instance) {
+            const int end = range->first_index + range->n_indices;
+            draw_index_range(&geometry->model, submesh->first_index, range->first_index - submesh->first_index);
+            draw_index_range(&geometry->model, end, submesh->first_index + submesh->n_indices - end);
+            return;
+        }
+    }
+    if (batch->list != 0 && get_draw_path() == DRAW_PATH_DISPLAY_LISTS) {
+        glCallList(batch->list);
+    } else {
+        draw_index_range(&geometry->model, submesh->first_index, submesh->n_indices);
+    }
+}
+
+void draw_static_batches(const StaticGeometry* geometry, RenderQueue* queue, int is_transparent,
+                         int skipped_instance)
+{
+    for (int b = 0; b < geometry->n_batches; b++) {
+        const StaticBatch* batch = &geometry->batches[b];
+        if (batch->is_transparent != is_transparent) continue;
+
+        const int material = geometry->model.submeshes[batch->submesh].material;
+        if (!is_transparent) {
+            bind_queue_texture(queue, batch->texture);
+        }
+        if (material != NO_MATERIAL) {
+            glPushAttrib(GL_LIGHTING_BIT | GL_CURRENT_BIT);
+            apply_material(&geometry->model.materials[material]);
+        }
+        draw_batch(geometry, b, skipped_instance);
+        if (material != NO_MATERIAL) {
+            glPopAttrib();
+        }
+    }
+}
+
+void destroy_static_geometry(StaticGeometry* geometry)
+{
+    for (int b = 0; b < geometry->n_batches; b++) {
+        if (geometry->batches[b].list != 0) {
+            glDeleteLists(geometry->batches[b].list, 1);
+        }
+    }
+    release_model_buffers(&geometry->model);
+    free_model(&geometry->model);
+    init_static_geometry(geometry);
+}
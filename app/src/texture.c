@@ -1,44 +1,329 @@
 #include "texture.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_image.h>
 
-GLuint load_texture(char* filename)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TEXTURE_SSE2 1
+#endif
+
+static int mip_size(int size, int level)
+{
+    size >>= level;
+    return (size > 0) ? size : 1;
+}
+
+static void downsample_image(const unsigned char* src, int src_w, int src_h, size_t src_pitch,
+                             int channels, unsigned char* dst);
+
+/**
+ * Take the pixels of the decoded surface, halved until they fit max_size (0 = any size).
+ * The pixels are copied out of the surface when halved or when its rows are padded.
+ */
+static int take_surface_pixels(SDL_Surface* surface, int channels, int max_size, TextureImage* image)
 {
+    int w = surface->w;
+    int h = surface->h;
+    size_t pitch = (size_t)surface->pitch;
+    const unsigned char* src = (const unsigned char*)surface->pixels;
+    unsigned char* owned = NULL;
+
+    // SDL_image can't decode at a reduced scale: halve right after the decode instead,
+    // before the mip chain, the hash and the upload see the full size image.
+    while (max_size > 0 && (w > max_size || h > max_size)) {
+        unsigned char* half = (unsigned char*)malloc((size_t)mip_size(w, 1) * mip_size(h, 1) * channels);
+        if (!half) {
+            free(owned);
+            return 0;
+        }
+        downsample_image(src, w, h, pitch, channels, half);
+        free(owned);
+        owned = half;
+        src = half;
+        w = mip_size(w, 1);
+        h = mip_size(h, 1);
+        pitch = (size_t)w * channels;
+    }
+    if (!owned && pitch != (size_t)w * channels) {
+        owned = (unsigned char*)malloc((size_t)w * h * channels);
+        if (!owned) {
+            return 0;
+        }
+        for (int y = 0; y < h; y++) {
+            memcpy(owned + (size_t)y * w * channels, src + (size_t)y * pitch, (size_t)w * channels);
+        }
+    }
+
+    image->width = w;
+    image->height = h;
+    image->channels = channels;
+    if (owned) {
+        image->pixels = owned;
+        SDL_FreeSurface(surface);
+    } else {
+        image->pixels = (unsigned char*)surface->pixels;
+        image->surface = surface;
+    }
+    return 1;
+}
+
+int load_texture_image(const char* filename, int max_size, TextureImage* image)
+{
+    image->width = 0;
+    image->height = 0;
+    image->channels = 4;
+    image->pixels = NULL;
+    image->surface = NULL;
+    image->n_levels = 1;
+    image->mipmaps = NULL;
+
     SDL_Surface* loaded = IMG_Load(filename);
     if (!loaded) {
         printf("[ERROR] IMG_Load failed (%s): %s\n", filename, IMG_GetError());
         return 0;
     }
 
-    // Biztos RGBA formátum (stabil minden jpg/png esetén)
-    SDL_Surface* surface = SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_RGBA32, 0);
+    // Biztos RGB/RGBA formátum (stabil minden jpg/png esetén).
+    // Without alpha (JPEG) 3 bytes per pixel are enough; paletted images may have a color key.
+    const Uint32 format = loaded->format->format;
+    const int channels = (SDL_ISPIXELFORMAT_ALPHA(format) || SDL_ISPIXELFORMAT_INDEXED(format)) ? 4 : 3;
+    SDL_Surface* surface = SDL_ConvertSurfaceFormat(loaded, (channels == 4) ? SDL_PIXELFORMAT_RGBA32
+                                                                           : SDL_PIXELFORMAT_RGB24, 0);
     SDL_FreeSurface(loaded);
 
     if (!surface) {
         printf("[ERROR] SDL_ConvertSurfaceFormat failed (%s): %s\n", filename, SDL_GetError());
         return 0;
     }
+    if (!take_surface_pixels(surface, channels, max_size, image)) {
+        printf("[ERROR] Out of memory while scaling %s\n", filename);
+        SDL_FreeSurface(surface);
+        return 0;
+    }
+    return 1;
+}
 
-    GLuint tex = 0;
-    glGenTextures(1, &tex);
-    glBindTexture(GL_TEXTURE_2D, tex);
+void free_texture_image(TextureImage* image)
+{
+    if (image->surface) {
+        SDL_FreeSurface((SDL_Surface*)image->surface);
+    } else {
+        free(image->pixels);
+    }
+    free(image->mipmaps);
+    image->pixels = NULL;
+    image->surface = NULL;
+    image->n_levels = 1;
+    image->mipmaps = NULL;
+}
 
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+/**
+ * Average 2x2 blocks of two source rows into one row of out_width pixels.
+ * next is the byte offset of the right neighbour (0 for one pixel wide sources).
+ */
+static void downsample_row(const unsigned char* row0, const unsigned char* row1, int next, int channels,
+                           unsigned char* out, int out_width)
+{
+    const int step = channels * 2;
+    int x = 0;
+#ifdef TEXTURE_SSE2
+    if (channels == 4 && next == 4) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i round = _mm_set1_epi16(2);
+        // 8 source pixels of both rows -> 4 output pixels, summed in 16 bit lanes.
+        for (; x + 4 <= out_width; x += 4) {
+            const __m128i a0 = _mm_loadu_si128((const __m128i*)(row0 + x * 8));
+            const __m128i a1 = _mm_loadu_si128((const __m128i*)(row0 + x * 8 + 16));
+            const __m128i b0 = _mm_loadu_si128((const __m128i*)(row1 + x * 8));
+            const __m128i b1 = _mm_loadu_si128((const __m128i*)(row1 + x * 8 + 16));
+            const __m128i s01 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero));
+            const __m128i s23 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero));
+            const __m128i s45 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero));
+            const __m128i s67 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero));
+            // Column pairs: (0 + 1, 2 + 3) and (4 + 5, 6 + 7).
+            __m128i lo = _mm_add_epi16(_mm_unpacklo_epi64(s01, s23), _mm_unpackhi_epi64(s01, s23));
+            __m128i hi = _mm_add_epi16(_mm_unpacklo_epi64(s45, s67), _mm_unpackhi_epi64(s45, s67));
+            lo = _mm_srli_epi16(_mm_add_epi16(lo, round), 2);
+            hi = _mm_srli_epi16(_mm_add_epi16(hi, round), 2);
+            _mm_storeu_si128((__m128i*)(out + x * 4), _mm_packus_epi16(lo, hi));
+        }
+    }
+    else if (channels == 3 && next == 3) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i round = _mm_set1_epi16(2);
+        // RGB: 4 source pixels (12 of the 16 loaded bytes) -> 2 output pixels. The loads
+        // reach 4 bytes past the pixels, so the end of the row is left to the scalar loop.
+        for (; x + 4 <= out_width; x += 2) {
+            const __m128i a = _mm_loadu_si128((const __m128i*)(row0 + x * 6));
+            const __m128i b = _mm_loadu_si128((const __m128i*)(row1 + x * 6));
+            const __m128i s_lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+            const __m128i s_hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+            // Lanes of s_lo: pixels 0 and 1 (+ red of 2); s_hi: pixel 2 from lane 1, pixel 3.
+            const __m128i p01 = _mm_add_epi16(s_lo, _mm_srli_si128(s_lo, 6));
+            const __m128i p23 = _mm_add_epi16(_mm_srli_si128(s_lo, 12), _mm_slli_si128(s_hi, 4));
+            const __m128i q23 = _mm_add_epi16(p23, _mm_srli_si128(s_hi, 2));
+            __m128i sums = _mm_unpacklo_epi64(p01, q23);
+            sums = _mm_srli_epi16(_mm_add_epi16(sums, round), 2);
+            unsigned char packed[16];
+            _mm_storeu_si128((__m128i*)packed, _mm_packus_epi16(sums, zero));
+            memcpy(out + x * 3, packed, 3);
+            memcpy(out + x * 3 + 3, packed + 4, 3);
+        }
+    }
+#endif
+    for (; x < out_width; x++) {
+        const unsigned char* a = row0 + x * step;
+        const unsigned char* b = row1 + x * step;
+        for (int c = 0; c < channels; c++) {
+            out[x * channels + c] = (unsigned char)((a[c] + a[next + c] + b[c] + b[next + c] + 2) >> 2);
+        }
+    }
+}
 
-    glTexImage2D(
-        GL_TEXTURE_2D, 0, GL_RGBA,
-        surface->w, surface->h,
-        0, GL_RGBA, GL_UNSIGNED_BYTE,
-        surface->pixels
-    );
+/* Half size (rounded down, at least 1) copy of the image; odd sizes drop the last row/column. */
+static void downsample_image(const unsigned char* src, int src_w, int src_h, size_t src_pitch,
+                             int channels, unsigned char* dst)
+{
+    const int w = mip_size(src_w, 1);
+    const int h = mip_size(src_h, 1);
+    for (int y = 0; y < h; y++) {
+        const unsigned char* row0 = src + (size_t)(y * 2) * src_pitch;
+        const unsigned char* row1 = (src_h > 1) ? row0 + src_pitch : row0;
+        downsample_row(row0, row1, (src_w > 1) ? channels : 0, channels, dst + (size_t)y * w * channels, w);
+    }
+}
+
+int build_texture_mipmaps(TextureImage* image)
+{
+    const int channels = image->channels;
+    size_t chain_size = 0;
+    int n_levels = 1;
+    while (mip_size(image->width, n_levels - 1) > 1 || mip_size(image->height, n_levels - 1) > 1) {
+        chain_size += (size_t)mip_size(image->width, n_levels) * (size_t)mip_size(image->height, n_levels) * channels;
+        n_levels++;
+    }
 
+    free(image->mipmaps);
+    image->mipmaps = NULL;
+    image->n_levels = 1;
+    if (n_levels == 1) {
+        return 1;
+    }
+    image->mipmaps = (unsigned char*)malloc(chain_size);
+    if (!image->mipmaps) {
+        return 0;
+    }
+
+    // Each level is filtered from the previous one.
+    const unsigned char* src = image->pixels;
+    unsigned char* dst = image->mipmaps;
+    for (int level = 1; level < n_levels; level++) {
+        const int src_w = mip_size(image->width, level - 1);
+        const int src_h = mip_size(image->height, level - 1);
+        downsample_image(src, src_w, src_h, (size_t)src_w * channels, channels, dst);
+        src = dst;
+        dst += (size_t)mip_size(image->width, level) * mip_size(image->height, level) * channels;
+    }
+    image->n_levels = n_levels;
+    return 1;
+}
+
+const unsigned char* get_texture_level(const TextureImage* image, int level, int* width, int* height)
+{
+    const unsigned char* pixels = (level == 0) ? image->pixels : image->mipmaps;
+    for (int i = 1; i < level; i++) {
+        pixels += (size_t)mip_size(image->width, i) * (size_t)mip_size(image->height, i) * image->channels;
+    }
+    *width = mip_size(image->width, level);
+    *height = mip_size(image->height, level);
+    return pixels;
+}
+
+uint64_t hash_texture_image(const TextureImage* image)
+{
+    const size_t size = (size_t)image->width * (size_t)image->height * image->channels;
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= image->pixels[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+void set_texture_sampling(int n_levels)
+{
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    // Trilinear: the tiled room surfaces and distant paintings sample a small level.
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, (n_levels > 1) ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+GLuint upload_texture(const TextureImage* image, size_t max_bytes, size_t* gpu_bytes, int* n_levels)
+{
+    TextureImage chain = *image;
+    if (!chain.mipmaps && !build_texture_mipmaps(&chain)) {
+        printf("[WARN] Out of memory for the mip levels, using the full image only\n");
+    }
+
+    // Over the budget: start from a smaller level (each one is a quarter of the previous).
+    size_t total_bytes = 0;
+    int first_level = chain.n_levels;
+    while (first_level > 0) {
+        const size_t level_bytes = (size_t)mip_size(chain.width, first_level - 1)
+            * (size_t)mip_size(chain.height, first_level - 1) * chain.channels;
+        if (first_level < chain.n_levels && total_bytes + level_bytes > max_bytes) {
+            break;
+        }
+        total_bytes += level_bytes;
+        first_level--;
+    }
+
+    GLuint tex = 0;
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+
+    // RGB rows are tightly packed, not 4 byte aligned.
+    glPixelStorei(GL_UNPACK_ALIGNMENT, (chain.channels == 4) ? 4 : 1);
+
+    const GLenum format = (chain.channels == 4) ? GL_RGBA : GL_RGB;
+    for (int level = first_level; level < chain.n_levels; level++) {
+        int w;
+        int h;
+        const unsigned char* level_pixels = get_texture_level(&chain, level, &w, &h);
+        glTexImage2D(
+            GL_TEXTURE_2D, level - first_level, (chain.channels == 4) ? GL_RGBA8 : GL_RGB8,
+            w, h,
+            0, format, GL_UNSIGNED_BYTE,
+            level_pixels
+        );
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    if (chain.mipmaps != image->mipmaps) {
+        free(chain.mipmaps);
+    }
+    set_texture_sampling(chain.n_levels - first_level);
 
-    SDL_FreeSurface(surface);
+    if (gpu_bytes) {
+        *gpu_bytes = total_bytes;
+    }
+    if (n_levels) {
+        *n_levels = chain.n_levels - first_level;
+    }
+    return tex;
+}
+
+GLuint load_texture(char* filename)
+{
+    TextureImage image;
+    if (!load_texture_image(filename, 0, &image)) {
+        return 0;
+    }
+    const GLuint tex = upload_texture(&image, SIZE_MAX, NULL, NULL);
+    free_texture_image(&image);
     return tex;
-}
\ No newline at end of file
+}
@@ -0,0 +1,399 @@
+#include "texture_cache.h"
+#include "texture.h"
+#include "texture_compress.h"
+
+#include <obj/load.h>
+#include <obj/platform.h>
+
+#include <SDL2/SDL.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int find_path(const TextureCache* cache, const char* path)
+{
+    for (int i = 0; i < cache->path_count; i++) {
+        if (strcmp(cache->paths[i].path, path) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int find_texture(const TextureCache* cache, GLuint id)
+{
+    for (int i = 0; i < MAX_CACHED_TEXTURES; i++) {
+        if (cache->textures[i].id != 0 && cache->textures[i].id == id) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int find_same_content(const TextureCache* cache, int width, int height, uint64_t hash)
+{
+    for (int i = 0; i < MAX_CACHED_TEXTURES; i++) {
+        const CachedTexture* t = &cache->textures[i];
+        if (t->id != 0 && t->content_hash == hash && t->width == width && t->height == height) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int add_path(TextureCache* cache, const char* path, int texture)
+{
+    if (cache->path_count >= MAX_CACHED_TEXTURES) {
+        return 0;
+    }
+    TexturePath* entry = &cache->paths[cache->path_count++];
+    memset(entry->path, 0, sizeof(entry->path));
+    strncpy(entry->path, path, sizeof(entry->path) - 1);
+    entry->texture = texture;
+    return 1;
+}
+
+static int get_env_int(const char* name, int default_value)
+{
+    const char* env = getenv(name);
+    return (env != NULL && atoi(env) >= 0) ? atoi(env) : default_value;
+}
+
+void init_texture_cache(TextureCache* cache)
+{
+    memset(cache, 0, sizeof(*cache));
+    cache->mipmapping = 1;
+    cache->max_size[TEXTURE_PAINTING] = get_env_int("TEXTURE_MAX_PAINTING", 2048);
+    cache->max_size[TEXTURE_ROOM] = get_env_int("TEXTURE_MAX_ROOM", 1024);
+    cache->max_size[TEXTURE_MODEL] = get_env_int("TEXTURE_MAX_MODEL", 1024);
+    cache->budget_bytes = (size_t)get_env_int("TEXTURE_BUDGET_MB", 256) * 1024 * 1024;
+}
+
+static void apply_min_filter(const TextureCache* cache, const CachedTexture* texture)
+{
+    // A single level would be mipmap-incomplete with a mipmap filter (it samples white).
+    glBindTexture(GL_TEXTURE_2D, texture->id);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                    (cache->mipmapping && texture->n_levels > 1) ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+}
+
+/**
+ * Image file decoded (or its transcode cache mapped) by a worker thread
+ */
+typedef struct DecodeJob
+{
+    const char* path;
+    int max_size;
+    int decoded;
+    /* Block compressed levels, or the RGBA image when compressed.blocks is NULL */
+    CompressedTexture compressed;
+    TextureImage image;
+    uint64_t hash;
+    int width;
+    int height;
+} DecodeJob;
+
+/**
+ * Load the file as blocks (from the transcode cache, or encoded and cached now)
+ * when compressing, otherwise as an RGBA mip chain. No GL calls.
+ */
+static void decode_texture(DecodeJob* job, int compress)
+{
+    if (compress && load_texture_transcode(job->path, job->max_size, &job->compressed)) {
+        job->decoded = 1;
+        job->hash = job->compressed.content_hash;
+        job->width = job->compressed.width;
+        job->height = job->compressed.height;
+        return;
+    }
+
+    job->decoded = load_texture_image(job->path, job->max_size, &job->image);
+    if (!job->decoded) {
+        return;
+    }
+    job->hash = hash_texture_image(&job->image);
+    job->width = job->image.width;
+    job->height = job->image.height;
+    if (compress && compress_texture_image(&job->image, job->hash, &job->compressed)) {
+        if (!save_texture_transcode(job->path, job->max_size, &job->compressed)) {
+            printf("[WARN] Could not write the transcode cache of %s\n", job->path);
+        }
+        free_texture_image(&job->image);
+        return;
+    }
+    // The mip chain is CPU work too; a failure leaves it to upload_texture().
+    build_texture_mipmaps(&job->image);
+}
+
+static void free_decoded_texture(DecodeJob* job)
+{
+    free_compressed_texture(&job->compressed);
+    free_texture_image(&job->image);
+}
+
+/**
+ * Register the decoded image of a new path: share the texture of an identical
+ * image or upload it into a free slot (with no references yet).
+ * Frees the decoded data. Returns the slot or -1.
+ */
+static int add_decoded_texture(TextureCache* cache, const char* path, DecodeJob* job)
+{
+    // Another file with the same pixels: share its texture.
+    int slot = find_same_content(cache, job->width, job->height, job->hash);
+    if (slot >= 0) {
+        free_decoded_texture(job);
+        return add_path(cache, path, slot) ? slot : -1;
+    }
+
+    for (int i = 0; i < MAX_CACHED_TEXTURES && slot < 0; i++) {
+        if (cache->textures[i].id == 0) {
+            slot = i;
+        }
+    }
+    if (slot < 0 || cache->path_count >= MAX_CACHED_TEXTURES) {
+        printf("[ERROR] Too many textures (max %d): %s\n", MAX_CACHED_TEXTURES, path);
+        free_decoded_texture(job);
+        return -1;
+    }
+
+    CachedTexture* t = &cache->textures[slot];
+    const size_t budget_left = (cache->resident_bytes < cache->budget_bytes)
+        ? cache->budget_bytes - cache->resident_bytes : 0;
+    t->id = job->compressed.blocks
+        ? upload_compressed_texture(&job->compressed, budget_left, &t->gpu_bytes, &t->n_levels)
+        : upload_texture(&job->image, budget_left, &t->gpu_bytes, &t->n_levels);
+    t->width = job->width;
+    t->height = job->height;
+    t->content_hash = job->hash;
+    t->ref_count = 0;
+    free_decoded_texture(job);
+    if (t->id == 0) {
+        memset(t, 0, sizeof(*t));
+        return -1;
+    }
+    if (!cache->mipmapping) {
+        apply_min_filter(cache, t);
+    }
+    cache->resident_bytes += t->gpu_bytes;
+    add_path(cache, path, slot);
+    return slot;
+}
+
+static GLuint reference_path(TextureCache* cache, int path_index)
+{
+    const int slot = cache->paths[path_index].texture;
+    if (slot < 0) {
+        return 0;
+    }
+    cache->textures[slot].ref_count++;
+    return cache->textures[slot].id;
+}
+
+GLuint acquire_texture(TextureCache* cache, const char* path, TextureClass texture_class)
+{
+    const int known = find_path(cache, path);
+    if (known >= 0) {
+        return reference_path(cache, known);
+    }
+
+    DecodeJob job;
+    memset(&job, 0, sizeof(job));
+    job.path = path;
+    job.max_size = cache->max_size[texture_class];
+    decode_texture(&job, is_texture_compression_supported());
+    if (!job.decoded) {
+        add_path(cache, path, -1);
+        return 0;
+    }
+    if (add_decoded_texture(cache, path, &job) < 0) {
+        return 0;
+    }
+    return reference_path(cache, find_path(cache, path));
+}
+
+/**
+ * Work shared by the decoder threads and the GL thread
+ */
+typedef struct DecodeQueue
+{
+    TextureCache* cache;
+    DecodeJob* jobs;
+    int n_jobs;
+    /* Transcode to S3TC (checked on the GL thread before the workers start) */
+    int compress;
+    /* Next job to decode (taken atomically by the workers). */
+    SDL_atomic_t next_job;
+    /* Handoff queue: finished jobs in completion order. */
+    SDL_mutex* lock;
+    SDL_cond* finished;
+    int* done;
+    int n_done;
+} DecodeQueue;
+
+static void decode_worker(DecodeQueue* queue)
+{
+    for (;;) {
+        const int index = SDL_AtomicAdd(&queue->next_job, 1);
+        if (index >= queue->n_jobs) {
+            return;
+        }
+        decode_texture(&queue->jobs[index], queue->compress);
+
+        SDL_LockMutex(queue->lock);
+        queue->done[queue->n_done++] = index;
+        SDL_CondSignal(queue->finished);
+        SDL_UnlockMutex(queue->lock);
+    }
+}
+
+// Only the GL thread uploads: it takes the finished jobs as they arrive.
+static void upload_worker(DecodeQueue* queue)
+{
+    for (int n_uploaded = 0; n_uploaded < queue->n_jobs; n_uploaded++) {
+        SDL_LockMutex(queue->lock);
+        while (queue->n_done == n_uploaded) {
+            SDL_CondWait(queue->finished, queue->lock);
+        }
+        DecodeJob* job = &queue->jobs[queue->done[n_uploaded]];
+        SDL_UnlockMutex(queue->lock);
+
+        if (job->decoded) {
+            add_decoded_texture(queue->cache, job->path, job);
+        } else {
+            add_path(queue->cache, job->path, -1);
+        }
+    }
+}
+
+static void run_decode_task(void* context, int task_index)
+{
+    // run_parallel() runs the first task on the calling (GL) thread.
+    if (task_index == 0) {
+        upload_worker((DecodeQueue*)context);
+    } else {
+        decode_worker((DecodeQueue*)context);
+    }
+}
+
+void acquire_textures(TextureCache* cache, const char* const* paths, const TextureClass* classes,
+                      int count, GLuint* ids)
+{
+    DecodeJob jobs[MAX_CACHED_TEXTURES];
+    int done[MAX_CACHED_TEXTURES];
+    int n_jobs = 0;
+
+    // The new files, each once.
+    for (int i = 0; i < count; i++) {
+        if (find_path(cache, paths[i]) >= 0 || n_jobs == MAX_CACHED_TEXTURES) {
+            continue;
+        }
+        int queued = 0;
+        for (int k = 0; k < n_jobs && !queued; k++) {
+            queued = (strcmp(jobs[k].path, paths[i]) == 0);
+        }
+        if (!queued) {
+            memset(&jobs[n_jobs], 0, sizeof(jobs[n_jobs]));
+            jobs[n_jobs].path = paths[i];
+            jobs[n_jobs++].max_size = cache->max_size[classes[i]];
+        }
+    }
+
+    if (n_jobs > 0) {
+        const double start_time = get_time_seconds();
+        // Same thread count as the model loader (OBJ_LOAD_THREADS or all cores).
+        int n_decoders = get_load_thread_count();
+        if (n_decoders > n_jobs) {
+            n_decoders = n_jobs;
+        }
+
+        DecodeQueue queue;
+        queue.cache = cache;
+        queue.jobs = jobs;
+        queue.n_jobs = n_jobs;
+        queue.compress = is_texture_compression_supported();
+        SDL_AtomicSet(&queue.next_job, 0);
+        queue.lock = SDL_CreateMutex();
+        queue.finished = SDL_CreateCond();
+        queue.done = done;
+        queue.n_done = 0;
+        if (queue.lock && queue.finished) {
+            run_parallel(run_decode_task, &queue, n_decoders + 1);
+        } else {
+            // No threading primitives: decode on this thread.
+            for (int k = 0; k < n_jobs; k++) {
+                decode_texture(&jobs[k], queue.compress);
+                if (jobs[k].decoded) {
+                    add_decoded_texture(cache, jobs[k].path, &jobs[k]);
+                } else {
+                    add_path(cache, jobs[k].path, -1);
+                }
+            }
+        }
+        if (queue.finished) {
+            SDL_DestroyCond(queue.finished);
+        }
+        if (queue.lock) {
+            SDL_DestroyMutex(queue.lock);
+        }
+        printf("Decoded %d textures in %.1f ms (%d thread%s)\n", n_jobs,
+               (get_time_seconds() - start_time) * 1000.0, n_decoders, (n_decoders > 1) ? "s" : "");
+    }
+
+    for (int i = 0; i < count; i++) {
+        const int known = find_path(cache, paths[i]);
+        ids[i] = (known >= 0) ? reference_path(cache, known) : acquire_texture(cache, paths[i], classes[i]);
+    }
+}
+
+void release_texture(TextureCache* cache, GLuint id)
+{
+    const int slot = find_texture(cache, id);
+    if (slot < 0) {
+        return;
+    }
+    CachedTexture* t = &cache->textures[slot];
+    if (--t->ref_count > 0) {
+        return;
+    }
+
+    glDeleteTextures(1, &t->id);
+    cache->resident_bytes -= t->gpu_bytes;
+    memset(t, 0, sizeof(*t));
+
+    // Forget the paths of the texture, so they are loaded again on the next use.
+    for (int i = 0; i < cache->path_count; ) {
+        if (cache->paths[i].texture == slot) {
+            cache->paths[i] = cache->paths[--cache->path_count];
+        } else {
+            i++;
+        }
+    }
+}
+
+void set_texture_mipmapping(TextureCache* cache, int enabled)
+{
+    cache->mipmapping = enabled;
+    for (int i = 0; i < MAX_CACHED_TEXTURES; i++) {
+        if (cache->textures[i].id != 0) {
+            apply_min_filter(cache, &cache->textures[i]);
+        }
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+size_t get_resident_texture_bytes(const TextureCache* cache)
+{
+    return cache->resident_bytes;
+}
+
+int get_resident_texture_count(const TextureCache* cache)
+{
+    int count = 0;
+    for (int i = 0; i < MAX_CACHED_TEXTURES; i++) {
+        if (cache->textures[i].id != 0) {
+            count++;
+        }
+    }
+    return count;
+}
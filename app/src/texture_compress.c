@@ -0,0 +1,483 @@
+#include "texture_compress.h"
+
+#include <SDL2/SDL.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+#define TRANSCODE_MAGIC 0x58455442U /* "BTEX" */
+#define TRANSCODE_VERSION 2
+#define TRANSCODE_SUFFIX ".btex"
+#define TRANSCODE_PATH_SIZE 512
+
+/* glCompressedTexImage2D is GL 1.3, above the GL 1.1 headers of Windows. */
+typedef void (APIENTRY *CompressedTexImage2DFunc)(GLenum target, GLint level, GLenum internal_format,
+                                                  GLsizei width, GLsizei height, GLint border,
+                                                  GLsizei image_size, const void* data);
+
+static CompressedTexImage2DFunc compressed_tex_image_2d = NULL;
+static int compression_state = -1;
+
+/**
+ * Header of a .btex file (the blocks of the levels follow it)
+ */
+typedef struct TranscodeHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t file_size;
+    /* Size and FNV-1a hash of the bytes of the image file */
+    uint64_t source_size;
+    uint64_t source_hash;
+    uint64_t content_hash;
+    uint32_t format;
+    int32_t width;
+    int32_t height;
+    int32_t n_levels;
+    /* Size cap of the decode (0 = full size) */
+    int32_t max_size;
+    int32_t reserved;
+} TranscodeHeader;
+
+static CompressedTexImage2DFunc get_compressed_tex_image_2d(const char* name)
+{
+    // Copied, because ISO C has no cast between object and function pointers.
+    void* address = SDL_GL_GetProcAddress(name);
+    CompressedTexImage2DFunc function = NULL;
+    if (address && sizeof(function) == sizeof(address)) {
+        memcpy(&function, &address, sizeof(function));
+    }
+    return function;
+}
+
+int is_texture_compression_supported(void)
+{
+    if (compression_state < 0) {
+        const char* env = getenv("TEXTURE_COMPRESSION");
+        compression_state = 0;
+        if ((env == NULL || strcmp(env, "0") != 0)
+            && SDL_GL_ExtensionSupported("GL_EXT_texture_compression_s3tc")) {
+            compressed_tex_image_2d = get_compressed_tex_image_2d("glCompressedTexImage2D");
+            if (!compressed_tex_image_2d) {
+                compressed_tex_image_2d = get_compressed_tex_image_2d("glCompressedTexImage2DARB");
+            }
+            compression_state = (compressed_tex_image_2d != NULL);
+        }
+        printf("Texture compression: %s\n", compression_state ? "S3TC (BC1/BC3)" : "off (RGBA8)");
+    }
+    return compression_state;
+}
+
+static int level_size(int size, int level)
+{
+    size >>= level;
+    return (size > 0) ? size : 1;
+}
+
+static size_t level_bytes(GLenum format, int width, int height)
+{
+    const size_t block_bytes = (format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT) ? 8 : 16;
+    return (size_t)((width + 3) / 4) * (size_t)((height + 3) / 4) * block_bytes;
+}
+
+static size_t chain_bytes(GLenum format, int width, int height, int n_levels)
+{
+    size_t size = 0;
+    for (int level = 0; level < n_levels; level++) {
+        size += level_bytes(format, level_size(width, level), level_size(height, level));
+    }
+    return size;
+}
+
+static int count_levels(int width, int height)
+{
+    int n_levels = 1;
+    while (level_size(width, n_levels - 1) > 1 || level_size(height, n_levels - 1) > 1) {
+        n_levels++;
+    }
+    return n_levels;
+}
+
+/* 4x4 RGBA pixels at (bx, by) in blocks, repeating the last row/column past the edges. */
+static void fetch_block(const unsigned char* pixels, int width, int height, int channels, int bx, int by,
+                        unsigned char block[16][4])
+{
+    for (int y = 0; y < 4; y++) {
+        const int sy = (by * 4 + y < height) ? by * 4 + y : height - 1;
+        for (int x = 0; x < 4; x++) {
+            const int sx = (bx * 4 + x < width) ? bx * 4 + x : width - 1;
+            block[y * 4 + x][3] = 255;
+            memcpy(block[y * 4 + x], pixels + ((size_t)sy * width + sx) * channels, (size_t)channels);
+        }
+    }
+}
+
+static unsigned short pack_565(const int color[3])
+{
+    return (unsigned short)(((color[0] >> 3) << 11) | ((color[1] >> 2) << 5) | (color[2] >> 3));
+}
+
+static void unpack_565(unsigned short packed, int color[3])
+{
+    const int r = (packed >> 11) & 31;
+    const int g = (packed >> 5) & 63;
+    const int b = packed & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+/**
+ * BC1 color block (4 color mode): the endpoints are the inset bounding box of
+ * the colors, along the diagonal that follows the correlation of the channels.
+ */
+static void encode_color_block(unsigned char block[16][4], unsigned char* out)
+{
+    int lo[3] = { 255, 255, 255 };
+    int hi[3] = { 0, 0, 0 };
+    int mean[3] = { 0, 0, 0 };
+    int axis = 0;
+
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < 3; c++) {
+            lo[c] = (block[i][c] < lo[c]) ? block[i][c] : lo[c];
+            hi[c] = (block[i][c] > hi[c]) ? block[i][c] : hi[c];
+            mean[c] += block[i][c];
+        }
+    }
+    for (int c = 0; c < 3; c++) {
+        mean[c] = (mean[c] + 8) / 16;
+        if (hi[c] - lo[c] > hi[axis] - lo[axis]) {
+            axis = c;
+        }
+    }
+    // Channels that fall while the widest one rises run the other way.
+    for (int c = 0; c < 3; c++) {
+        int covariance = 0;
+        for (int i = 0; i < 16 && c != axis; i++) {
+            covariance += (block[i][axis] - mean[axis]) * (block[i][c] - mean[c]);
+        }
+        if (covariance < 0) {
+            const int t = lo[c];
+            lo[c] = hi[c];
+            hi[c] = t;
+        }
+    }
+    for (int c = 0; c < 3; c++) {
+        const int inset = (hi[c] - lo[c]) / 16;
+        hi[c] -= inset;
+        lo[c] += inset;
+    }
+
+    unsigned short c0 = pack_565(hi);
+    unsigned short c1 = pack_565(lo);
+    if (c0 < c1) {
+        const unsigned short t = c0;
+        c0 = c1;
+        c1 = t;
+    }
+    unsigned int indices = 0;
+    if (c0 != c1) {
+        int palette[4][3];
+        unpack_565(c0, palette[0]);
+        unpack_565(c1, palette[1]);
+        for (int c = 0; c < 3; c++) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        for (int i = 0; i < 16; i++) {
+            int best = 0;
+            int best_distance = 0x7FFFFFFF;
+            for (int k = 0; k < 4; k++) {
+                const int dr = block[i][0] - palette[k][0];
+                const int dg = block[i][1] - palette[k][1];
+                const int db = block[i][2] - palette[k][2];
+                const int distance = dr * dr + dg * dg + db * db;
+                if (distance < best_distance) {
+                    best = k;
+                    best_distance = distance;
+                }
+            }
+            indices |= (unsigned int)best << (i * 2);
+        }
+    }
+    out[0] = (unsigned char)(c0 & 0xFF);
+    out[1] = (unsigned char)(c0 >> 8);
+    out[2] = (unsigned char)(c1 & 0xFF);
+    out[3] = (unsigned char)(c1 >> 8);
+    for (int b = 0; b < 4; b++) {
+        out[4 + b] = (unsigned char)(indices >> (b * 8));
+    }
+}
+
+/**
+ * BC3 alpha block (8 alpha mode between the lowest and the highest alpha).
+ */
+static void encode_alpha_block(unsigned char block[16][4], unsigned char* out)
+{
+    int lo = 255;
+    int hi = 0;
+    for (int i = 0; i < 16; i++) {
+        lo = (block[i][3] < lo) ? block[i][3] : lo;
+        hi = (block[i][3] > hi) ? block[i][3] : hi;
+    }
+
+    uint64_t indices = 0;
+    if (hi != lo) {
+        int palette[8];
+        palette[0] = hi;
+        palette[1] = lo;
+        for (int k = 2; k < 8; k++) {
+            palette[k] = ((8 - k) * hi + (k - 1) * lo) / 7;
+        }
+        for (int i = 0; i < 16; i++) {
+            int best = 0;
+            int best_distance = 256;
+            for (int k = 0; k < 8; k++) {
+                const int distance = abs(block[i][3] - palette[k]);
+                if (distance < best_distance) {
+                    best = k;
+                    best_distance = distance;
+                }
+            }
+            indices |= (uint64_t)best << (i * 3);
+        }
+    }
+    out[0] = (unsigned char)hi;
+    out[1] = (unsigned char)lo;
+    for (int b = 0; b < 6; b++) {
+        out[2 + b] = (unsigned char)(indices >> (b * 8));
+    }
+}
+
+static int is_opaque(const TextureImage* image)
+{
+    const size_t n_pixels = (size_t)image->width * (size_t)image->height;
+    if (image->channels == 3) {
+        return 1;
+    }
+    for (size_t i = 0; i < n_pixels; i++) {
+        if (image->pixels[i * 4 + 3] != 255) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int compress_texture_image(TextureImage* image, uint64_t content_hash, CompressedTexture* texture)
+{
+    memset(texture, 0, sizeof(*texture));
+    if (!image->mipmaps && !build_texture_mipmaps(image)) {
+        return 0;
+    }
+
+    const GLenum format = is_opaque(image) ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    const size_t size = chain_bytes(format, image->width, image->height, image->n_levels);
+    unsigned char* blocks = (unsigned char*)malloc(size);
+    if (!blocks) {
+        return 0;
+    }
+
+    unsigned char* out = blocks;
+    for (int level = 0; level < image->n_levels; level++) {
+        int w;
+        int h;
+        const unsigned char* pixels = get_texture_level(image, level, &w, &h);
+        for (int by = 0; by < (h + 3) / 4; by++) {
+            for (int bx = 0; bx < (w + 3) / 4; bx++) {
+                unsigned char block[16][4];
+                fetch_block(pixels, w, h, image->channels, bx, by, block);
+                if (format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT) {
+                    encode_alpha_block(block, out);
+                    out += 8;
+                }
+                encode_color_block(block, out);
+                out += 8;
+            }
+        }
+    }
+
+    texture->format = format;
+    texture->width = image->width;
+    texture->height = image->height;
+    texture->n_levels = image->n_levels;
+    texture->content_hash = content_hash;
+    texture->blocks = blocks;
+    texture->size = size;
+    return 1;
+}
+
+static int make_transcode_path(char* out, size_t out_size, const char* filename)
+{
+    const int length = snprintf(out, out_size, "%s%s", filename, TRANSCODE_SUFFIX);
+    return length > 0 && (size_t)length < out_size;
+}
+
+static int get_source_key(const char* filename, TranscodeHeader* header)
+{
+    MappedFile source;
+    if (!map_file(&source, filename)) {
+        return 0;
+    }
+    // FNV-1a of the file bytes: much cheaper than decoding the image.
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < source.size; i++) {
+        hash ^= (unsigned char)source.data[i];
+        hash *= 1099511628211ULL;
+    }
+    header->source_size = (uint64_t)source.size;
+    header->source_hash = hash;
+    unmap_file(&source);
+    return 1;
+}
+
+int load_texture_transcode(const char* filename, int max_size, CompressedTexture* texture)
+{
+    char path[TRANSCODE_PATH_SIZE];
+    TranscodeHeader key;
+
+    memset(texture, 0, sizeof(*texture));
+    if (!make_transcode_path(path, sizeof(path), filename) || !get_source_key(filename, &key)) {
+        return 0;
+    }
+    if (!map_file(&texture->file, path)) {
+        return 0;
+    }
+
+    const TranscodeHeader* header = (const TranscodeHeader*)texture->file.data;
+    const int valid = texture->file.size >= sizeof(TranscodeHeader)
+        && header->magic == TRANSCODE_MAGIC
+        && header->version == TRANSCODE_VERSION
+        && header->file_size == texture->file.size
+        && header->source_size == key.source_size
+        && header->source_hash == key.source_hash
+        && header->max_size == max_size
+        && (header->format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || header->format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+        && header->width > 0 && header->height > 0
+        && header->n_levels == count_levels(header->width, header->height)
+        && header->file_size - sizeof(TranscodeHeader)
+               == chain_bytes(header->format, header->width, header->height, header->n_levels);
+    if (!valid) {
+        // Stale, from another version or damaged: the caller transcodes again.
+        unmap_file(&texture->file);
+        memset(texture, 0, sizeof(*texture));
+        return 0;
+    }
+
+    texture->format = header->format;
+    texture->width = header->width;
+    texture->height = header->height;
+    texture->n_levels = header->n_levels;
+    texture->content_hash = header->content_hash;
+    texture->blocks = (const unsigned char*)texture->file.data + sizeof(TranscodeHeader);
+    texture->size = texture->file.size - sizeof(TranscodeHeader);
+    texture->is_mapped = 1;
+    return 1;
+}
+
+int save_texture_transcode(const char* filename, int max_size, const CompressedTexture* texture)
+{
+    char path[TRANSCODE_PATH_SIZE];
+    char temp_path[TRANSCODE_PATH_SIZE + 4];
+    TranscodeHeader header;
+
+    memset(&header, 0, sizeof(header));
+    if (!make_transcode_path(path, sizeof(path), filename) || !get_source_key(filename, &header)) {
+        return 0;
+    }
+    header.magic = TRANSCODE_MAGIC;
+    header.version = TRANSCODE_VERSION;
+    header.file_size = sizeof(header) + texture->size;
+    header.content_hash = texture->content_hash;
+    header.format = texture->format;
+    header.width = texture->width;
+    header.height = texture->height;
+    header.n_levels = texture->n_levels;
+    header.max_size = max_size;
+
+    // Write to a temporary file first, so a half-written cache is never picked up.
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+    FILE* file = fopen(temp_path, "wb");
+    if (!file) {
+        return 0;
+    }
+    int success = fwrite(&header, sizeof(header), 1, file) == 1
+        && fwrite(texture->blocks, 1, texture->size, file) == texture->size;
+    success = (fclose(file) == 0) && success;
+    if (!success) {
+        remove(temp_path);
+        return 0;
+    }
+#ifdef _WIN32
+    remove(path);
+#endif
+    if (rename(temp_path, path) != 0) {
+        remove(temp_path);
+        return 0;
+    }
+    return 1;
+}
+
+GLuint upload_compressed_texture(const CompressedTexture* texture, size_t max_bytes, size_t* gpu_bytes,
+                                 int* n_levels)
+{
+    if (!is_texture_compression_supported()) {
+        return 0;
+    }
+
+    // Over the budget: start from a smaller level, like upload_texture().
+    size_t total_bytes = 0;
+    int first_level = texture->n_levels;
+    while (first_level > 0) {
+        const size_t size = level_bytes(texture->format, level_size(texture->width, first_level - 1),
+                                        level_size(texture->height, first_level - 1));
+        if (first_level < texture->n_levels && total_bytes + size > max_bytes) {
+            break;
+        }
+        total_bytes += size;
+        first_level--;
+    }
+
+    GLuint tex = 0;
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+
+    const unsigned char* blocks = texture->blocks + (texture->size - total_bytes);
+    for (int level = first_level; level < texture->n_levels; level++) {
+        const int w = level_size(texture->width, level);
+        const int h = level_size(texture->height, level);
+        const size_t size = level_bytes(texture->format, w, h);
+        compressed_tex_image_2d(GL_TEXTURE_2D, level - first_level, texture->format, w, h, 0, (GLsizei)size, blocks);
+        blocks += size;
+    }
+    set_texture_sampling(texture->n_levels - first_level);
+
+    if (gpu_bytes) {
+        *gpu_bytes = total_bytes;
+    }
+    if (n_levels) {
+        *n_levels = texture->n_levels - first_level;
+    }
+    return tex;
+}
+
+void free_compressed_texture(CompressedTexture* texture)
+{
+    if (texture->is_mapped) {
+        unmap_file(&texture->file);
+    } else {
+        free((void*)texture->blocks);
+    }
+    memset(texture, 0, sizeof(*texture));
+}